@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <malloc.h>
+
+#include "cd.h"
+#include "spu.h"
+#include "util.h"
+#include "spumap.h"
+
+// sfx banks; built for both the player and orgrender, so only through cd.h and the SPU calls host.c stubs
+
+// first used address in the bank, which is where the bank's data starts
+static u32 bank_start_addr(const struct sfx_bank *bank) {
+  for (u32 i = 0; i < bank->num_sfx; ++i)
+    if (bank->sfx_addr[i]) return bank->sfx_addr[i];
+  return 0;
+}
+
+// banks are built for the address they were loaded at by orgconv/sfxconv, but ADPCM data
+// works anywhere, so a bank can be moved by just fixing up its addresses
+static void relocate_sfx_bank(struct sfx_bank *bank, const u32 addr) {
+  const u32 start = bank_start_addr(bank);
+  if (start == addr)
+    return;
+  for (u32 i = 0; i < bank->num_sfx; ++i)
+    if (bank->sfx_addr[i]) bank->sfx_addr[i] = bank->sfx_addr[i] - start + addr;
+}
+
+struct sfx_bank *read_sfx_bank(const char *fname, u8 **data) {
+  cd_file_t *f = cd_fopen(fname, 0);
+  if (!f) panic("could not open bank file '%s'", fname);
+
+  const u32 buflen = cd_fread_u32le(f);
+  const u32 num_sfx = cd_fread_u32le(f);
+
+  struct sfx_bank *bank = malloc(sizeof(*bank) + sizeof(u32) * num_sfx);
+  ASSERT(bank);
+  bank->data_len = buflen;
+  bank->num_sfx = num_sfx;
+  cd_freadordie(&bank->sfx_addr[0], sizeof(u32) * num_sfx, 1, f);
+
+  u8 *buf = malloc(buflen);
+  ASSERT(buf);
+  cd_freadordie(buf, buflen, 1, f);
+
+  // banks with resampled instruments have a pitch multiplier for every sample after the data
+  bank->sfx_pitch = NULL;
+  if (cd_fsize(f) - cd_ftell(f) >= (s32)(sizeof(u16) * num_sfx)) {
+    bank->sfx_pitch = malloc(sizeof(u16) * num_sfx);
+    ASSERT(bank->sfx_pitch);
+    cd_freadordie(bank->sfx_pitch, sizeof(u16) * num_sfx, 1, f);
+  }
+
+  cd_fclose(f);
+
+  printf("bank '%s': read %u bytes of sample data (%u samples)\n", fname, buflen, num_sfx);
+  printf("bank ident: %02x %02x %02x %02x\n", buf[0], buf[1], buf[2], buf[3]);
+
+  *data = buf;
+  return bank;
+}
+
+// loads a bank to `addr`, NULL if its data is longer than max_len
+static struct sfx_bank *load_bank(const char *fname, const u32 addr, const u32 max_len) {
+  printf("loading bank '%s' at addr %u\n", fname, addr);
+
+  u8 *buf;
+  struct sfx_bank *bank = read_sfx_bank(fname, &buf);
+  if (bank->data_len > max_len) {
+    printf("bank '%s': %u bytes of sample data don't fit in %u\n", fname, bank->data_len, max_len);
+    free(buf);
+    free_sfx_bank_tables(bank);
+    return NULL;
+  }
+
+  relocate_sfx_bank(bank, addr);
+
+  SpuSetTransferMode(SPU_TRANSFER_BY_DMA);
+  spu_set_transfer_addr(addr);
+  SpuWrite((void *)buf, bank->data_len);
+  spu_wait_for_transfer();
+  spumap_add(SPUMAP_BANK, addr, bank->data_len, fname, bank);
+
+  free(buf);
+
+  return bank;
+}
+
+struct sfx_bank *load_sfx_bank(const char *fname) {
+  struct sfx_bank *bank = load_bank(fname, spuram_ptr, SPU_RAM_SIZE - spuram_ptr);
+  if (!bank) panic("out of SPU RAM loading '%s'", fname);
+  spuram_ptr += bank->data_len;
+  return bank;
+}
+
+struct sfx_bank *load_sfx_bank_at(const char *fname, const u32 addr, const u32 max_len) {
+  return load_bank(fname, addr, max_len);
+}
+
+void free_sfx_bank_tables(struct sfx_bank *bank) {
+  spumap_remove_bank(bank);
+  if (bank->sfx_pitch)
+    free(bank->sfx_pitch);
+  free(bank);
+}
+
+int free_sfx_bank(struct sfx_bank *bank) {
+  spumap_remove_bank(bank);
+  const u32 prevaddr = spuram_ptr - bank->data_len;
+  if (prevaddr == bank_start_addr(bank))
+    spuram_ptr = prevaddr; // free SPU RAM if this is the last loaded bank
+  if (bank->sfx_pitch)
+    free(bank->sfx_pitch);
+  free(bank);
+  return 0;
+}
@@ -18,6 +18,7 @@
 #define MAX_FHANDLES 1
 
 static const u32 cdmode = CdlModeSpeed;
+static const u32 xamode = CdlModeRT | CdlModeSF; // single speed is all one stereo stream needs
 
 struct cd_file_s {
   char fname[64];
@@ -32,6 +33,9 @@ struct cd_file_s {
 static cd_file_t fhandle;
 static s32 num_fhandles = 0;
 
+static CdlFILE xa_file;
+static s32 xa_start = -1;
+
 void cd_init(void) {
   CdInit();
   // look alive
@@ -196,6 +200,44 @@ int cd_feof(cd_file_t *f) {
   return (f->seccur >= f->secend);
 }
 
+s32 cd_xa_open(const char *fname) {
+  if (CdSearchFile(&xa_file, fname) == NULL) {
+    printf("cd_xa_open(%s): file not found\n", fname);
+    xa_start = -1;
+    return 0;
+  }
+  xa_start = CdPosToInt(&xa_file.pos);
+  // the directory entry counts 2048 bytes for each 2336-byte sector
+  return xa_file.size / SECSIZE / CD_XA_INTERLEAVE;
+}
+
+void cd_xa_play(const s32 sector) {
+  if (xa_start < 0) return;
+  CdlFILTER filter = { .file = CD_XA_FILE, .chan = 0 };
+  CdlATV mix = { .val0 = 0x80, .val1 = 0x00, .val2 = 0x80, .val3 = 0x00 };
+  CdlLOC pos;
+  CdMix(&mix);
+  CdControlB(CdlSetfilter, (u8 *)&filter, 0);
+  CdControlB(CdlSetmode, (u8 *)&xamode, 0);
+  CdIntToPos(xa_start + sector * CD_XA_INTERLEAVE, &pos);
+  CdControlB(CdlSetloc, (u8 *)&pos, 0);
+  CdControl(CdlReadS, 0, 0);
+}
+
+void cd_xa_stop(void) {
+  CdControlB(CdlPause, 0, 0);
+  CdControlB(CdlSetmode, (u8 *)&cdmode, 0);
+}
+
+s32 cd_xa_tell(void) {
+  u8 res[8];
+  if (xa_start < 0 || !CdControlB(CdlGetlocP, 0, res))
+    return -1;
+  // track, index, relative mm:ss:ff, absolute mm:ss:ff, all BCD like CdlLOC
+  CdlLOC pos = { .minute = res[5], .second = res[6], .sector = res[7] };
+  return CdPosToInt(&pos) - xa_start;
+}
+
 u8 cd_fread_u8(cd_file_t *f) {
   u8 res = 0;
   cd_freadordie(&res, 1, 1, f);
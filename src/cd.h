@@ -6,6 +6,10 @@
 #define CD_MAX_FILENAME 16
 #define CD_MAX_PATH (128 + CD_MAX_FILENAME)
 
+// XA files interleave one sector of the stream with this many - 1 of padding, for 37.8kHz stereo at single speed
+#define CD_XA_INTERLEAVE 4
+#define CD_XA_FILE 1
+
 typedef struct cd_file_s cd_file_t;
 
 void cd_init(void);
@@ -20,6 +24,14 @@ s32 cd_fsize(cd_file_t *f);
 int cd_feof(cd_file_t *f);
 int cd_scandir(const char *dir, char out[][CD_MAX_FILENAME], const char *filter);
 
+// streams channel 0 of an XA file through the CD-ROM's ADPCM decoder; no files can be read meanwhile
+// returns the number of audio sectors in the file or 0 if it's not there
+s32 cd_xa_open(const char *fname);
+void cd_xa_play(const s32 sector);
+void cd_xa_stop(void);
+// sectors read since the start of the file, including other channels
+s32 cd_xa_tell(void);
+
 u8 cd_fread_u8(cd_file_t *f);
 u16 cd_fread_u16le(cd_file_t *f);
 u32 cd_fread_u32le(cd_file_t *f);
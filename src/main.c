@@ -11,16 +11,58 @@
 #include "cd.h"
 #include "util.h"
 #include "org.h"
+#include "sfx.h"
+#include "sfxpool.h"
+#include "playlist.h"
+#include "tickprof.h"
+#include "spumap.h"
 
 #define MAX_MENU_FILES 128
 #define MENU_DISP_FILES 20
 
+// playlist songs play their loop this many times, then the next one starts right after
+#define PLAYLIST_LOOPS 1
+#define PLAYLIST_FADE_MS 0
+
+// square fades the song out and back in
+#define SONG_FADE_MS 2000
+// everything fades in from silence when a player starts
+#define PLAYER_FADE_IN_MS 500
+
+// SFX stay in main RAM and get uploaded to this much SPU RAM as they're played; 0 keeps all of SFX.BNK there
+#define SFX_POOL_SIZE (128 * 1024)
+
+// the SPU RAM map draws a block for every MAP_CELL bytes from SPU_RAM_START on, MAP_COLS to a row
+#define MAP_CELL 256
+#define MAP_COLS 64
+#define MAP_FIRST_CELL (SPU_RAM_START / MAP_CELL)
+#define MAP_NUM_CELLS (SPU_RAM_SIZE / MAP_CELL - MAP_FIRST_CELL)
+#define MAP_X 32
+#define MAP_Y 136
+#define MAP_CELL_W 4
+#define MAP_CELL_H 3
+#define MAP_MAX_SAMPLES 256
+#define MAP_MAX_LIST 10
+
+enum player_mode {
+  PLAYER_SEQ, // sequenced on the SPU by org_tick()
+  PLAYER_XA,  // pre-rendered, streamed from \XA\<name>.XA
+  PLAYER_PLAYLIST, // sequenced, every song in the menu from the selected one on
+};
+
 static char padbuf[2][34];
 static DISPENV disp[2];
 static DRAWENV draw[2];
 static int db;
 
 static struct sfx_bank *bnk_sfx;
+static struct sfx_bank *bnk_drum;
+static struct sfx_bank *bnk_wave;
+static s8 *wavetable;
+
+static char menu_files[MAX_MENU_FILES][CD_MAX_FILENAME];
+static int menu_numfiles;
+static int menu_pos;
 
 static u16 pad_btn = 0xFFFF;
 static u16 pad_btn_old = 0xFFFF;
@@ -76,14 +118,113 @@ static inline void btn_scan(void) {
   pad_btn = ((PADTYPE *)padbuf[0])->btn;
 }
 
-static void draw_tracks(void) {
+// free, pool, slot, then two shades each for synthesized instruments, pool samples and 4 bank colors
+enum { MAP_FREE, MAP_POOL, MAP_SLOT, MAP_SYNTH, MAP_POOL_SAMPLE = MAP_SYNTH + 2, MAP_BANK = MAP_POOL_SAMPLE + 2, MAP_NUM_COLORS = MAP_BANK + 8 };
+static const u8 map_colors[MAP_NUM_COLORS][3] = {
+  { 40, 40, 48 }, { 0, 56, 64 }, { 48, 0, 64 },
+  { 224, 120, 0 }, { 160, 80, 0 },
+  { 0, 208, 176 }, { 0, 144, 128 },
+  { 224, 192, 0 }, { 160, 136, 0 }, { 0, 160, 224 }, { 0, 104, 160 },
+  { 224, 80, 80 }, { 160, 48, 48 }, { 128, 208, 64 }, { 88, 144, 40 },
+};
+
+static u8 map_cells[MAP_NUM_CELLS];
+static TILE map_tiles[MAP_NUM_CELLS + 1];
+static u32 map_ot;
+static spumap_sample_t map_samples[MAP_MAX_SAMPLES];
+
+// colors the cells from addr on, cells only partly in it included
+static void map_paint(const u32 addr, const u32 len, const u8 color) {
+  if (!len || addr + len <= SPU_RAM_START)
+    return;
+  s32 first = (s32)(addr / MAP_CELL) - MAP_FIRST_CELL;
+  s32 last = (s32)((addr + len - 1) / MAP_CELL) - MAP_FIRST_CELL;
+  if (first < 0) first = 0;
+  if (last >= MAP_NUM_CELLS) last = MAP_NUM_CELLS - 1;
+  for (s32 i = first; i <= last; ++i)
+    map_cells[i] = color;
+}
+
+// every region and sample in SPU RAM as colored blocks, what spuram_ptr is and how the free space is split up
+static void draw_spu_map(void) {
+  spumap_stats_t st;
+  spumap_get_stats(&st);
+  u32 count;
+  const spumap_region_t *regions = spumap_get_regions(&count);
+
+  FntPrint(-1, "\n SPU RAM              SELECT: BACK\n");
+  FntPrint(-1, " USED %6u FREE %6u PTR %05X\n", st.used, st.free, st.ptr);
+  FntPrint(-1, " GAPS %3u MAX %6u FRAG %3u%%", st.num_gaps, st.largest_gap, st.fragmentation);
+  if (st.overlaps)
+    FntPrint(-1, " OVERLAP %u", st.overlaps);
+  FntPrint(-1, "\n\n");
+
+  memset(map_cells, MAP_FREE, sizeof(map_cells));
+  u32 listed = 0, banks = 0;
+  for (u32 i = 0; i < count; ++i) {
+    const spumap_region_t *r = &regions[i];
+    // what's in the pool gets too many to list
+    if (r->kind != SPUMAP_POOL_SAMPLE && listed < MAP_MAX_LIST) {
+      FntPrint(-1, " %-5s %-11s %05X %6u", spumap_kind_name(r->kind), r->name, r->addr, r->len);
+      if (r->kind == SPUMAP_POOL || r->kind == SPUMAP_SLOT)
+        FntPrint(-1, " %3u%%", r->len ? r->used * 100 / r->len : 0);
+      FntPrint(-1, "\n");
+      ++listed;
+    }
+
+    u8 color;
+    switch (r->kind) {
+      case SPUMAP_POOL: color = MAP_POOL; break;
+      case SPUMAP_SLOT: color = MAP_SLOT; break;
+      case SPUMAP_SYNTH: color = MAP_SYNTH; break;
+      case SPUMAP_POOL_SAMPLE: color = MAP_POOL_SAMPLE + (r->addr / 8 & 1); break;
+      default: color = MAP_BANK + (banks++ & 3) * 2; break;
+    }
+    // samples alternate between the two shades
+    u32 n = spumap_get_samples(r, map_samples, MAP_MAX_SAMPLES);
+    if (n > MAP_MAX_SAMPLES) n = MAP_MAX_SAMPLES;
+    if (!n)
+      map_paint(r->addr, r->len, color);
+    for (u32 j = 0; j < n; ++j)
+      map_paint(map_samples[j].addr, map_samples[j].len, color + (j & 1));
+  }
+
+  // one tile per run of the same color in a row, then a line where spuram_ptr is
+  ClearOTagR(&map_ot, 1);
+  u32 num_tiles = 0;
+  for (u32 i = 0; i < MAP_NUM_CELLS; ) {
+    const u32 row = i / MAP_COLS;
+    const u32 start = i;
+    const u8 color = map_cells[i];
+    while (i < MAP_NUM_CELLS && i / MAP_COLS == row && map_cells[i] == color)
+      ++i;
+    TILE *t = &map_tiles[num_tiles++];
+    setTile(t);
+    setXY0(t, MAP_X + (start % MAP_COLS) * MAP_CELL_W, MAP_Y + row * MAP_CELL_H);
+    setWH(t, (i - start) * MAP_CELL_W, MAP_CELL_H);
+    setRGB0(t, map_colors[color][0], map_colors[color][1], map_colors[color][2]);
+    addPrim(&map_ot, t);
+  }
+  if (st.ptr >= SPU_RAM_START && st.ptr < SPU_RAM_SIZE) {
+    const u32 cell = st.ptr / MAP_CELL - MAP_FIRST_CELL;
+    TILE *t = &map_tiles[num_tiles++];
+    setTile(t);
+    setXY0(t, MAP_X + (cell % MAP_COLS) * MAP_CELL_W, MAP_Y + (cell / MAP_COLS) * MAP_CELL_H);
+    setWH(t, 1, MAP_CELL_H);
+    setRGB0(t, 255, 255, 255);
+    addPrim(&map_ot, t);
+  }
+  DrawOTag(&map_ot);
+}
+
+static void draw_tracks(org_state_t *song) {
   FntPrint(-1, " TRACKS\n\n");
   FntPrint(-1, " 000 001 002 003 004 005 006 007 008");
 
   org_note_t dummy = { 0 };
   org_note_t *n[ORG_MAX_TRACKS];
   for (int i = 0; i <= 8; ++i) {
-    n[i] = org_get_track_pos(i);
+    n[i] = org_get_track_pos(song, i);
     if (!n[i]) n[i] = &dummy;
   }
 
@@ -105,15 +246,50 @@ static void draw_tracks(void) {
 }
 
 static volatile u32 play_org = 0;
+static org_state_t *song;
+static int playlist_mode;
+static u32 timer_wait; // ms per tick the timer runs at
 
+// SFX are queued by the main loop and started here, in the same place the sequencer gets its voices
 static void mus_callback(void) {
-  if (play_org)
-    org_tick();
+  tickprof_begin();
+  spu_trace_tick();
+  if (play_org && playlist_mode) {
+    // the next song might have a different tempo
+    const u32 wait = playlist_tick();
+    if (wait != timer_wait) {
+      timer_wait = wait;
+      SetRCnt(RCntCNT1, org_wait_to_timer(wait), RCntMdINTR);
+    }
+  } else if (play_org) {
+    org_tick(song);
+  }
+  sfx_flush();
+  tickprof_end();
+}
+
+// min/avg/max of the timer IRQ and the flushes in it, a histogram of 60 us steps and the ticks that overran
+static void draw_tick_profile(void) {
+  tickprof_stats_t st;
+  tickprof_get_stats(&st);
+  u32 peak = 1;
+  for (int i = 0; i < TICKPROF_BUCKETS; ++i)
+    if (st.hist[i] > peak) peak = st.hist[i];
+  char hist[TICKPROF_BUCKETS + 1];
+  for (int i = 0; i < TICKPROF_BUCKETS; ++i)
+    hist[i] = st.hist[i] ? '1' + (st.hist[i] - 1) * 9 / peak : '.';
+  hist[TICKPROF_BUCKETS] = '\0';
+  FntPrint(-1, " IRQ %3u/%3u/%4uUS SPU %3u/%4uUS\n", st.min_us, st.avg_us, st.max_us, st.flush_avg_us, st.flush_max_us);
+  FntPrint(-1, " %s OVR %u", hist, st.overruns);
+  if (st.overruns)
+    FntPrint(-1, " @%u", st.last_overrun);
+  FntPrint(-1, "\n");
 }
 
 static void timer_start(const u32 rate) {
   EnterCriticalSection();
-  const u32 tick = 15625 * rate / 1000;
+  timer_wait = rate;
+  const u32 tick = org_wait_to_timer(rate);
   SetRCnt(RCntCNT1, tick, RCntMdINTR);
   InterruptCallback(5, mus_callback); // IRQ5 is RCNT1
   StartRCnt(RCntCNT1);
@@ -127,18 +303,73 @@ static void timer_stop(void) {
   ExitCriticalSection();
 }
 
-static void run_player(const char *orgname) {
-  org_load(orgname);
+// the XA version needs no instruments in SPU RAM and no timer, so it plays alongside heavy SFX use
+static int xa_start(const char *orgname, s32 *num_sectors, s32 *loop_sector) {
+  char tmp[256];
+  org_info_t info;
+  if (!org_get_info(orgname, &info))
+    return 0;
+  snprintf(tmp, sizeof(tmp), "\\XA\\%s.XA;1", orgname);
+  *num_sectors = cd_xa_open(tmp);
+  if (!*num_sectors)
+    return 0;
+  *loop_sector = *num_sectors - org_xa_loop_sectors(&info);
+  if (*loop_sector < 0)
+    *loop_sector = 0;
+  spu_set_cd_volume(SPU_MAX_VOLUME);
+  cd_xa_play(0);
+  return 1;
+}
+
+static void run_player(const char *orgname, const enum player_mode mode) {
+  s32 xa_sectors = 0;
+  s32 xa_loop = 0;
+  s32 xa_pos = 0;
+
+  if (mode == PLAYER_XA) {
+    if (!xa_start(orgname, &xa_sectors, &xa_loop))
+      return;
+    play_org = 1;
+  } else if (mode == PLAYER_PLAYLIST) {
+    const u32 slot_size = playlist_slot_size(menu_files, menu_numfiles);
+    if (!playlist_start(menu_files, menu_numfiles, menu_pos, slot_size, SPU_ALL_VOICES, PLAYLIST_LOOPS, PLAYLIST_FADE_MS))
+      return;
+    playlist_mode = 1;
+    song = playlist_get_song();
+    timer_start(org_get_wait(song));
+    play_org = 1;
+  } else {
+    song = org_load(orgname, SPU_ALL_VOICES);
+    if (!song)
+      return;
+    timer_start(org_get_wait(song));
+  }
+
+  spu_set_master_volume(0);
+  spu_fade_master(SPU_MAX_VOLUME, PLAYER_FADE_IN_MS);
+
+  // the profile is per song
+  int prof_index = -1;
+  if (TICK_PROFILE) {
+    EnterCriticalSection();
+    tickprof_reset();
+    ExitCriticalSection();
+  }
 
-  timer_start(org_get_wait());
+  // the last SPU_TRACE_RING_LEN register writes, for dumping from an emulator or debugger
+  if (SPU_TRACE) {
+    EnterCriticalSection();
+    spu_trace_start(NULL);
+    ExitCriticalSection();
+    printf("run_player(%s): SPU trace ring at %p\n", orgname, (const void *)spu_trace_get_ring());
+  }
 
   u32 sfx = 1;
+  int show_map = 0;
   u16 mute_cur = 0;
   u16 mute_mask = 0;
   char mute_chans[17] = "................";
 
-  spu_set_voice_volume(0, SPU_MAX_VOLUME);
-
   while (1) {
     btn_scan();
 
@@ -158,36 +389,111 @@ static void run_player(const char *orgname) {
       else ++mute_cur;
     }
 
-    if (btn_pressed(PAD_CROSS) && bnk_sfx->sfx_addr[sfx])
-      spu_play_sample(0, bnk_sfx->sfx_addr[sfx], 22050);
+    if (btn_pressed(PAD_CROSS))
+      sfx_play(sfx, freq2pitch(22050), SPU_MAX_VOLUME, 0, SPU_PRIO_SFX);
     else if (btn_released(PAD_CROSS))
-      spu_key_off(SPU_VOICECH(0));
+      sfx_stop(sfx);
+
+    // there's no timer running for the XA version
+    if (mode == PLAYER_XA)
+      sfx_flush();
 
     if (btn_pressed(PAD_CIRCLE)) {
       play_org = !play_org;
-      if (!play_org)
-        spu_key_off(0xFFFFFFFF);
+      if (mode == PLAYER_XA) {
+        if (play_org) cd_xa_play(xa_pos / CD_XA_INTERLEAVE);
+        else cd_xa_stop();
+      } else if (!play_org) {
+        // SFX still get started from the timer IRQ
+        EnterCriticalSection();
+        if (playlist_mode) playlist_stop_voices();
+        else org_stop_voices(song);
+        ExitCriticalSection();
+      }
+    }
+
+    if (mode == PLAYER_XA && play_org) {
+      // the drive has read past the last sector of the stream, go back to the start of the loop
+      const s32 pos = cd_xa_tell();
+      if (pos > (xa_sectors - 1) * CD_XA_INTERLEAVE)
+        cd_xa_play(xa_loop);
+      else if (pos >= 0)
+        xa_pos = pos;
     }
 
-    if (btn_pressed(PAD_TRIANGLE)) {
+    if (mode == PLAYER_PLAYLIST) {
+      playlist_update();
+      song = playlist_get_song();
+      orgname = menu_files[playlist_get_index()];
+      if (TICK_PROFILE && prof_index != playlist_get_index()) {
+        prof_index = playlist_get_index();
+        EnterCriticalSection();
+        tickprof_reset();
+        ExitCriticalSection();
+      }
+    }
+
+    if (btn_pressed(PAD_SQUARE) && mode != PLAYER_XA) {
+      EnterCriticalSection();
+      if (org_get_fade(song) < 0) org_fade_in(song, SONG_FADE_MS);
+      else org_fade_out(song, SONG_FADE_MS);
+      ExitCriticalSection();
+    }
+
+    if (btn_pressed(PAD_TRIANGLE) && mode == PLAYER_SEQ) {
       mute_mask ^= (1 << mute_cur);
       mute_chans[mute_cur] = (mute_chans[mute_cur] == 'm') ? '.' : 'm';
-      org_set_mute_mask(mute_mask);
+      EnterCriticalSection();
+      org_set_mute_mask(song, mute_mask);
+      ExitCriticalSection();
     }
 
     if (btn_pressed(PAD_START))
       break;
 
+    if (btn_pressed(PAD_SELECT))
+      show_map = !show_map;
+
+    if (show_map) {
+      draw_spu_map();
+      FntFlush(-1);
+      display();
+      continue;
+    }
+
+    FntPrint(-1, "\n X, O: PLAY  DPAD: CHANGE  START: BACK\n SQUARE: FADE  SELECT: SPU RAM\n\n");
+    sfx_stats_t stats;
+    sfx_get_stats(&stats);
+    FntPrint(-1, " SFX: %03d / %03d\n", sfx, bnk_sfx->num_sfx - 1);
+    FntPrint(-1, " PLAY %4d LIM %3d STL %3d DRP %3d\n", stats.played, stats.limited, stats.stolen, stats.dropped);
+    if (SFX_POOL_SIZE) {
+      sfx_pool_stats_t pool;
+      sfx_pool_get_stats(&pool);
+      FntPrint(-1, " HIT %4d MISS %3d EVI %3d UP %4uUS\n", pool.hits, pool.misses, pool.evictions, pool.upload_us_last);
+    }
+    FntPrint(-1, "\n");
+
+    if (mode == PLAYER_XA) {
+      FntPrint(-1, " XA: %4d / %4d\n", xa_pos / CD_XA_INTERLEAVE, xa_sectors);
+      FntPrint(-1, " LOOP: %4d\n", xa_loop);
+      FntPrint(-1, "\n\n\n %s.XA", orgname);
+      FntFlush(-1);
+      display();
+      continue;
+    }
+
     // HACK
     const char old = mute_chans[mute_cur];
     mute_chans[mute_cur] = (old == 'm') ? 'X' : ',';
 
-    FntPrint(-1, "\n X, O: PLAY\n DPAD: CHANGE\n START: BACK\n\n");
-    FntPrint(-1, " SFX: %03d / %03d\n\n", sfx, bnk_sfx->num_sfx - 1);
-    FntPrint(-1, " ORG: %4d\n", org_get_pos());
+    u32 ram, spuram;
+    org_get_mem_usage(song, &ram, &spuram);
+    FntPrint(-1, " ORG: %4d MEM: %5u + %6u SPU\n", org_get_pos(song), ram, spuram);
+    if (TICK_PROFILE)
+      draw_tick_profile();
     FntPrint(-1, " CHN: %s\n\n", mute_chans);
-    draw_tracks();
-    FntPrint(-1, "\n\n\n %s.ORG", orgname);
+    draw_tracks(song);
+    FntPrint(-1, "\n\n %s.ORG", orgname);
     FntFlush(-1);
     display();
 
@@ -195,19 +501,35 @@ static void run_player(const char *orgname) {
   }
 
   play_org = 0;
-  timer_stop();
+  if (mode == PLAYER_XA) {
+    cd_xa_stop();
+  } else if (mode == PLAYER_PLAYLIST) {
+    timer_stop();
+    playlist_stop();
+    playlist_mode = 0;
+    song = NULL;
+  } else {
+    timer_stop();
+    org_free(song);
+    song = NULL;
+  }
   spu_clear_all_voices();
-  org_free();
 }
 
-static const char *run_menu(void) {
-  static char files[MAX_MENU_FILES][CD_MAX_FILENAME];
-  int numfiles = 0;
+static const char *run_menu(enum player_mode *mode) {
+  char (*files)[CD_MAX_FILENAME] = menu_files;
 
   // scan root CD directory if needed
-  numfiles = cd_scandir("\\ORG", files, ".ORG");
+  const int numfiles = cd_scandir("\\ORG", files, ".ORG");
   if (numfiles < 0)
     panic("could not scan ORG directory");
+  menu_numfiles = numfiles;
+
+  // nuke everything after the extension, the playlist needs all the names like that
+  for (int i = 0; i < numfiles; ++i) {
+    char *dot = strrchr(files[i], '.');
+    if (dot) *dot = '\0';
+  }
 
   int filepos = 0;
 
@@ -222,10 +544,11 @@ static const char *run_menu(void) {
       else --filepos;
     }
 
-    if (btn_pressed(PAD_CROSS) && numfiles) {
-      // nuke everything after the extension
-      char *dot = strrchr(files[filepos], '.');
-      if (dot) *dot = '\0';
+    if ((btn_pressed(PAD_CROSS) || btn_pressed(PAD_SQUARE) || btn_pressed(PAD_TRIANGLE)) && numfiles) {
+      if (btn_pressed(PAD_SQUARE)) *mode = PLAYER_XA;
+      else if (btn_pressed(PAD_TRIANGLE)) *mode = PLAYER_PLAYLIST;
+      else *mode = PLAYER_SEQ;
+      menu_pos = filepos;
       return files[filepos];
     }
 
@@ -233,6 +556,8 @@ static const char *run_menu(void) {
       break;
 
     FntPrint(-1, "\n SELECT FILE AND PRESS X\n");
+    FntPrint(-1, " (OR SQUARE FOR THE XA VERSION,\n");
+    FntPrint(-1, " TRIANGLE TO PLAY ALL FROM HERE)\n");
     FntPrint(-1, " OR SWAP CD AND PRESS START\n\n");
 
     if (!numfiles) {
@@ -255,14 +580,45 @@ static const char *run_menu(void) {
 int main(int argc, char **argv) {
   init();
 
-  bnk_sfx = load_sfx_bank("\\BNK\\SFX.BNK;1");
-  org_init(bnk_sfx);
+  // songs without their own drums use these, or the ones in SFX.BNK if there's no drum bank
+  if (cd_fexists("\\BNK\\DRUM.BNK;1"))
+    bnk_drum = load_sfx_bank("\\BNK\\DRUM.BNK;1");
+
+  if (SFX_POOL_SIZE) {
+    bnk_sfx = sfx_pool_init("\\BNK\\SFX.BNK;1", SFX_POOL_SIZE);
+    // the sequencer reads drum addresses straight from the bank, so they stay
+    if (!bnk_drum) {
+      u16 drums[ORG_NUM_DRUMS];
+      u32 num_drums = 0;
+      for (u32 i = 0; i < ORG_NUM_DRUMS; ++i)
+        if (!(org_get_noise_drums() & (1 << i)))
+          drums[num_drums++] = ORG_DRUM_BANK_BASE + i;
+      sfx_pool_preload(drums, num_drums, 1);
+    }
+  } else {
+    bnk_sfx = load_sfx_bank("\\BNK\\SFX.BNK;1");
+  }
+  sfx_init(bnk_sfx);
+  // these loop (see tools/src/sfxconv.c), one of each is enough
+  static const u8 looping_sfx[] = { 7, 40, 41, 58 };
+  for (u32 i = 0; i < sizeof(looping_sfx); ++i) {
+    sfx_set_looping(looping_sfx[i], 1);
+    sfx_set_limit(looping_sfx[i], 1);
+  }
+  // if there's a shared wave bank, songs don't need their own banks
+  if (cd_fexists("\\BNK\\WAVE.BNK;1"))
+    bnk_wave = load_sfx_bank("\\BNK\\WAVE.BNK;1");
+  // otherwise if there's a wavetable, songs' instruments can be made on the fly
+  else if (cd_fexists("\\WAVE.DAT;1"))
+    wavetable = load_file("\\WAVE.DAT;1", NULL);
+  org_init(bnk_drum ? bnk_drum : bnk_sfx, bnk_wave, wavetable);
 
   while (1) {
     const char *org = NULL;
+    enum player_mode mode = PLAYER_SEQ;
     while (!org)
-      org = run_menu();
-    run_player(org);
+      org = run_menu(&mode);
+    run_player(org, mode);
   }
 
   return 0;
@@ -8,18 +8,21 @@
 #include "spu.h"
 #include "org.h"
 #include "cd.h"
+#include "synth.h"
+#include "spumap.h"
 
 #define ORG_MAGIC "Org-0"
 #define ORG_MAGICLEN 5
 
 #define MAX_TRACKS ORG_MAX_TRACKS
 #define MAX_MELODY_TRACKS 8
-#define MAX_DRUM_TRACKS 8
+#define MAX_DRUM_TRACKS ORG_NUM_DRUMS
 
-#define NUM_OCTS 8
+#define NUM_OCTS SYNTH_NUM_OCTS
 #define NUM_ALTS 2
+#define NUM_WAVEFORMS SYNTH_NUM_WAVEFORMS
 
-#define DRUM_BANK_BASE 150
+#define DRUM_BANK_BASE ORG_DRUM_BANK_BASE
 
 #define PANDUMMY 0xFF
 #define VOLDUMMY 0xFF
@@ -53,52 +56,146 @@ typedef struct {
 typedef struct {
   org_note_t *notes;
   org_note_t *cur_note;
+  const u32 *inst_addr; // [NUM_OCTS] sample addresses for each octave
+  const u16 *inst_pitch; // [NUM_OCTS] pitch multipliers for each octave or NULL
   s32 vol;
   u32 sustain;
   s8 mute;
   u8 old_key;
+  s8 voice; // last voice the track got from the allocator, -1 if none
+  s16 pan;  // for when it gets a new one
 } org_trackstate_t;
 
-typedef struct {
+struct org_state {
   org_hdr_t info;
   org_trackstate_t tracks[MAX_TRACKS];
+  struct sfx_bank *inst_bank; // the song's own instruments, NULL if it uses the wave bank
+  u32 drum_addr[MAX_DRUM_TRACKS]; // from its own bank if that has them, else from the shared one; 0 if there's none
+  u32 voice_mask; // voices the song may take
+  u32 key_on_mask; // all the keys that got keyed on this tick
+  u32 key_off_mask; // all the keys that got keyed off this tick
+  u32 mem_size; // bytes of main RAM the instance takes
+  u32 slot_addr; // where in SPU RAM its own instruments go if it was loaded into a slot
+  u32 slot_size; // 0 if they're just put at spuram_ptr
+  u32 loops; // times it has gone back to repeat_x
   s32 vol;
   s32 pos;
-  u8 fadeout;
+  u32 fade_ticks; // length of the fade going on
+  u32 fade_left; // ticks until it's done, 0 if there's none
+  s8 fade_dir; // -1 out, 1 in
+  u8 faded; // faded out, silent until it fades back in
+  u16 sweep_tracks; // tracks that got new voices during the fade, they join it on the next tick
   s8 track;
   u8 def_pan;
   u8 def_vol;
-} org_state_t;
+};
 
-static u32 key_on_mask; // all the keys that got keyed on this tick
-static u32 key_off_mask; // all the keys that got keyed off this tick
-static org_state_t org;
-static struct sfx_bank *inst_bank;
+// shared by every instance
 static struct sfx_bank *drum_bank;
+static struct sfx_bank *wave_bank;
+static const s8 *wavetable;
+static u8 noise_drum_mask = ORG_NOISE_DRUMS;
+
+// a drum on the noise generator: its clock at NOISE_KEY, which goes up 4 steps an octave like the pitch of the
+// samples, its envelope, how long it lasts at most and how loud it is next to the sample, in 1/128ths
+struct noise_drum {
+  u8 clock;
+  u8 vol;
+  u16 adsr_lo;
+  u16 adsr_hi;
+  u16 len_ms;
+};
 
-s32 org_freqshift = 0;
-
-static const struct {
-  s16 wave_size;
-  s16 oct_par;
-  s16 oct_size;
-} oct_wave[NUM_OCTS] = {
-  { 256,   1,  4 }, // 0 Oct
-  { 256,   2,  8 }, // 1 Oct
-  { 128,   4, 12 }, // 2 Oct
-  { 128,   8, 16 }, // 3 Oct
-  {  64,  16, 20 }, // 4 Oct
-  {  32,  32, 24 }, // 5 Oct
-  {  16,  64, 28 }, // 6 Oct
-  {   8, 128, 32 }, // 7 Oct
+#define NOISE_KEY 48
+
+// adsr_lo: instant attack, exponential decay at shift (bits 4-7) down to (n + 1) / 16 (bits 0-3);
+// adsr_hi: exponential decrease at shift (bits 8-12) from there on; every shift up doubles the time
+static const struct noise_drum noise_drums[MAX_DRUM_TRACKS] = {
+  { 36,  96, 0x0080, 0xC900, 120 }, // bass drum: low rumble, short
+  { 54,  80, 0x0072, 0xCA00, 200 }, // snare
+  { 63,  48, 0x0060, 0xC800, 60  }, // closed hat
+  { 62,  64, 0x0083, 0xCB00, 400 }, // open hat
+  { 44,  88, 0x0091, 0xCA00, 200 }, // tom
+  { 58,  64, 0x0060, 0xC800, 80  }, // percussion
+  { 60,  64, 0x0073, 0xCA00, 250 },
+  { 60,  64, 0x0073, 0xCA00, 250 },
 };
 
+s32 org_freqshift = 0;
+
 static const s16 freq_tbl[12] = { 262, 277, 294, 311, 330, 349, 370, 392, 415, 440, 466, 494 };
 static const s16 pan_tbl[13] = { 0, 43, 86, 129, 172, 215, 256, 297, 340, 383, 426, 469, 512 };
 
-static void org_read_track(cd_file_t *f, const int track) {
-  const org_trackhdr_t *hdr = &org.info.tdata[track];
-  org_trackstate_t *dst = &org.tracks[track];
+// the track's voice if nobody has taken it away, -1 otherwise
+static inline s32 org_track_voice(org_state_t *org, const int trk) {
+  const s32 ch = org->tracks[trk].voice;
+  return (ch >= 0 && spu_voice_owned(ch, &org->tracks[trk])) ? ch : -1;
+}
+
+// the song's volume right now, 0 to 100
+static s32 org_cur_vol(const org_state_t *org) {
+  if (org->fade_left) {
+    const u32 at = (org->fade_dir < 0) ? org->fade_left : org->fade_ticks - org->fade_left;
+    return org->vol * at / org->fade_ticks;
+  }
+  return org->faded ? 0 : org->vol;
+}
+
+static inline int org_is_noise_drum(const int trk) {
+  return trk >= MAX_MELODY_TRACKS && (noise_drum_mask & (1 << (trk - MAX_MELODY_TRACKS)));
+}
+
+static inline s16 org_track_vol(const org_state_t *org, const int trk, const s32 vol) {
+  if (org_is_noise_drum(trk))
+    return ((org->tracks[trk].vol * vol / 0x7F) * noise_drums[trk - MAX_MELODY_TRACKS].vol) >> 2;
+  return (org->tracks[trk].vol * vol / 0x7F) << 5;
+}
+
+// hands a voice over to the SPU for the rest of the fade
+static inline void org_sweep_voice(org_state_t *org, const int trk, const s32 ch) {
+  const s16 vol = (org->fade_dir < 0) ? 0 : org_track_vol(org, trk, org->vol);
+  spu_sweep_voice(ch, vol, org->fade_left * org->info.wait);
+}
+
+// a voice to start a note on: the one the track already has or a new one, set up with its volume and pan
+static s32 org_note_voice(org_state_t *org, const int trk, const u8 flags) {
+  s32 ch = org_track_voice(org, trk);
+  if (ch >= 0) {
+    spu_renew_voice(ch, SPU_PRIO_MUSIC, flags);
+    return ch;
+  }
+  ch = spu_alloc_voice(org->voice_mask, SPU_PRIO_MUSIC, flags, &org->tracks[trk]);
+  org->tracks[trk].voice = ch;
+  if (ch >= 0) {
+    spu_set_voice_volume(ch, org_track_vol(org, trk, org_cur_vol(org)));
+    spu_set_voice_pan(ch, org->tracks[trk].pan);
+    if (org->fade_left)
+      org->sweep_tracks |= 1 << trk;
+  }
+  return ch;
+}
+
+static inline void org_release_voice(org_state_t *org, const int trk) {
+  const s32 ch = org_track_voice(org, trk);
+  if (ch >= 0) {
+    org->key_off_mask |= SPU_VOICECH(ch);
+    spu_release_voice(ch);
+  }
+}
+
+// gives the track's voice back right away, returns its key off bit
+static u32 org_stop_voice(org_state_t *org, const int trk) {
+  const s32 ch = org_track_voice(org, trk);
+  org->tracks[trk].voice = -1;
+  if (ch < 0)
+    return 0;
+  spu_free_voice(ch);
+  return SPU_VOICECH(ch);
+}
+
+static void org_read_track(org_state_t *org, cd_file_t *f, const int track) {
+  const org_trackhdr_t *hdr = &org->info.tdata[track];
+  org_trackstate_t *dst = &org->tracks[track];
   // hope there's enough stack space
   u8 notedata[sizeof(s32) * hdr->note_num];
   // read positions ("x coordinate")
@@ -118,264 +215,609 @@ static void org_read_track(cd_file_t *f, const int track) {
   for (u16 i = 0; i < hdr->note_num; ++i) dst->notes[i].pan = notedata[i];
 }
 
-void org_init(struct sfx_bank *sample_bank) {
-  org.info.dot = 4;
-  org.info.line = 4;
-  org.info.wait = 128;
-  org.info.repeat_x = 0;
-  org.info.end_x = org.info.line * 255;
-  org.def_pan = DEFPAN;
-  org.def_vol = DEFVOLUME;
-  for (int i = 0; i < MAX_TRACKS; ++i) {
-    org.info.tdata[i].freq = 1000;
-    org.info.tdata[i].wave_no = 0;
-    org.info.tdata[i].pipi = 0;
-  }
+void org_init(struct sfx_bank *sample_bank, struct sfx_bank *waveform_bank, const s8 *wave_dat) {
   drum_bank = sample_bank;
+  wave_bank = waveform_bank;
+  wavetable = wave_dat;
+  if (wave_bank && wave_bank->num_sfx != NUM_WAVEFORMS * NUM_OCTS) {
+    printf("org_init(): expected %d samples in wave bank, got %d\n", NUM_WAVEFORMS * NUM_OCTS, wave_bank->num_sfx);
+    wave_bank = NULL;
+  }
 }
 
-int org_load(const char *name) {
-  char tmp[256];
-  cd_file_t *f = NULL;
+// a track with notes needs a real waveform; empty ones get waveform 0, like orgconv gives them
+static int org_check_waveforms(org_state_t *org, const char *name) {
+  for (int i = 0; i < MAX_MELODY_TRACKS; ++i) {
+    if (org->info.tdata[i].wave_no < NUM_WAVEFORMS)
+      continue;
+    if (org->info.tdata[i].note_num) {
+      printf("org_load(%s): track %d has invalid waveform %d\n", name, i, org->info.tdata[i].wave_no);
+      return 0;
+    }
+    org->info.tdata[i].wave_no = 0;
+  }
+  return 1;
+}
 
+// points the melody tracks at their samples in the shared wave bank
+static int org_map_wave_bank(org_state_t *org, const char *name) {
+  if (!org_check_waveforms(org, name))
+    return 0;
+  for (int i = 0; i < MAX_MELODY_TRACKS; ++i) {
+    const int wave_no = org->info.tdata[i].wave_no;
+    org->tracks[i].inst_addr = &wave_bank->sfx_addr[wave_no * NUM_OCTS];
+    org->tracks[i].inst_pitch = wave_bank->sfx_pitch ? &wave_bank->sfx_pitch[wave_no * NUM_OCTS] : NULL;
+    // the wave bank only has the octaves that are actually used by some song
+    for (u32 j = 0; j < org->info.tdata[i].note_num; ++j) {
+      const u8 key = org->tracks[i].notes[j].key;
+      if (key != KEYDUMMY && !org->tracks[i].inst_addr[key / 12]) {
+        printf("org_load(%s): waveform %d octave %d is not in the wave bank\n", name, wave_no, key / 12);
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+// loads the song's own instrument bank
+static int org_load_inst_bank(org_state_t *org, const char *name) {
+  char tmp[256];
   snprintf(tmp, sizeof(tmp), "\\BNK\\%s.BNK;1", name);
-  inst_bank = load_sfx_bank(tmp);
-  if (!inst_bank) goto _error;
-  if (inst_bank->num_sfx != MAX_MELODY_TRACKS * NUM_OCTS) {
+  if (org->slot_size)
+    org->inst_bank = load_sfx_bank_at(tmp, org->slot_addr, org->slot_size);
+  else
+    org->inst_bank = load_sfx_bank(tmp);
+  if (!org->inst_bank) return 0;
+  // orgconv -s puts the drums the song plays after the instruments
+  if (org->inst_bank->num_sfx != MAX_MELODY_TRACKS * NUM_OCTS &&
+      org->inst_bank->num_sfx != MAX_MELODY_TRACKS * NUM_OCTS + MAX_DRUM_TRACKS) {
     printf("org_load(%s): expected %d instruments in bank, got %d\n",
-      name, MAX_MELODY_TRACKS * NUM_OCTS, inst_bank->num_sfx);
-    goto _error;
+      name, MAX_MELODY_TRACKS * NUM_OCTS, org->inst_bank->num_sfx);
+    return 0;
+  }
+  for (int i = 0; i < MAX_MELODY_TRACKS; ++i) {
+    org->tracks[i].inst_addr = &org->inst_bank->sfx_addr[i * NUM_OCTS];
+    org->tracks[i].inst_pitch = org->inst_bank->sfx_pitch ? &org->inst_bank->sfx_pitch[i * NUM_OCTS] : NULL;
+  }
+  return 1;
+}
+
+// looks up where the drums are: the song's own bank, a drum bank from orgconv -d
+// with just the drums, or the full SFX bank with them at DRUM_BANK_BASE
+static void org_map_drums(org_state_t *org, const char *name) {
+  const u32 *addr = NULL;
+  u32 count = 0;
+  if (org->inst_bank && org->inst_bank->num_sfx == MAX_MELODY_TRACKS * NUM_OCTS + MAX_DRUM_TRACKS) {
+    addr = &org->inst_bank->sfx_addr[MAX_MELODY_TRACKS * NUM_OCTS];
+    count = MAX_DRUM_TRACKS;
+  } else if (drum_bank && drum_bank->num_sfx == MAX_DRUM_TRACKS) {
+    addr = drum_bank->sfx_addr;
+    count = MAX_DRUM_TRACKS;
+  } else if (drum_bank && drum_bank->num_sfx > DRUM_BANK_BASE) {
+    addr = &drum_bank->sfx_addr[DRUM_BANK_BASE];
+    count = drum_bank->num_sfx - DRUM_BANK_BASE;
+  }
+
+  for (int i = 0; i < MAX_DRUM_TRACKS; ++i) {
+    const int trk = MAX_MELODY_TRACKS + i;
+    org->drum_addr[i] = (i < (int)count) ? addr[i] : 0;
+    if (!org->drum_addr[i] && org->info.tdata[trk].note_num && !org_is_noise_drum(trk))
+      printf("org_load(%s): no sample for drum track %d, it won't play\n", name, i);
+  }
+}
+
+// size of the instruments org_synth_inst_bank() makes, and of the longest one in samples
+static u32 org_synth_data_len(u32 *max_len) {
+  u32 data_len = 0;
+  *max_len = 0;
+  for (int j = 0; j < NUM_OCTS; ++j) {
+    const u32 len = synth_loop_len(j);
+    if (len > *max_len) *max_len = len;
+    data_len += ALIGN(synth_adpcm_size(len), 8) * MAX_MELODY_TRACKS;
   }
+  return data_len;
+}
+
+// builds the instrument samples from the wavetable and uploads them, laid out like orgconv -f would
+static int org_synth_inst_bank(org_state_t *org, const char *name) {
+  if (!org_check_waveforms(org, name))
+    return 0;
+
+  u32 max_len;
+  const u32 data_len = org_synth_data_len(&max_len);
+  const u32 addr = org->slot_size ? org->slot_addr : spuram_ptr;
+  if (org->slot_size && data_len > org->slot_size) {
+    printf("org_load(%s): %u bytes of instruments don't fit in a %u byte slot\n", name, data_len, org->slot_size);
+    return 0;
+  }
+  if (!org->slot_size && data_len > SPU_RAM_SIZE - spuram_ptr) {
+    printf("org_load(%s): out of SPU RAM for %u bytes of instruments at %u\n", name, data_len, spuram_ptr);
+    return 0;
+  }
+
+  org->inst_bank = malloc(sizeof(*org->inst_bank) + sizeof(u32) * MAX_MELODY_TRACKS * NUM_OCTS);
+  ASSERT(org->inst_bank);
+  org->inst_bank->data_len = data_len;
+  org->inst_bank->num_sfx = MAX_MELODY_TRACKS * NUM_OCTS;
+  org->inst_bank->sfx_pitch = NULL;
+
+  s16 *pcm = malloc(sizeof(s16) * max_len);
+  u8 *buf = malloc(data_len);
+  ASSERT(pcm);
+  ASSERT(buf);
+
+  u32 ofs = 0;
+  for (int i = 0; i < MAX_MELODY_TRACKS; ++i) {
+    const s8 *wave = wavetable + org->info.tdata[i].wave_no * SYNTH_WAVEFORM_LEN;
+    for (int j = 0; j < NUM_OCTS; ++j) {
+      const u32 len = synth_loop_len(j);
+      synth_build_sample(pcm, wave, j, len, len / synth_oct[j].wave_size);
+      org->inst_bank->sfx_addr[i * NUM_OCTS + j] = addr + ofs;
+      ofs += ALIGN(synth_encode_adpcm(buf + ofs, pcm, len, 1), 8);
+    }
+    org->tracks[i].inst_addr = &org->inst_bank->sfx_addr[i * NUM_OCTS];
+    org->tracks[i].inst_pitch = NULL;
+  }
+
+  free(pcm);
+
+  SpuSetTransferMode(SPU_TRANSFER_BY_DMA);
+  spu_set_transfer_addr(addr);
+  SpuWrite((void *)buf, data_len);
+  spu_wait_for_transfer();
+  if (!org->slot_size)
+    spuram_ptr += data_len;
+  spumap_add(SPUMAP_SYNTH, addr, data_len, name, org->inst_bank);
+
+  printf("org_load(%s): synthesized %u bytes of instruments at %u, spuram_ptr=%u\n", name, data_len, addr, spuram_ptr);
+
+  free(buf);
 
+  return 1;
+}
+
+static cd_file_t *org_open(const char *name, org_hdr_t *hdr, int *ver) {
+  char tmp[256];
   snprintf(tmp, sizeof(tmp), "\\ORG\\%s.ORG;1", name);
-  f = cd_fopen(tmp, 0);
-  if (!f) goto _error;
+  cd_file_t *f = cd_fopen(tmp, 0);
+  if (!f) return NULL;
 
   char magic[ORG_MAGICLEN + 1] = { 0 }; // +1 for version
   cd_freadordie(magic, ORG_MAGICLEN + 1, 1, f);
 
   if (memcmp(magic, ORG_MAGIC, ORG_MAGICLEN)) {
     printf("org_load(%s): invalid Org magic\n", name);
-    goto _error;
+    cd_fclose(f);
+    return NULL;
+  }
+
+  *ver = magic[ORG_MAGICLEN] - '0';
+  if (*ver != 1 && *ver != 2) {
+    printf("org_load(%s): expected version 1 or 2, got %d\n", name, *ver);
+    cd_fclose(f);
+    return NULL;
   }
 
-  const int ver = magic[ORG_MAGICLEN] - '0';
-  if (ver != 1 && ver != 2) {
-    printf("org_load(%s): expected version 1 or 2, got %d\n", name, ver);
-    goto _error;
+  cd_freadordie(hdr, sizeof(*hdr), 1, f);
+
+  return f;
+}
+
+int org_get_info(const char *name, org_info_t *info) {
+  org_hdr_t hdr;
+  int ver;
+  cd_file_t *f = org_open(name, &hdr, &ver);
+  if (!f) return 0;
+  cd_fclose(f);
+  info->wait = hdr.wait;
+  info->repeat_x = hdr.repeat_x;
+  info->end_x = hdr.end_x;
+  return 1;
+}
+
+u32 org_get_spuram_size(const char *name) {
+  if (wave_bank)
+    return 0;
+
+  if (wavetable) {
+    u32 max_len;
+    return org_synth_data_len(&max_len);
   }
 
-  cd_freadordie(&org.info, sizeof(org.info), 1, f);
+  char tmp[256];
+  snprintf(tmp, sizeof(tmp), "\\BNK\\%s.BNK;1", name);
+  cd_file_t *f = cd_fopen(tmp, 0);
+  if (!f) return 0;
+  const u32 data_len = cd_fread_u32le(f);
+  cd_fclose(f);
+  return data_len;
+}
+
+org_state_t *org_load(const char *name, const u32 voice_mask) {
+  return org_load_into(name, voice_mask, 0, 0);
+}
+
+org_state_t *org_load_into(const char *name, const u32 voice_mask, const u32 slot_addr, const u32 slot_size) {
+  org_state_t *org = calloc(1, sizeof(*org));
+  ASSERT(org);
+  org->voice_mask = voice_mask;
+  org->slot_addr = slot_addr;
+  org->slot_size = slot_size;
+  org->def_pan = DEFPAN;
+  org->def_vol = DEFVOLUME;
+  org->mem_size = sizeof(*org);
+
+  int ver;
+  cd_file_t *f = org_open(name, &org->info, &ver);
+  if (!f) goto _error;
 
   for (int i = 0; i < MAX_TRACKS; ++i) {
+    org->tracks[i].voice = -1;
     if (ver == 1)
-      org.info.tdata[i].pipi = 0;
-    if (org.info.tdata[i].note_num) {
-      org.tracks[i].notes = malloc(org.info.tdata[i].note_num * sizeof(org_note_t));
-      ASSERT(org.tracks[i].notes);
-      org_read_track(f, i);
-    } else {
-      org.tracks[i].notes = NULL;
+      org->info.tdata[i].pipi = 0;
+    if (org->info.tdata[i].note_num) {
+      org->tracks[i].notes = malloc(org->info.tdata[i].note_num * sizeof(org_note_t));
+      ASSERT(org->tracks[i].notes);
+      org->mem_size += org->info.tdata[i].note_num * sizeof(org_note_t);
+      org_read_track(org, f, i);
     }
   }
 
   cd_fclose(f);
+  f = NULL;
+
+  // with a shared wave bank or the wavetable the ORG is all we need to load
+  if (wave_bank) {
+    if (!org_map_wave_bank(org, name)) goto _error;
+  } else if (wavetable) {
+    if (!org_synth_inst_bank(org, name)) goto _error;
+  } else {
+    if (!org_load_inst_bank(org, name)) goto _error;
+  }
+
+  org_map_drums(org, name);
+
+  if (org->inst_bank) {
+    org->mem_size += sizeof(*org->inst_bank) + sizeof(u32) * org->inst_bank->num_sfx;
+    if (org->inst_bank->sfx_pitch)
+      org->mem_size += sizeof(u16) * org->inst_bank->num_sfx;
+  }
 
   // dump eet
   /*
   for (int i = 0; i < MAX_MELODY_TRACKS; ++i) {
     printf("\nTRACK %02d\n", i);
-    for (u32 j = 0; j < org.info.tdata[i].note_num; ++j) {
-      const org_note_t *n = org.tracks[i].notes + j;
+    for (u32 j = 0; j < org->info.tdata[i].note_num; ++j) {
+      const org_note_t *n = org->tracks[i].notes + j;
       printf("%04d | %02x %02x %02x %02x\n", j, n->key, n->len, n->vol, n->pan);
     }
   }
   */
 
-  org.vol = 100;
+  org->vol = 100;
 
-  org_restart_from(0);
+  org_restart_from(org, 0);
 
-  return 1;
+  return org;
 
 _error:
   if (f) cd_fclose(f);
-  org_free();
-  return 0;
+  org_free(org);
+  return NULL;
 }
 
-void org_free(void) {
-  if (inst_bank) {
-    free_sfx_bank(inst_bank);
-    inst_bank = NULL;
-  }
-  for (int i = 0; i < MAX_TRACKS; ++i) {
-    if (org.tracks[i].notes) {
-      free(org.tracks[i].notes);
-      org.tracks[i].notes = NULL;
-    }
-  }
+void org_free(org_state_t *org) {
+  org_stop_voices(org);
+  if (org->inst_bank && org->slot_size)
+    free_sfx_bank_tables(org->inst_bank);
+  else if (org->inst_bank)
+    free_sfx_bank(org->inst_bank);
+  for (int i = 0; i < MAX_TRACKS; ++i)
+    free(org->tracks[i].notes);
+  free(org);
 }
 
-void org_restart_from(const s32 pos) {
-  org.pos = pos;
+void org_restart_from(org_state_t *org, const s32 pos) {
+  org->pos = pos;
   for (int i = 0; i < MAX_TRACKS; ++i) {
-    org.tracks[i].cur_note = NULL;
-    for (int j = 0; j < org.info.tdata[i].note_num; ++j) {
-      if (org.tracks[i].notes[j].pos >= pos) {
-        org.tracks[i].cur_note = &org.tracks[i].notes[j];
+    org->tracks[i].cur_note = NULL;
+    for (int j = 0; j < org->info.tdata[i].note_num; ++j) {
+      if (org->tracks[i].notes[j].pos >= pos) {
+        org->tracks[i].cur_note = &org->tracks[i].notes[j];
         break;
       }
     }
   }
 }
 
-static inline void org_play_melodic(const int trk, int key, int freq, int mode) {
-  const u32 ch = ORG_START_CH + trk;
+static inline void org_play_melodic(org_state_t *org, const int trk, int key, int freq, int mode) {
   const int oct = key / 12;
-  const int inst = trk * NUM_OCTS + oct;
+  s32 ch;
   switch (mode) {
     case 0: // also stop?
     case 2: // stop
-      if (org.tracks[trk].old_key != KEYDUMMY) {
-        key_off_mask |= SPU_VOICECH(ch);
-        org.tracks[trk].old_key = KEYDUMMY;
+      if (org->tracks[trk].old_key != KEYDUMMY) {
+        org_release_voice(org, trk);
+        org->tracks[trk].old_key = KEYDUMMY;
       }
       break;
     case -1: // key on?
-      org.tracks[trk].old_key = key;
-      freq = ((oct_wave[oct].wave_size * freq_tbl[key % 12]) * oct_wave[oct].oct_par) / 8 + (freq - 1000);
-      spu_set_voice_addr(ch, inst_bank->sfx_addr[inst]);
-      spu_set_voice_freq(ch, freq + org_freqshift);
-      key_on_mask |= SPU_VOICECH(ch);
+      ch = org_note_voice(org, trk, 0);
+      if (ch < 0) // everything is busy with more important things
+        break;
+      org->tracks[trk].old_key = key;
+      freq = ((synth_oct[oct].wave_size * freq_tbl[key % 12]) * synth_oct[oct].oct_par) / 8 + (freq - 1000);
+      spu_set_voice_addr(ch, org->tracks[trk].inst_addr[oct]);
+      if (org->tracks[trk].inst_pitch) // instrument is resampled to a shorter loop, correct for that
+        spu_set_voice_pitch(ch, freq2pitch_scaled(freq + org_freqshift, org->tracks[trk].inst_pitch[oct]));
+      else
+        spu_set_voice_freq(ch, freq + org_freqshift);
+      org->key_on_mask |= SPU_VOICECH(ch);
       break;
     default:
       break;
   }
 }
 
-static inline void org_play_drum(const int trk, int key, int mode) {
-  const u32 ch = ORG_START_CH + trk;
-  const int inst = trk - MAX_MELODY_TRACKS + DRUM_BANK_BASE;
+// the voice runs through the silent carrier at whatever pitch makes it end after len_ms, then frees itself
+static inline void org_play_noise_drum(org_state_t *org, const int trk, const int key) {
+  const struct noise_drum *nd = &noise_drums[trk - MAX_MELODY_TRACKS];
+  const s32 ch = org_note_voice(org, trk, SPU_VOICE_ONESHOT);
+  if (ch < 0)
+    return;
+  s32 clock = nd->clock + (key - NOISE_KEY) / 3;
+  if (clock < 0) clock = 0;
+  u32 pitch = (SPU_NOISE_CARRIER_SAMPLES << 12) / 441 * 10 / nd->len_ms;
+  if (pitch > 0x3FFF) pitch = 0x3FFF;
+  spu_set_noise_clock(clock);
+  spu_set_voice_noise(ch, 1);
+  spu_set_voice_adsr(ch, nd->adsr_lo, nd->adsr_hi);
+  spu_set_voice_addr(ch, SPU_NOISE_CARRIER_ADDR);
+  spu_set_voice_pitch(ch, pitch);
+  org->key_on_mask |= SPU_VOICECH(ch);
+}
+
+static inline void org_play_drum(org_state_t *org, const int trk, int key, int mode) {
+  const u32 addr = org->drum_addr[trk - MAX_MELODY_TRACKS];
+  s32 ch;
   switch (mode) {
     case 0: // stop
-      key_off_mask |= SPU_VOICECH(ch);
+      org_release_voice(org, trk);
       break;
     case 1: // play
-      spu_set_voice_addr(ch, drum_bank->sfx_addr[inst]);
+      if (org_is_noise_drum(trk)) {
+        org_play_noise_drum(org, trk, key);
+        break;
+      }
+      if (!addr)
+        break;
+      ch = org_note_voice(org, trk, SPU_VOICE_ONESHOT);
+      if (ch < 0)
+        break;
+      spu_set_voice_addr(ch, addr);
       spu_set_voice_freq(ch, key * 800 + 100);
-      key_on_mask |= SPU_VOICECH(ch);
+      org->key_on_mask |= SPU_VOICECH(ch);
       break;
     default:
       break;
   }
 }
 
-static inline void org_set_vol(const int trk, int vol) {
-  spu_set_voice_volume(ORG_START_CH + trk, vol << 5);
+// voices that are part of a fade are left alone until it's over
+static inline void org_set_vol(org_state_t *org, const int trk) {
+  const s32 ch = org_track_voice(org, trk);
+  if (ch >= 0 && !org->fade_left)
+    spu_set_voice_volume(ch, org_track_vol(org, trk, org_cur_vol(org)));
 }
 
-static inline void org_set_pan(const int trk, int pan) {
-  spu_set_voice_pan(ORG_START_CH + trk, pan_tbl[pan] - 256);
+static inline void org_set_pan(org_state_t *org, const int trk, int pan) {
+  org->tracks[trk].pan = pan_tbl[pan] - 256;
+  const s32 ch = org_track_voice(org, trk);
+  if (ch >= 0 && !org->fade_left)
+    spu_set_voice_pan(ch, org->tracks[trk].pan);
 }
 
-void org_tick(void) {
-  if (org.fadeout && org.vol)
-    org.vol -= 2;
-  if (org.vol < 0)
-    org.vol = 0;
+void org_tick(org_state_t *org) {
+  org->key_off_mask = 0;
+  org->key_on_mask = 0;
 
-  key_off_mask = 0;
-  key_on_mask = 0;
+  spu_update_voices();
+
+  // the volumes of these were written last tick, now they can sweep from there
+  if (org->fade_left) {
+    for (int i = 0; org->sweep_tracks; ++i, org->sweep_tracks >>= 1) {
+      const s32 ch = org_track_voice(org, i);
+      if ((org->sweep_tracks & 1) && ch >= 0)
+        org_sweep_voice(org, i, ch);
+    }
+  }
+  org->sweep_tracks = 0;
 
   // waves
   for (int i = 0; i < MAX_MELODY_TRACKS; ++i) {
-    const org_note_t *note = org.tracks[i].cur_note;
-    if (note && org.pos == note->pos) {
-      if (!org.tracks[i].mute && note->key != KEYDUMMY) {
-        org_play_melodic(i, note->key, org.info.tdata[i].freq, -1);
-        org.tracks[i].sustain = note->len;
+    const org_note_t *note = org->tracks[i].cur_note;
+    if (note && org->pos == note->pos) {
+      if (!org->tracks[i].mute && note->key != KEYDUMMY) {
+        org_play_melodic(org, i, note->key, org->info.tdata[i].freq, -1);
+        org->tracks[i].sustain = note->len;
       }
       if (note->pan != PANDUMMY)
-        org_set_pan(i, note->pan);
+        org_set_pan(org, i, note->pan);
       if (note->vol != VOLDUMMY)
-        org.tracks[i].vol = note->vol;
-      ++org.tracks[i].cur_note;
-      if (org.tracks[i].cur_note >= org.tracks[i].notes + org.info.tdata[i].note_num)
-        org.tracks[i].cur_note = NULL;
+        org->tracks[i].vol = note->vol;
+      ++org->tracks[i].cur_note;
+      if (org->tracks[i].cur_note >= org->tracks[i].notes + org->info.tdata[i].note_num)
+        org->tracks[i].cur_note = NULL;
     }
 
-    if (org.tracks[i].sustain == 0)
-      org_play_melodic(i, 0, org.info.tdata[i].freq, 2);
+    if (org->tracks[i].sustain == 0)
+      org_play_melodic(org, i, 0, org->info.tdata[i].freq, 2);
     else
-      --org.tracks[i].sustain;
+      --org->tracks[i].sustain;
 
-    if (org.tracks[i].cur_note)
-      org_set_vol(i, org.tracks[i].vol * org.vol / 0x7F);
+    if (org->tracks[i].cur_note)
+      org_set_vol(org, i);
   }
 
   // drums
   for (int i = MAX_MELODY_TRACKS; i < MAX_TRACKS; ++i) {
-    const org_note_t *note = org.tracks[i].cur_note;
-    if (note && org.pos == note->pos) {
-      if (!org.tracks[i].mute && note->key != KEYDUMMY)
-        org_play_drum(i, note->key, 1);
+    const org_note_t *note = org->tracks[i].cur_note;
+    if (note && org->pos == note->pos) {
+      if (!org->tracks[i].mute && note->key != KEYDUMMY)
+        org_play_drum(org, i, note->key, 1);
       if (note->pan != PANDUMMY)
-        org_set_pan(i, note->pan);
+        org_set_pan(org, i, note->pan);
       if (note->vol != VOLDUMMY)
-        org.tracks[i].vol = note->vol;
-      ++org.tracks[i].cur_note;
-      if (org.tracks[i].cur_note >= org.tracks[i].notes + org.info.tdata[i].note_num)
-        org.tracks[i].cur_note = NULL;
+        org->tracks[i].vol = note->vol;
+      ++org->tracks[i].cur_note;
+      if (org->tracks[i].cur_note >= org->tracks[i].notes + org->info.tdata[i].note_num)
+        org->tracks[i].cur_note = NULL;
+    }
+
+    if (org->tracks[i].cur_note)
+      org_set_vol(org, i);
+  }
+
+  spu_flush_voices();
+  spu_key_off(org->key_off_mask);
+  spu_key_on(org->key_on_mask);
+
+  if (org->fade_left && !--org->fade_left) {
+    if (org->fade_dir < 0) {
+      org->faded = 1;
+    } else {
+      // upward sweeps don't stop where the fade does
+      for (int i = 0; i < MAX_TRACKS; ++i)
+        org_set_vol(org, i);
     }
+  }
+
+  ++org->pos;
+  if (org->pos >= org->info.end_x) {
+    org_restart_from(org, org->info.repeat_x);
+    ++org->loops;
+  }
+}
+
+void org_set_volume(org_state_t *org, const s32 vol) {
+  org->vol = vol;
+}
+
+static void org_start_fade(org_state_t *org, const s8 dir, const u32 ms) {
+  const u32 wait = org->info.wait ? org->info.wait : 1;
+  org->fade_ticks = (ms + wait - 1) / wait;
+  if (!org->fade_ticks) org->fade_ticks = 1;
+  org->fade_left = org->fade_ticks;
+  org->fade_dir = dir;
+  org->sweep_tracks = 0;
+}
 
-    if (org.tracks[i].cur_note)
-      org_set_vol(i, org.tracks[i].vol * org.vol / 0x7F);
+void org_fade_out(org_state_t *org, const u32 ms) {
+  // going on from the level a fade in got to
+  const s32 from = org_cur_vol(org);
+  if (!from)
+    return;
+  org_start_fade(org, -1, ms);
+  if (org->vol)
+    org->fade_left = (org->fade_ticks * from + org->vol - 1) / org->vol;
+  for (int i = 0; i < MAX_TRACKS; ++i) {
+    const s32 ch = org_track_voice(org, i);
+    if (ch >= 0)
+      org_sweep_voice(org, i, ch);
   }
+}
 
+void org_fade_in(org_state_t *org, const u32 ms) {
+  // from silence, or from the level a fade out got to
+  const s32 from = (org->fade_left && org->fade_dir < 0) ? org_cur_vol(org) : 0;
+  org_start_fade(org, 1, ms);
+  if (org->vol)
+    org->fade_left -= org->fade_ticks * from / org->vol;
+  if (!org->fade_left)
+    org->fade_left = 1;
+  org->faded = 0;
+  // the voices it has start at that level now, their sweeps go from there on the next tick
+  for (int i = 0; i < MAX_TRACKS; ++i) {
+    const s32 ch = org_track_voice(org, i);
+    if (ch >= 0) {
+      spu_set_voice_volume(ch, org_track_vol(org, i, from));
+      org->sweep_tracks |= 1 << i;
+    }
+  }
   spu_flush_voices();
-  spu_key_off(key_off_mask);
-  spu_key_on(key_on_mask);
+}
+
+int org_get_fade(const org_state_t *org) {
+  return org->fade_left ? org->fade_dir : (org->faded ? -1 : 0);
+}
+
+void org_stop_voices(org_state_t *org) {
+  u32 voices = 0;
+  for (int i = 0; i < MAX_TRACKS; ++i)
+    voices |= org_stop_voice(org, i);
+  spu_key_off(voices);
+}
+
+void org_get_mem_usage(const org_state_t *org, u32 *ram, u32 *spuram) {
+  if (ram)
+    *ram = org->mem_size;
+  if (spuram)
+    *spuram = org->inst_bank ? org->inst_bank->data_len : 0;
+}
+
+void org_set_noise_drums(const u8 mask) {
+  noise_drum_mask = mask;
+}
+
+u8 org_get_noise_drums(void) {
+  return noise_drum_mask;
+}
+
+u32 org_get_loops(const org_state_t *org) {
+  return org->loops;
+}
 
-  ++org.pos;
-  if (org.pos >= org.info.end_x)
-    org_restart_from(org.info.repeat_x);
+s32 org_get_ticks_left(const org_state_t *org) {
+  return org->info.end_x - org->pos;
 }
 
-int org_get_wait(void) {
-  return org.info.wait;
+int org_get_wait(const org_state_t *org) {
+  return org->info.wait;
 }
 
-int org_get_pos(void) {
-  return org.pos;
+int org_get_pos(const org_state_t *org) {
+  return org->pos;
 }
 
-u16 org_get_mute_mask(void) {
+u16 org_get_mute_mask(const org_state_t *org) {
   register u16 mask = 0;
   for (u16 i = 0; i < MAX_TRACKS; ++i) {
-    if (org.tracks[i].mute)
+    if (org->tracks[i].mute)
       mask |= (1 << i);
   }
   return mask;
 }
 
-u16 org_set_mute_mask(const u16 mask) {
+u16 org_set_mute_mask(org_state_t *org, const u16 mask) {
   register u16 oldmask = 0;
+  u32 muted_voices = 0;
   for (u16 i = 0; i < MAX_TRACKS; ++i) {
-    if (org.tracks[i].mute)
+    if (org->tracks[i].mute)
       oldmask |= (1 << i);
-    org.tracks[i].mute = !!(mask & (1 << i));
+    org->tracks[i].mute = !!(mask & (1 << i));
+    if (org->tracks[i].mute)
+      muted_voices |= org_stop_voice(org, i);
   }
-  spu_key_off((u32)mask << ORG_START_CH);
+  spu_key_off(muted_voices);
   return oldmask;
 }
 
-org_note_t *org_get_track(const int tracknum, u32 *numnotes) {
+org_note_t *org_get_track(org_state_t *org, const int tracknum, u32 *numnotes) {
   if (numnotes)
-    *numnotes = org.info.tdata[tracknum].note_num;
-  return org.tracks[tracknum].notes;
+    *numnotes = org->info.tdata[tracknum].note_num;
+  return org->tracks[tracknum].notes;
 }
 
-org_note_t *org_get_track_pos(const int tracknum) {
-  return org.tracks[tracknum].cur_note;
+org_note_t *org_get_track_pos(org_state_t *org, const int tracknum) {
+  return org->tracks[tracknum].cur_note;
 }
@@ -3,7 +3,6 @@
 #include "types.h"
 #include "util.h"
 
-#define ORG_START_CH 8
 #define ORG_MAX_TRACKS 16
 
 typedef struct org_note {
@@ -14,18 +13,90 @@ typedef struct org_note {
   u8 pan;
 } org_note_t;
 
+// drums are the samples from this one on in the SFX bank; a drum bank from orgconv -d has just the
+// ORG_NUM_DRUMS of them, and a song's own bank can have them after its instruments (orgconv -s)
+#define ORG_DRUM_BANK_BASE 150
+#define ORG_NUM_DRUMS 8
+
+// drums (one bit each) that play on the SPU noise generator by default instead of their samples, see
+// org_set_noise_drums(); hats and cymbals come out close enough, see orgrender -n
+#define ORG_NOISE_DRUMS 0x00
+
+// songs are ticked by root counter 1 counting hblanks, which it assumes run at this rate
+#define ORG_TIMER_FREQ 15625
+
+// pre-rendered XA versions of songs (see tools/orgrender) are 37800 Hz stereo, 2016 frames per sector;
+// the loop is stretched a tiny bit to fill a whole number of sectors and ends the file
+#define ORG_XA_FREQ 37800
+#define ORG_XA_SECTOR_FRAMES 2016
+
+typedef struct org_info {
+  u16 wait; // ms per tick
+  s32 repeat_x;
+  s32 end_x;
+} org_info_t;
+
 extern s32 org_freqshift;
 
-void org_init(struct sfx_bank *drum_bank);
-int org_load(const char *name);
-void org_free(void);
-void org_restart_from(const s32 pos);
-void org_tick(void);
+static inline u32 org_wait_to_timer(const u32 wait) {
+  return ORG_TIMER_FREQ * wait / 1000;
+}
+
+// number of XA sectors the loop of a song takes, at least 1
+// (end_x - repeat_x) ticks * timer ticks per tick * 37800 / 15625 / 2016, rounded;
+// both factors are split around 2500 so long loops at slow tempos don't overflow u32 (and no u64 division)
+static inline u32 org_xa_loop_sectors(const org_info_t *info) {
+  const u32 ticks = (info->end_x > info->repeat_x) ? (info->end_x - info->repeat_x) : 1;
+  const u32 timer = org_wait_to_timer(info->wait) * 3;
+  const u32 tq = ticks / 2500, tr = ticks % 2500;
+  const u32 sectors = tq * timer + tr * (timer / 2500) + (tr * (timer % 2500) + 1250) / 2500;
+  return sectors ? sectors : 1;
+}
+
+// a loaded song; any number of them can play at once, each ticked on its own
+typedef struct org_state org_state_t;
+
+// sets the banks every song uses
+void org_init(struct sfx_bank *drum_bank, struct sfx_bank *wave_bank, const s8 *wavetable);
+// loads a song that plays on voices from `voice_mask` (SPU_ALL_VOICES to share all of them), NULL on failure
+org_state_t *org_load(const char *name, const u32 voice_mask);
+// same, but its own instruments (if it has any) go to the `slot_size` bytes of SPU RAM at `slot_addr`
+// instead of spuram_ptr, which makes it fail if they don't fit; 0 size is the same as org_load()
+org_state_t *org_load_into(const char *name, const u32 voice_mask, const u32 slot_addr, const u32 slot_size);
+// bytes of SPU RAM the song's own instruments take, 0 if it uses the wave bank
+u32 org_get_spuram_size(const char *name);
+// reads just the header of a song without loading it
+int org_get_info(const char *name, org_info_t *info);
+// also keys off and frees its voices; songs loaded after it that have their own banks should be freed first
+void org_free(org_state_t *org);
+void org_restart_from(org_state_t *org, const s32 pos);
+void org_tick(org_state_t *org);
+// which drums play on the noise generator, with the clock and envelope from a table in org.c; they need
+// no samples in SPU RAM (see orgconv -n), but all noise voices share one clock, the last drum's;
+// songs pick this up on their next drum notes
+void org_set_noise_drums(const u8 mask);
+u8 org_get_noise_drums(void);
+// 0 to 100, scales the volume of every track
+void org_set_volume(org_state_t *org, const s32 vol);
+// fade the song out to silence or back in to its volume over about `ms`: the SPU sweeps the volumes of its
+// voices by itself, the song only writes them for voices it gets during the fade; it keeps ticking silently
+// after a fade out. call from the timer IRQ or in a critical section, like org_tick()
+void org_fade_out(org_state_t *org, const u32 ms);
+void org_fade_in(org_state_t *org, const u32 ms);
+// -1 while fading out or faded out, 1 while fading in, 0 otherwise
+int org_get_fade(const org_state_t *org);
+// keys off and frees the song's voices, e.g. to pause it; the next notes get new ones
+void org_stop_voices(org_state_t *org);
+// main RAM taken by the instance and its notes, SPU RAM taken by its own instruments if it has any
+void org_get_mem_usage(const org_state_t *org, u32 *ram, u32 *spuram);
 
-int org_get_wait(void);
-int org_get_pos(void);
-u16 org_get_mute_mask(void);
-u16 org_set_mute_mask(const u16 mask);
+// times the song has gone back to its loop start, and ticks until it does again
+u32 org_get_loops(const org_state_t *org);
+s32 org_get_ticks_left(const org_state_t *org);
+int org_get_wait(const org_state_t *org);
+int org_get_pos(const org_state_t *org);
+u16 org_get_mute_mask(const org_state_t *org);
+u16 org_set_mute_mask(org_state_t *org, const u16 mask);
 
-org_note_t *org_get_track(const int tracknum, u32 *numnotes);
-org_note_t *org_get_track_pos(const int tracknum);
+org_note_t *org_get_track(org_state_t *org, const int tracknum, u32 *numnotes);
+org_note_t *org_get_track_pos(org_state_t *org, const int tracknum);
@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <psxapi.h>
+
+#include "types.h"
+#include "util.h"
+#include "spu.h"
+#include "cd.h"
+#include "org.h"
+#include "playlist.h"
+#include "spumap.h"
+
+struct slot {
+  org_state_t *song;
+  int index; // into names
+};
+
+static char (*names)[CD_MAX_FILENAME];
+static int num_names;
+static int next_index;
+
+static u32 slot_addr[2];
+static u32 slot_size;
+static u32 voice_mask;
+static u32 num_loops;
+static u32 fade_ms;
+
+static struct slot slots[2];
+static volatile int cur; // slot that's playing
+static volatile int next_ready; // the other slot has a song the IRQ may switch to
+static volatile int retired; // the IRQ is done with the other slot's song, the main loop frees it
+static int crossfading;
+static u32 fade_timer; // timer counts the next song is owed while crossfading
+
+// menu entries might still have their extension
+static void song_name(const int index, char *out) {
+  strncpy(out, names[index], CD_MAX_FILENAME - 1);
+  out[CD_MAX_FILENAME - 1] = '\0';
+  char *dot = strrchr(out, '.');
+  if (dot) *dot = '\0';
+}
+
+u32 playlist_slot_size(char list[][CD_MAX_FILENAME], const int count) {
+  char name[CD_MAX_FILENAME];
+  u32 size = 0;
+  names = list;
+  for (int i = 0; i < count; ++i) {
+    song_name(i, name);
+    const u32 len = org_get_spuram_size(name);
+    if (len > size) size = len;
+  }
+  return size;
+}
+
+static int load_slot(const int s, const int index) {
+  char name[CD_MAX_FILENAME];
+  song_name(index, name);
+  // without slots, songs with their own instruments would pile up at spuram_ptr
+  if (!slot_size && org_get_spuram_size(name)) {
+    printf("playlist: '%s' needs SPU RAM but there are no slots\n", name);
+    return 0;
+  }
+  slots[s].song = org_load_into(name, voice_mask, slot_addr[s], slot_size);
+  slots[s].index = index;
+  return slots[s].song != NULL;
+}
+
+int playlist_start(char list[][CD_MAX_FILENAME], const int count, const int first, const u32 size,
+    const u32 mask, const u32 loops, const u32 fade) {
+  if (spuram_ptr + 2 * size > SPU_RAM_SIZE) {
+    printf("playlist: 2 slots of %u bytes don't fit in SPU RAM, spuram_ptr=%u\n", size, spuram_ptr);
+    return 0;
+  }
+
+  names = list;
+  num_names = count;
+  slot_size = size;
+  slot_addr[0] = spuram_ptr;
+  slot_addr[1] = spuram_ptr + size;
+  spuram_ptr += 2 * size;
+  if (size) {
+    spumap_add(SPUMAP_SLOT, slot_addr[0], size, "SLOT 0", NULL);
+    spumap_add(SPUMAP_SLOT, slot_addr[1], size, "SLOT 1", NULL);
+  }
+  voice_mask = mask;
+  num_loops = loops ? loops : 1;
+  fade_ms = fade;
+
+  cur = 0;
+  next_ready = 0;
+  retired = 0;
+  crossfading = 0;
+  fade_timer = 0;
+  slots[0].song = slots[1].song = NULL;
+
+  if (!load_slot(0, first)) {
+    playlist_stop();
+    return 0;
+  }
+  next_index = (first + 1) % num_names;
+
+  printf("playlist: %d songs, 2 slots of %u bytes at %u\n", num_names, slot_size, slot_addr[0]);
+  return 1;
+}
+
+void playlist_update(void) {
+  // playlist_tick() flips cur and sets retired together, so both are read with the IRQ off;
+  // once that's handled it won't flip again until next_ready, which only this sets
+  EnterCriticalSection();
+  const int s = !cur;
+  if (retired) {
+    org_free(slots[s].song);
+    slots[s].song = NULL;
+    retired = 0;
+  }
+  ExitCriticalSection();
+
+  if (!slots[s].song) {
+    // the music keeps going in the IRQ while this blocks
+    const int ok = load_slot(s, next_index);
+    next_index = (next_index + 1) % num_names;
+    if (ok)
+      next_ready = 1;
+  }
+}
+
+u32 playlist_tick(void) {
+  org_state_t *song = slots[cur].song;
+  org_state_t *next = next_ready ? slots[!cur].song : NULL;
+
+  org_tick(song);
+
+  if (!next)
+    return org_get_wait(song);
+
+  const u32 loops = org_get_loops(song);
+  if (loops >= num_loops) {
+    // it has just played its last tick, the next one starts on the next IRQ
+    // if it was fading in, that finishes on its own
+    org_stop_voices(song);
+    cur = !cur;
+    next_ready = 0;
+    retired = 1;
+    crossfading = 0;
+    fade_timer = 0;
+    return org_get_wait(next);
+  }
+
+  const u32 left_ms = org_get_ticks_left(song) * org_get_wait(song);
+  if (fade_ms && !crossfading && loops + 1 == num_loops && left_ms <= fade_ms) {
+    // the SPU does the volumes from here on
+    org_fade_out(song, left_ms);
+    org_fade_in(next, left_ms);
+    crossfading = 1;
+  }
+
+  if (crossfading) {
+    // the next song keeps its own tempo, so it gets as many ticks as fit in one of ours
+    const u32 next_timer = org_wait_to_timer(org_get_wait(next));
+    fade_timer += org_wait_to_timer(org_get_wait(song));
+    while (fade_timer >= next_timer) {
+      org_tick(next);
+      fade_timer -= next_timer;
+    }
+  }
+
+  return org_get_wait(song);
+}
+
+void playlist_stop_voices(void) {
+  for (int s = 0; s < 2; ++s)
+    if (slots[s].song)
+      org_stop_voices(slots[s].song);
+}
+
+void playlist_stop(void) {
+  for (int s = 0; s < 2; ++s) {
+    if (slots[s].song) {
+      org_free(slots[s].song);
+      slots[s].song = NULL;
+    }
+  }
+  next_ready = 0;
+  retired = 0;
+  crossfading = 0;
+  if (spuram_ptr == slot_addr[0] + 2 * slot_size)
+    spuram_ptr = slot_addr[0];
+  spumap_remove(SPUMAP_SLOT, slot_addr[0]);
+  spumap_remove(SPUMAP_SLOT, slot_addr[1]);
+}
+
+org_state_t *playlist_get_song(void) {
+  return slots[cur].song;
+}
+
+int playlist_get_index(void) {
+  return slots[cur].index;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "types.h"
+#include "cd.h"
+#include "org.h"
+
+// plays a list of songs back to back without gaps: while one plays, the next one is loaded into
+// the other of two SPU RAM slots, and the timer IRQ switches over to it within a single tick
+
+// the biggest slot any of the songs needs, see org_get_spuram_size()
+u32 playlist_slot_size(char names[][CD_MAX_FILENAME], const int count);
+// takes 2 * slot_size bytes at spuram_ptr for the slots and loads the first song; songs switch
+// after playing their loop `loops` times, crossfading over the last `fade_ms` ms if that's not 0;
+// returns 0 if there's not enough SPU RAM or the first song doesn't load
+int playlist_start(char names[][CD_MAX_FILENAME], const int count, const int first, const u32 slot_size,
+  const u32 voice_mask, const u32 loops, const u32 fade_ms);
+// frees whatever the IRQ is done with and loads the next song; call from the main loop,
+// the loading blocks it but not the music
+void playlist_update(void);
+// ticks the current song (and the next one while crossfading) and switches songs at the end;
+// call from the timer IRQ, returns the ms per tick the timer should run at from now on
+u32 playlist_tick(void);
+// keys off every voice the playlist has, for pausing
+void playlist_stop_voices(void);
+// frees both songs and the slots; stop the timer first
+void playlist_stop(void);
+org_state_t *playlist_get_song(void);
+int playlist_get_index(void);
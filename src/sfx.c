@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "util.h"
+#include "spu.h"
+#include "sfx.h"
+#include "sfxpool.h"
+
+#define QUEUE_MASK (SFX_QUEUE_LEN - 1)
+
+#define MAX_PITCH 0x3FFF
+
+// keeps the compiler from moving memory accesses across it, which is all a single core needs
+#define BARRIER() __asm__ volatile("" ::: "memory")
+
+struct sfx_req {
+  u16 id;
+  u16 pitch;
+  s16 vol;
+  s16 pan;
+  u8 prio;
+  u8 stop;
+};
+
+struct sfx_sample {
+  u8 limit;
+  u8 looping;
+};
+
+// what the voices we've got are playing; spu_voice_owned(v, voices) says whether we still have v
+static struct {
+  u32 start; // to find the oldest instance of a sample
+  u16 id;
+} voices[SPU_NUM_VOICES];
+
+static const struct sfx_bank *bank;
+static int pooled; // samples have to be put in SPU RAM by sfx_pool_get() before they can be played
+static struct sfx_sample *samples; // [bank->num_sfx]
+
+static struct sfx_req queue[SFX_QUEUE_LEN];
+static volatile u32 queue_head; // only written by the producer
+static volatile u32 queue_tail; // only written by sfx_flush()
+
+static volatile u32 queue_full; // counted by the producer, the rest by sfx_flush()
+static sfx_stats_t stats;
+static u32 num_started;
+
+void sfx_init(const struct sfx_bank *sfx_bank) {
+  bank = sfx_bank;
+  pooled = (sfx_bank == sfx_pool_get_bank());
+  free(samples);
+  samples = calloc(bank->num_sfx, sizeof(*samples));
+  ASSERT(samples);
+  queue_head = queue_tail = 0;
+  queue_full = 0;
+  memset(&stats, 0, sizeof(stats));
+}
+
+void sfx_set_limit(const u32 id, const u8 max) {
+  if (id < bank->num_sfx)
+    samples[id].limit = max;
+}
+
+void sfx_set_looping(const u32 id, const int looping) {
+  if (id < bank->num_sfx)
+    samples[id].looping = !!looping;
+}
+
+static int sfx_push(const struct sfx_req *req) {
+  const u32 head = queue_head;
+  if (head - queue_tail >= SFX_QUEUE_LEN) {
+    ++queue_full;
+    return 0;
+  }
+  queue[head & QUEUE_MASK] = *req;
+  BARRIER(); // the request has to be complete before the consumer can see it
+  queue_head = head + 1;
+  return 1;
+}
+
+int sfx_play(const u32 id, const u16 pitch, const s16 vol, const s16 pan, const u8 prio) {
+  // uploading can't wait for sfx_flush(), that might be in the IRQ; the sample can't be evicted
+  // by anything played after this until sfx_flush() has started it
+  if (pooled && !sfx_pool_get(id))
+    return 0;
+  if (pooled)
+    sfx_pool_mark_queued(id);
+  const struct sfx_req req = { id, pitch, vol, pan, prio, 0 };
+  if (!sfx_push(&req)) {
+    if (pooled)
+      sfx_pool_unmark_queued(id);
+    return 0;
+  }
+  return 1;
+}
+
+int sfx_stop(const u32 id) {
+  const struct sfx_req req = { id, 0, 0, 0, 0, 1 };
+  return sfx_push(&req);
+}
+
+// frees every voice playing `id`, returns their key off bits
+static u32 sfx_stop_now(const u32 id) {
+  u32 mask = 0;
+  for (u32 v = 0; v < SPU_NUM_VOICES; ++v) {
+    if (voices[v].id == id && spu_voice_owned(v, voices)) {
+      spu_free_voice(v);
+      mask |= SPU_VOICECH(v);
+    }
+  }
+  return mask;
+}
+
+// the oldest instance of `id` if it's already playing on as many voices as it may, -1 otherwise
+static s32 sfx_limit_voice(const u32 id) {
+  const u32 limit = samples[id].limit;
+  if (!limit)
+    return -1;
+  u32 count = 0;
+  s32 oldest = -1;
+  for (u32 v = 0; v < SPU_NUM_VOICES; ++v) {
+    if (voices[v].id == id && spu_voice_owned(v, voices)) {
+      ++count;
+      if (oldest < 0 || voices[v].start < voices[oldest].start)
+        oldest = v;
+    }
+  }
+  return (count >= limit) ? oldest : -1;
+}
+
+// sets up a voice for the request, returns it or -1
+static s32 sfx_start(const struct sfx_req *req) {
+  const u32 id = req->id;
+  if (id >= bank->num_sfx || !bank->sfx_addr[id]) {
+    ++stats.dropped;
+    return -1;
+  }
+
+  const u8 flags = samples[id].looping ? 0 : SPU_VOICE_ONESHOT;
+  s32 v = sfx_limit_voice(id);
+  if (v >= 0) {
+    spu_renew_voice(v, req->prio, flags);
+    ++stats.limited;
+  } else {
+    const u32 free = spu_get_free_voices();
+    v = spu_alloc_voice(SPU_ALL_VOICES, req->prio, flags, voices);
+    if (v < 0) {
+      ++stats.dropped;
+      return -1;
+    }
+    if (!(free & SPU_VOICECH(v)))
+      ++stats.stolen;
+  }
+
+  u32 pitch = req->pitch;
+  if (bank->sfx_pitch)
+    pitch = (pitch * bank->sfx_pitch[id]) >> 12;
+  if (pitch > MAX_PITCH)
+    pitch = MAX_PITCH;
+
+  voices[v].id = id;
+  voices[v].start = num_started++;
+  spu_set_voice_addr(v, bank->sfx_addr[id]);
+  spu_set_voice_pitch(v, pitch);
+  spu_set_voice_volume(v, req->vol);
+  spu_set_voice_pan(v, req->pan);
+  ++stats.played;
+  return v;
+}
+
+void sfx_flush(void) {
+  u32 key_on = 0;
+  u32 key_off = 0;
+
+  spu_update_voices();
+
+  u32 tail = queue_tail;
+  const u32 head = queue_head;
+  BARRIER(); // don't read requests before seeing that they're there
+  for (; tail != head; ++tail) {
+    const struct sfx_req *req = &queue[tail & QUEUE_MASK];
+    if (req->stop) {
+      const u32 mask = sfx_stop_now(req->id);
+      key_off |= mask;
+      key_on &= ~mask;
+    } else {
+      const s32 v = sfx_start(req);
+      if (pooled)
+        sfx_pool_mark_flushed(req->id);
+      if (v >= 0) {
+        key_on |= SPU_VOICECH(v);
+        key_off &= ~SPU_VOICECH(v);
+      }
+    }
+  }
+  BARRIER(); // done reading them before giving the slots back
+  queue_tail = tail;
+
+  if (key_on)
+    spu_flush_voices();
+  if (key_off)
+    spu_key_off(key_off);
+  if (key_on)
+    spu_key_on(key_on);
+}
+
+void sfx_get_stats(sfx_stats_t *out) {
+  *out = stats;
+  out->dropped += queue_full;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "types.h"
+#include "util.h"
+
+// sound effects from a bank, played on voices from the allocator in spu.c
+// requests go through a lock-free ring: one context (the main loop) queues them with sfx_play(),
+// another one (the timer IRQ, or the main loop itself) starts them all at once with sfx_flush()
+
+#define SFX_QUEUE_LEN 32 // power of 2
+
+typedef struct sfx_stats {
+  u32 played;
+  u32 limited; // restarted the oldest instance of a sample that was at its limit
+  u32 stolen;  // took a voice that was busy with something else
+  u32 dropped; // queue full, invalid sample or every voice more important
+} sfx_stats_t;
+
+void sfx_init(const struct sfx_bank *bank);
+// how many instances of a sample can play at once, 0 (the default) for no limit
+void sfx_set_limit(const u32 id, const u8 max);
+// looping samples don't end by themselves, so their voices stay taken until they're stopped
+void sfx_set_looping(const u32 id, const int looping);
+// queues sample `id` at `pitch` (4.12, 0x1000 = 44100 Hz, scaled by the bank's multiplier if it has one),
+// volume 0 to SPU_MAX_VOLUME, pan -255 to 255 and priority (see SPU_PRIO_*);
+// if the bank is from sfx_pool_init(), this uploads the sample if it has to;
+// returns 0 if the queue is full or the sample didn't fit in the pool
+int sfx_play(const u32 id, const u16 pitch, const s16 vol, const s16 pan, const u8 prio);
+// queues stopping every instance of sample `id`
+int sfx_stop(const u32 id);
+// starts everything queued since the last flush with one key on; also frees finished voices
+void sfx_flush(void);
+void sfx_get_stats(sfx_stats_t *stats);
@@ -0,0 +1,244 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <psxspu.h>
+
+#include "types.h"
+#include "util.h"
+#include "spu.h"
+#include "sfxpool.h"
+#include "spumap.h"
+
+// uploads are timed a chunk at a time, root counter 2 wraps too soon for the big samples
+#define UPLOAD_CHUNK 8192
+
+struct sample {
+  u32 ofs; // into data
+  u32 len; // 0 if the bank doesn't have it
+  u32 last_use;
+  u32 queued;           // sfx_play() requests, only written by the main loop
+  volatile u32 flushed; // of those, how many sfx_flush() got to, only written by it
+  u8 pinned;
+};
+
+// a sample that's in the pool
+struct block {
+  u32 addr;
+  u32 len;
+  u16 id;
+};
+
+static struct sfx_bank *bank;
+static u8 *data; // the bank's sample data
+static struct sample *samples; // [bank->num_sfx]
+
+static u32 pool_addr;
+static u32 pool_size;
+static struct block *blocks; // sorted by address
+static u32 num_blocks;
+static u32 use_counter;
+static sfx_pool_stats_t stats;
+
+struct sfx_bank *sfx_pool_init(const char *fname, const u32 size) {
+  pool_addr = ALIGN(spuram_ptr, 8);
+  pool_size = size & ~7;
+  if (pool_addr + pool_size > SPU_RAM_SIZE)
+    panic("out of SPU RAM for a %u byte SFX pool", size);
+
+  bank = read_sfx_bank(fname, &data);
+  samples = calloc(bank->num_sfx, sizeof(*samples));
+  blocks = malloc(bank->num_sfx * sizeof(*blocks));
+  ASSERT(samples && blocks);
+
+  // samples are stored back to back, so each one ends where the next one after it starts
+  u32 start = 0;
+  for (u32 i = 0; i < bank->num_sfx; ++i)
+    if (bank->sfx_addr[i] && (!start || bank->sfx_addr[i] < start))
+      start = bank->sfx_addr[i];
+  for (u32 i = 0; i < bank->num_sfx; ++i) {
+    const u32 addr = bank->sfx_addr[i];
+    if (!addr)
+      continue;
+    u32 end = start + bank->data_len;
+    for (u32 j = 0; j < bank->num_sfx; ++j)
+      if (bank->sfx_addr[j] > addr && bank->sfx_addr[j] < end)
+        end = bank->sfx_addr[j];
+    samples[i].ofs = addr - start;
+    samples[i].len = ALIGN(end - addr, 8);
+  }
+  // not before all of them are measured, the scan above needs every other sample's address
+  for (u32 i = 0; i < bank->num_sfx; ++i)
+    bank->sfx_addr[i] = 0;
+
+  num_blocks = 0;
+  use_counter = 0;
+  memset(&stats, 0, sizeof(stats));
+  spuram_ptr = pool_addr + pool_size;
+  spumap_add(SPUMAP_POOL, pool_addr, pool_size, fname, NULL);
+  rcnt2_start();
+
+  printf("sfx pool: %u bytes at %u for %u bytes of samples\n", pool_size, pool_addr, bank->data_len);
+  return bank;
+}
+
+struct sfx_bank *sfx_pool_get_bank(void) {
+  return bank;
+}
+
+// first gap that fits `len`, returns its address and the block index it goes in at, 0 if there's none
+static u32 pool_find_gap(const u32 len, u32 *at) {
+  u32 prev_end = pool_addr;
+  for (u32 i = 0; i < num_blocks; ++i) {
+    if (blocks[i].addr - prev_end >= len) {
+      *at = i;
+      return prev_end;
+    }
+    prev_end = blocks[i].addr + blocks[i].len;
+  }
+  if (pool_addr + pool_size - prev_end >= len) {
+    *at = num_blocks;
+    return prev_end;
+  }
+  return 0;
+}
+
+static void pool_remove(const u32 i) {
+  spumap_remove(SPUMAP_POOL_SAMPLE, blocks[i].addr);
+  bank->sfx_addr[blocks[i].id] = 0;
+  stats.resident -= blocks[i].len;
+  --num_blocks;
+  memmove(&blocks[i], &blocks[i + 1], (num_blocks - i) * sizeof(*blocks));
+}
+
+// whether a sample has to stay where it is: pinned, queued to be played or still playing
+static int pool_busy(const u32 i) {
+  const struct sample *s = &samples[blocks[i].id];
+  return s->pinned || s->queued != s->flushed || spu_addr_in_use(blocks[i].addr, blocks[i].len);
+}
+
+// evicts the least recently used sample that can go, returns 0 if none can
+static int pool_evict_lru(void) {
+  s32 best = -1;
+  for (u32 i = 0; i < num_blocks; ++i) {
+    const struct sample *s = &samples[blocks[i].id];
+    if (best >= 0 && s->last_use >= samples[blocks[best].id].last_use)
+      continue;
+    if (pool_busy(i))
+      continue;
+    best = i;
+  }
+  if (best < 0)
+    return 0;
+  pool_remove(best);
+  ++stats.evictions;
+  return 1;
+}
+
+static void pool_upload(const u32 id, const u32 addr) {
+  const struct sample *s = &samples[id];
+  u32 ticks = 0;
+  SpuSetTransferMode(SPU_TRANSFER_BY_DMA);
+  for (u32 done = 0; done < s->len; done += UPLOAD_CHUNK) {
+    const u32 len = (s->len - done > UPLOAD_CHUNK) ? UPLOAD_CHUNK : s->len - done;
+    const u16 start = rcnt2_read();
+    spu_set_transfer_addr(addr + done);
+    SpuWrite((void *)(data + s->ofs + done), len);
+    spu_wait_for_transfer();
+    ticks += (u16)(rcnt2_read() - start);
+  }
+
+  const u32 us = ticks * 1000 / (RCNT2_HZ / 1000);
+  ++stats.uploads;
+  stats.upload_us_last = us;
+  stats.upload_us_total += us;
+  if (us > stats.upload_us_max)
+    stats.upload_us_max = us;
+}
+
+// puts a sample in the pool if it isn't there yet, returns its address or 0
+static u32 pool_load(const u32 id) {
+  struct sample *s = &samples[id];
+  s->last_use = ++use_counter;
+  if (bank->sfx_addr[id])
+    return bank->sfx_addr[id];
+
+  if (s->len > pool_size) {
+    ++stats.failed;
+    return 0;
+  }
+
+  u32 at;
+  u32 addr;
+  while (!(addr = pool_find_gap(s->len, &at))) {
+    if (!pool_evict_lru()) {
+      ++stats.failed;
+      return 0;
+    }
+  }
+
+  pool_upload(id, addr);
+  memmove(&blocks[at + 1], &blocks[at], (num_blocks - at) * sizeof(*blocks));
+  blocks[at] = (struct block){ addr, s->len, id };
+  ++num_blocks;
+  stats.resident += s->len;
+  bank->sfx_addr[id] = addr;
+
+  char name[SPUMAP_NAME_LEN];
+  snprintf(name, sizeof(name), "SFX %u", id);
+  spumap_add(SPUMAP_POOL_SAMPLE, addr, s->len, name, NULL);
+  return addr;
+}
+
+u32 sfx_pool_get(const u32 id) {
+  if (!bank || id >= bank->num_sfx || !samples[id].len)
+    return 0;
+  if (bank->sfx_addr[id])
+    ++stats.hits;
+  else
+    ++stats.misses;
+  return pool_load(id);
+}
+
+u32 sfx_pool_preload(const u16 *ids, const u32 count, const int pin) {
+  u32 loaded = 0;
+  for (u32 i = 0; i < count; ++i) {
+    const u32 id = ids[i];
+    if (id >= bank->num_sfx || !samples[id].len)
+      continue;
+    if (pool_load(id)) {
+      samples[id].pinned |= !!pin;
+      ++loaded;
+    }
+  }
+  return loaded;
+}
+
+void sfx_pool_unpin_all(void) {
+  for (u32 i = 0; i < bank->num_sfx; ++i)
+    samples[i].pinned = 0;
+}
+
+void sfx_pool_mark_queued(const u32 id) {
+  if (bank && id < bank->num_sfx)
+    ++samples[id].queued;
+}
+
+void sfx_pool_unmark_queued(const u32 id) {
+  if (bank && id < bank->num_sfx)
+    --samples[id].queued;
+}
+
+void sfx_pool_mark_flushed(const u32 id) {
+  if (bank && id < bank->num_sfx)
+    ++samples[id].flushed;
+}
+
+void sfx_pool_clear(void) {
+  for (u32 i = num_blocks; i-- > 0; )
+    if (!pool_busy(i))
+      pool_remove(i);
+}
+
+void sfx_pool_get_stats(sfx_pool_stats_t *out) {
+  *out = stats;
+}
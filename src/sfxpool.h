@@ -0,0 +1,41 @@
+#pragma once
+
+#include "types.h"
+#include "util.h"
+
+// keeps the sample data of an SFX bank in main RAM and uploads samples into a pool of SPU RAM the first
+// time they're played, evicting the ones used least recently to make room; everything here does SPU DMA,
+// so it belongs in the main loop, not the timer IRQ
+
+typedef struct sfx_pool_stats {
+  u32 hits;      // played samples that were already in the pool
+  u32 misses;    // played samples that had to be uploaded first
+  u32 uploads;   // including preloads
+  u32 evictions;
+  u32 failed;    // didn't fit even with everything evicted that isn't pinned, queued or playing
+  u32 resident;  // bytes of the pool in use
+  u32 upload_us_last;
+  u32 upload_us_max;
+  u32 upload_us_total;
+} sfx_pool_stats_t;
+
+// reads a bank into main RAM and takes `pool_size` bytes of SPU RAM at spuram_ptr for the pool;
+// the bank's sfx_addr[] has the SPU address of every sample in the pool and 0 for the rest
+struct sfx_bank *sfx_pool_init(const char *fname, const u32 pool_size);
+// the bank from sfx_pool_init(), NULL if there is none
+struct sfx_bank *sfx_pool_get_bank(void);
+// SPU address of sample `id`, uploading it first if it's not in the pool; 0 if it can't be
+u32 sfx_pool_get(const u32 id);
+// uploads a set of samples ahead of time, e.g. the ones a level uses; pinned ones are never evicted,
+// which is what samples other code reads from sfx_addr[] directly need; returns how many made it
+u32 sfx_pool_preload(const u16 *ids, const u32 count, const int pin);
+void sfx_pool_unpin_all(void);
+// sfx_play() requests for a sample that sfx_flush() hasn't got to yet keep it from being evicted:
+// sfx_play() marks each one it queues (and unmarks it if the queue was full), sfx_flush() marks it flushed.
+// these don't touch SPU RAM, and mark_flushed() is the only one that's safe in the timer IRQ
+void sfx_pool_mark_queued(const u32 id);
+void sfx_pool_unmark_queued(const u32 id);
+void sfx_pool_mark_flushed(const u32 id);
+// evicts everything that isn't pinned, queued or playing
+void sfx_pool_clear(void);
+void sfx_pool_get_stats(sfx_pool_stats_t *stats);
@@ -1,26 +1,60 @@
+#include <stdlib.h>
+#ifdef HOST_BUILD
+#include <stdio.h>
+#endif
 #include <psxspu.h>
 
 #include "types.h"
 #include "spu.h"
+#include "tickprof.h"
 
-#define SPU_VOICE_BASE ((volatile u16 *)(0x1F801C00))
-#define SPU_KEY_ON_LO  ((volatile u16 *)(0x1F801D88))
-#define SPU_KEY_ON_HI  ((volatile u16 *)(0x1F801D8A))
-#define SPU_KEY_OFF_LO ((volatile u16 *)(0x1F801D8C))
-#define SPU_KEY_OFF_HI ((volatile u16 *)(0x1F801D8E))
-#define DMA_BASE       ((volatile u32 *)(0x1F801080))
+// register offsets from 0x1F801C00
+#define SPU_REG_VOICE(v, r)   ((v) * 0x10 + (r))
+#define SPU_REG_VOL_LEFT      0x0
+#define SPU_REG_VOL_RIGHT     0x2
+#define SPU_REG_PITCH         0x4
+#define SPU_REG_ADDR          0x6
+#define SPU_REG_ADSR_LO       0x8
+#define SPU_REG_ADSR_HI       0xA
+#define SPU_REG_ADSR_VOL      0xC
+#define SPU_REG_REPEAT_ADDR   0xE
+#define SPU_REG_MAIN_LEFT     0x180
+#define SPU_REG_MAIN_RIGHT    0x182
+#define SPU_REG_KEY_ON_LO     0x188
+#define SPU_REG_KEY_ON_HI     0x18A
+#define SPU_REG_KEY_OFF_LO    0x18C
+#define SPU_REG_KEY_OFF_HI    0x18E
+#define SPU_REG_NOISE_LO      0x194
+#define SPU_REG_NOISE_HI      0x196
+#define SPU_REG_ENDX_LO       0x19C
+#define SPU_REG_ENDX_HI       0x19E
+#define SPU_REG_CTRL          0x1AA
+#define SPU_REG_CD_VOL_LEFT   0x1B0
+#define SPU_REG_CD_VOL_RIGHT  0x1B2
 
-struct spu_voice {
-  volatile s16 vol_left;
-  volatile s16 vol_right;
-  volatile u16 sample_rate;
-  volatile u16 sample_startaddr;
-  volatile u16 attack_decay;
-  volatile u16 sustain_release;
-  volatile u16 vol_current;
-  volatile u16 sample_repeataddr;
-};
-#define SPU_VOICE(x) (((volatile struct spu_voice *)SPU_VOICE_BASE) + (x))
+#define SPU_CTRL_CD_ENABLE 0x0001
+#define SPU_CTRL_NOISE_SHIFT 8
+#define SPU_CTRL_NOISE_MASK (0x3F << SPU_CTRL_NOISE_SHIFT)
+
+// volume register bits; sweeps here are always linear, in the normal phase
+#define SPU_VOL_SWEEP      0x8000
+#define SPU_VOL_SWEEP_DEC  0x2000
+
+#ifdef HOST_BUILD
+
+// the host tools run this file against an SPU emulator
+extern void spu_host_write(const u32 reg, const u16 val);
+extern u16 spu_host_read(const u32 reg);
+#define SPU_WRITE_REG(reg, val) spu_host_write((reg), (val))
+#define SPU_READ(reg) spu_host_read(reg)
+
+#else
+
+#define SPU_BASE ((volatile u16 *)(0x1F801C00))
+#define SPU_WRITE_REG(reg, val) (SPU_BASE[(reg) >> 1] = (val))
+#define SPU_READ(reg) (SPU_BASE[(reg) >> 1])
+
+#define DMA_BASE       ((volatile u32 *)(0x1F801080))
 
 struct dma_regs {
     volatile u32 madr;
@@ -31,80 +65,419 @@ struct dma_regs {
 #define DMA_CTRL(x) (((volatile struct dma_regs *)DMA_BASE) + (x))
 #define DMA_CTRL_SPU 4
 
+#endif
+
+#if SPU_TRACE
+#define SPU_WRITE(reg, val) spu_trace_write((reg), (val))
+#else
+#define SPU_WRITE(reg, val) SPU_WRITE_REG((reg), (val))
+#endif
+
+#define SPU_VOICE_WRITE(v, r, val) SPU_WRITE(SPU_REG_VOICE(v, SPU_REG_ ## r), (val))
+#define SPU_VOICE_READ(v, r) SPU_READ(SPU_REG_VOICE(v, SPU_REG_ ## r))
+
+#define VOICE_RELEASED 0x80 // internal flag, next to SPU_VOICE_ONESHOT
+
+// which registers of a voice spu_flush_voices() has to write
+#define DIRTY_VOL   1
+#define DIRTY_PITCH 2
+#define DIRTY_ADDR  4
+#define DIRTY_ADSR  8
+
 #define PAN_SHIFT 8
 
+#define SWEEP_MAX_LEVEL 0x7FFF // a fixed volume is half the level it sets
+
 u32 spuram_ptr = SPU_RAM_START;
 
+#if SPU_TRACE
+
+static int trace_on;
+static u32 trace_tick;
+
+#ifdef HOST_BUILD
+static FILE *trace_file;
+static spu_trace_header_t trace_hdr;
+#else
+static struct {
+  spu_trace_header_t hdr;
+  spu_trace_rec_t recs[SPU_TRACE_RING_LEN];
+} trace_ring;
+#endif
+
+static void spu_trace_write(const u32 reg, const u16 val) {
+  if (trace_on) {
+    const spu_trace_rec_t rec = { trace_tick, reg, val };
+#ifdef HOST_BUILD
+    fwrite(&rec, sizeof(rec), 1, trace_file);
+    ++trace_hdr.num_recs;
+#else
+    // the main loop also writes a few registers outside critical sections (master volume, SFX with XA),
+    // if the timer IRQ comes in right here one of its records can get lost; only the trace suffers
+    const u32 i = trace_ring.hdr.head;
+    trace_ring.recs[i] = rec;
+    trace_ring.hdr.head = (i + 1 < SPU_TRACE_RING_LEN) ? i + 1 : 0;
+    if (trace_ring.hdr.num_recs < SPU_TRACE_RING_LEN)
+      ++trace_ring.hdr.num_recs;
+#endif
+  }
+  SPU_WRITE_REG(reg, val);
+}
+
+int spu_trace_start(const char *fname) {
+  spu_trace_stop();
+
+#ifdef HOST_BUILD
+  spu_trace_header_t *hdr = &trace_hdr;
+#else
+  spu_trace_header_t *hdr = &trace_ring.hdr;
+#endif
+  hdr->magic = SPU_TRACE_MAGIC;
+  hdr->version = SPU_TRACE_VERSION;
+  hdr->rec_size = sizeof(spu_trace_rec_t);
+  hdr->num_recs = 0;
+  hdr->head = 0;
+  hdr->pad = 0;
+
+#ifdef HOST_BUILD
+  hdr->ring_len = 0;
+  trace_file = fopen(fname, "wb");
+  if (!trace_file) {
+    printf("spu_trace_start(%s): could not open file\n", fname);
+    return 0;
+  }
+  fwrite(hdr, sizeof(*hdr), 1, trace_file);
+#else
+  (void)fname;
+  hdr->ring_len = SPU_TRACE_RING_LEN;
+#endif
+
+  trace_tick = 0;
+  trace_on = 1;
+  return 1;
+}
+
+void spu_trace_stop(void) {
+  if (!trace_on)
+    return;
+  trace_on = 0;
+#ifdef HOST_BUILD
+  // now with the number of records
+  fseek(trace_file, 0, SEEK_SET);
+  fwrite(&trace_hdr, sizeof(trace_hdr), 1, trace_file);
+  fclose(trace_file);
+  trace_file = NULL;
+#endif
+}
+
+void spu_trace_tick(void) {
+  ++trace_tick;
+}
+
+const spu_trace_header_t *spu_trace_get_ring(void) {
+#ifdef HOST_BUILD
+  return NULL;
+#else
+  return &trace_ring.hdr;
+#endif
+}
+
+#endif
+
 // saved state for stop/play
 static struct {
   u32 addr;
   s16 vol; // 0 to SPU_MAX_VOLUME
   s16 pan; // -255 to 255
   u16 freq;
-  u16 dirty;
+  u8 dirty;
+  s8 sweep; // < 0 or > 0 while a sweep is waiting to be written
+  u8 swept; // the registers are in sweep mode, the next volume has to be written whatever it is
+  u16 sweep_ms;
+  u16 out_left; // last fixed volumes written
+  u16 out_right;
+  u16 adsr_lo;
+  u16 adsr_hi;
 } voice_state[SPU_NUM_VOICES];
 
+static s16 master_vol;
+
+static u32 noise_mask; // voices in noise mode
+static u8 noise_clock;
+static u8 noise_dirty; // noise_mask or noise_clock have to be written
+
+// who has which voice
+static struct {
+  const void *owner;
+  u32 age;
+  u8 prio;
+  u8 flags;
+} voice_alloc[SPU_NUM_VOICES];
+static u32 voice_free_mask = SPU_ALL_VOICES;
+static u32 voice_fresh_mask; // taken since the last spu_update_voices()
+static u32 voice_age;
+
+// silence that ends without looping, for noise voices to run through
+static void spu_upload_noise_carrier(void) {
+  static u8 carrier[SPU_NOISE_CARRIER_LEN];
+  for (u32 i = 0; i < SPU_NOISE_CARRIER_LEN; i += 16)
+    carrier[i + 1] = (i + 16 < SPU_NOISE_CARRIER_LEN) ? 0 : 1; // end, no repeat
+  SpuSetTransferMode(SPU_TRANSFER_BY_DMA);
+  spu_set_transfer_addr(SPU_NOISE_CARRIER_ADDR);
+  SpuWrite((void *)carrier, sizeof(carrier));
+  spu_wait_for_transfer();
+}
+
 void spu_init(void) {
   SpuInit();
+  spu_upload_noise_carrier();
+  noise_mask = 0;
+  noise_clock = 0;
+  noise_dirty = 0;
+  SPU_WRITE(SPU_REG_NOISE_LO, 0);
+  SPU_WRITE(SPU_REG_NOISE_HI, 0);
   spu_clear_all_voices();
+  spu_set_master_volume(SPU_MAX_VOLUME);
   spuram_ptr = SPU_RAM_START;
 }
 
 void spu_key_on(const u32 mask) {
-  *SPU_KEY_ON_LO = mask;
-  *SPU_KEY_ON_HI = mask >> 16;
+  SPU_WRITE(SPU_REG_KEY_ON_LO, mask);
+  SPU_WRITE(SPU_REG_KEY_ON_HI, mask >> 16);
 }
 
 void spu_key_off(const u32 mask) {
-  *SPU_KEY_OFF_LO = mask;
-  *SPU_KEY_OFF_HI = mask >> 16;
+  SPU_WRITE(SPU_REG_KEY_OFF_LO, mask);
+  SPU_WRITE(SPU_REG_KEY_OFF_HI, mask >> 16);
 }
 
 void spu_clear_voice(const u32 v) {
-  SPU_VOICE(v)->vol_left = 0;
-  SPU_VOICE(v)->vol_right = 0;
-  SPU_VOICE(v)->sample_rate = 0;
-  SPU_VOICE(v)->sample_startaddr = 0;
-  SPU_VOICE(v)->sample_repeataddr = 0;
-  SPU_VOICE(v)->attack_decay = 0x000F;
-  SPU_VOICE(v)->sustain_release = 0x0000;
-  SPU_VOICE(v)->vol_current = 0;
+  SPU_VOICE_WRITE(v, VOL_LEFT, 0);
+  SPU_VOICE_WRITE(v, VOL_RIGHT, 0);
+  SPU_VOICE_WRITE(v, PITCH, 0);
+  SPU_VOICE_WRITE(v, ADDR, 0);
+  SPU_VOICE_WRITE(v, REPEAT_ADDR, 0);
+  SPU_VOICE_WRITE(v, ADSR_LO, SPU_ADSR_LO_DEFAULT);
+  SPU_VOICE_WRITE(v, ADSR_HI, SPU_ADSR_HI_DEFAULT);
+  SPU_VOICE_WRITE(v, ADSR_VOL, 0);
   voice_state[v].vol = 0;
   voice_state[v].pan = 0;
   voice_state[v].addr = 0;
   voice_state[v].freq = 0;
   voice_state[v].dirty = 0;
+  voice_state[v].sweep = 0;
+  voice_state[v].swept = 0;
+  voice_state[v].out_left = 0;
+  voice_state[v].out_right = 0;
+  voice_state[v].adsr_lo = SPU_ADSR_LO_DEFAULT;
+  voice_state[v].adsr_hi = SPU_ADSR_HI_DEFAULT;
+  if (noise_mask & SPU_VOICECH(v)) {
+    noise_mask &= ~SPU_VOICECH(v);
+    noise_dirty = 1;
+  }
 }
 
 void spu_clear_all_voices(void) {
   spu_key_off(0xFFFFFFFF);
-  for (u32 i = 0; i < 24; ++i)
+  for (u32 i = 0; i < 24; ++i) {
     spu_clear_voice(i);
+    voice_alloc[i].owner = NULL;
+  }
+  voice_free_mask = SPU_ALL_VOICES;
+}
+
+// index of the lowest set bit of x != 0; __builtin_ctz would need libgcc, which the player doesn't link
+static inline u32 lowest_bit(const u32 x) {
+  static const u8 debruijn[32] = {
+    0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+    31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9,
+  };
+  return debruijn[((x & -x) * 0x077CB531u) >> 27];
+}
+
+static inline void spu_take_voice(const u32 v, const u8 prio, const u8 flags, const void *owner) {
+  voice_free_mask &= ~SPU_VOICECH(v);
+  voice_fresh_mask |= SPU_VOICECH(v);
+  // whoever had it before might have left it on the noise generator or with its own envelope
+  if (voice_alloc[v].owner != owner) {
+    spu_set_voice_noise(v, 0);
+    spu_set_voice_adsr(v, SPU_ADSR_LO_DEFAULT, SPU_ADSR_HI_DEFAULT);
+  }
+  voice_alloc[v].owner = owner;
+  voice_alloc[v].age = voice_age++;
+  voice_alloc[v].prio = prio;
+  voice_alloc[v].flags = flags;
+}
+
+s32 spu_alloc_voice(const u32 mask, const u8 prio, const u8 flags, const void *owner) {
+  const u32 free = voice_free_mask & mask;
+  if (free) {
+    const u32 v = lowest_bit(free);
+    spu_take_voice(v, prio, flags, owner);
+    return v;
+  }
+
+  // steal the least important voice, the oldest one if there's a tie
+  s32 best = -1;
+  u32 best_prio = prio;
+  u32 best_age = 0;
+  for (u32 v = 0; v < SPU_NUM_VOICES; ++v) {
+    if (!(mask & SPU_VOICECH(v)))
+      continue;
+    const u32 vprio = (voice_alloc[v].flags & VOICE_RELEASED) ? 0 : voice_alloc[v].prio;
+    if (vprio < best_prio || (vprio == best_prio && (best < 0 || voice_alloc[v].age < best_age))) {
+      best = v;
+      best_prio = vprio;
+      best_age = voice_alloc[v].age;
+    }
+  }
+
+  if (best >= 0)
+    spu_take_voice(best, prio, flags, owner);
+  return best;
+}
+
+void spu_renew_voice(const u32 v, const u8 prio, const u8 flags) {
+  spu_take_voice(v, prio, flags, voice_alloc[v].owner);
+}
+
+void spu_release_voice(const u32 v) {
+  voice_alloc[v].flags |= VOICE_RELEASED;
+}
+
+void spu_free_voice(const u32 v) {
+  voice_alloc[v].owner = NULL;
+  voice_free_mask |= SPU_VOICECH(v);
+}
+
+int spu_voice_owned(const u32 v, const void *owner) {
+  return !(voice_free_mask & SPU_VOICECH(v)) && voice_alloc[v].owner == owner;
+}
+
+void spu_update_voices(void) {
+  // ENDX bits of one-shot voices mean they've played to the end and gone silent; key on clears them,
+  // but voices taken since the last call might not have been keyed on yet, so leave those until the next
+  const u32 endx = SPU_READ(SPU_REG_ENDX_LO) | ((u32)SPU_READ(SPU_REG_ENDX_HI) << 16);
+  u32 busy = ~(voice_free_mask | voice_fresh_mask) & SPU_ALL_VOICES;
+  voice_fresh_mask = 0;
+  while (busy) {
+    const u32 v = lowest_bit(busy);
+    busy &= busy - 1;
+    const u8 flags = voice_alloc[v].flags;
+    if ((flags & SPU_VOICE_ONESHOT) && (endx & SPU_VOICECH(v)))
+      spu_free_voice(v);
+    else if ((flags & VOICE_RELEASED) && SPU_VOICE_READ(v, ADSR_VOL) == 0)
+      spu_free_voice(v);
+  }
+}
+
+u32 spu_get_free_voices(void) {
+  return voice_free_mask;
+}
+
+int spu_addr_in_use(const u32 addr, const u32 len) {
+  u32 busy = ~voice_free_mask & SPU_ALL_VOICES;
+  while (busy) {
+    const u32 v = lowest_bit(busy);
+    busy &= busy - 1;
+    if ((u32)(voice_state[v].addr << 3) - addr < len)
+      return 1;
+  }
+  return 0;
 }
 
+// setting what a voice already has doesn't cost a register write
 void spu_set_voice_volume(const u32 v, const s16 vol) {
-  voice_state[v].vol = vol;
-  voice_state[v].dirty = 1;
+  if (vol != voice_state[v].vol || voice_state[v].swept) {
+    voice_state[v].vol = vol;
+    voice_state[v].sweep = 0;
+    voice_state[v].dirty |= DIRTY_VOL;
+  }
 }
 
 void spu_set_voice_pan(const u32 v, const s16 pan) {
-  voice_state[v].pan = pan;
-  voice_state[v].dirty = 1;
+  if (pan != voice_state[v].pan) {
+    voice_state[v].pan = pan;
+    voice_state[v].dirty |= DIRTY_VOL;
+  }
 }
 
 void spu_set_voice_freq(const u32 v, const u32 hz) {
   voice_state[v].freq = freq2pitch(hz);
-  voice_state[v].dirty = 1;
+  voice_state[v].dirty |= DIRTY_PITCH;
 }
 
 void spu_set_voice_pitch(const u32 v, const u32 pitch) {
   voice_state[v].freq = pitch;
-  voice_state[v].dirty = 1;
+  voice_state[v].dirty |= DIRTY_PITCH;
 }
 
 void spu_set_voice_addr(const u32 v, const u32 addr) {
   voice_state[v].addr = (addr >> 3);
-  voice_state[v].dirty = 1;
+  voice_state[v].dirty |= DIRTY_ADDR;
+}
+
+void spu_set_voice_adsr(const u32 v, const u16 lo, const u16 hi) {
+  if (lo != voice_state[v].adsr_lo || hi != voice_state[v].adsr_hi) {
+    voice_state[v].adsr_lo = lo;
+    voice_state[v].adsr_hi = hi;
+    voice_state[v].dirty |= DIRTY_ADSR;
+  }
+}
+
+void spu_set_voice_noise(const u32 v, const int on) {
+  const u32 mask = on ? (noise_mask | SPU_VOICECH(v)) : (noise_mask & ~SPU_VOICECH(v));
+  if (mask != noise_mask) {
+    noise_mask = mask;
+    noise_dirty = 1;
+  }
+}
+
+void spu_set_noise_clock(const u32 clock) {
+  const u8 c = (clock > SPU_NOISE_CLOCK_MAX) ? SPU_NOISE_CLOCK_MAX : clock;
+  if (c != noise_clock) {
+    noise_clock = c;
+    noise_dirty = 1;
+  }
+}
+
+void spu_sweep_voice(const u32 v, const s16 vol, const u32 ms) {
+  if (vol == voice_state[v].vol && !voice_state[v].swept)
+    return;
+  voice_state[v].sweep = (vol < voice_state[v].vol) ? -1 : 1;
+  voice_state[v].sweep_ms = (ms > 0xFFFF) ? 0xFFFF : ms;
+  voice_state[v].vol = vol;
+  voice_state[v].dirty |= DIRTY_VOL;
+}
+
+// the sweep rate that moves a level by `delta` in about `ms`: the closest one that gets to silence
+// no later than that going down, and that doesn't overshoot going up, since it only stops at full volume
+static u16 spu_sweep_rate(const u32 delta, const u32 ms, const int up) {
+  u32 samples = ms * 441 / 10;
+  if (!samples) samples = 1;
+  const u32 want = (delta << 16) / samples; // level per sample, 16.16
+  // the step gets smaller as the rate goes up: (7 or 8 - (rate & 3)) << (11 - shift), or >> (shift - 11)
+  u32 lo = 0, hi = 0x7F;
+  while (lo < hi) {
+    const u32 mid = up ? (lo + hi) / 2 : (lo + hi + 1) / 2;
+    const u32 shift = mid >> 2;
+    const u32 step = ((up ? 7 : 8) - (mid & 3)) << 16;
+    const u32 got = (shift < 11) ? (step << (11 - shift)) : (step >> (shift - 11));
+    if (up) {
+      if (got <= want) hi = mid;
+      else lo = mid + 1;
+    } else {
+      if (got >= want) lo = mid;
+      else hi = mid - 1;
+    }
+  }
+  return SPU_VOL_SWEEP | (up ? 0 : SPU_VOL_SWEEP_DEC) | lo;
+}
+
+static inline u16 spu_voice_sweep(const u32 v, const u16 from, const u16 to) {
+  const int up = voice_state[v].sweep > 0;
+  const u32 delta = up ? ((to > from) ? to - from : 0) : from;
+  return spu_sweep_rate(delta << 1, voice_state[v].sweep_ms, up);
 }
 
 static inline void spu_update_voice_volume(const u32 v) {
@@ -115,32 +488,88 @@ static inline void spu_update_voice_volume(const u32 v) {
     vol_right = (vol_right * -pan) >> PAN_SHIFT;
   else if (pan > 0)
     vol_left = (vol_left * pan) >> PAN_SHIFT;
-  SPU_VOICE(v)->vol_left = vol_left;
-  SPU_VOICE(v)->vol_right = vol_right;
+
+  if (voice_state[v].sweep) {
+    // the sweep starts from what the registers were last set to
+    SPU_VOICE_WRITE(v, VOL_LEFT, spu_voice_sweep(v, voice_state[v].out_left, vol_left));
+    SPU_VOICE_WRITE(v, VOL_RIGHT, spu_voice_sweep(v, voice_state[v].out_right, vol_right));
+    voice_state[v].swept = voice_state[v].sweep > 0;
+    voice_state[v].sweep = 0;
+    // going down, it ends up at what it was set to; going up, the next volume set ends it
+    voice_state[v].out_left = voice_state[v].swept ? vol_left : 0;
+    voice_state[v].out_right = voice_state[v].swept ? vol_right : 0;
+    return;
+  }
+
+  SPU_VOICE_WRITE(v, VOL_LEFT, vol_left);
+  SPU_VOICE_WRITE(v, VOL_RIGHT, vol_right);
+  voice_state[v].out_left = vol_left;
+  voice_state[v].out_right = vol_right;
+  voice_state[v].swept = 0;
 }
 
 void spu_flush_voices(void) {
+  tickprof_flush_begin();
   SpuWait();
   for (int v = 0; v < SPU_NUM_VOICES; ++v) {
-    if (voice_state[v].dirty) {
+    const u8 dirty = voice_state[v].dirty;
+    if (dirty) {
       voice_state[v].dirty = 0;
-      spu_update_voice_volume(v);
-      SPU_VOICE(v)->sample_rate = voice_state[v].freq;
-      SPU_VOICE(v)->sample_startaddr = voice_state[v].addr;
+      if (dirty & DIRTY_VOL)
+        spu_update_voice_volume(v);
+      if (dirty & DIRTY_PITCH)
+        SPU_VOICE_WRITE(v, PITCH, voice_state[v].freq);
+      if (dirty & DIRTY_ADDR)
+        SPU_VOICE_WRITE(v, ADDR, voice_state[v].addr);
+      if (dirty & DIRTY_ADSR) {
+        SPU_VOICE_WRITE(v, ADSR_LO, voice_state[v].adsr_lo);
+        SPU_VOICE_WRITE(v, ADSR_HI, voice_state[v].adsr_hi);
+      }
     }
   }
+  if (noise_dirty) {
+    noise_dirty = 0;
+    SPU_WRITE(SPU_REG_NOISE_LO, noise_mask);
+    SPU_WRITE(SPU_REG_NOISE_HI, noise_mask >> 16);
+    SPU_WRITE(SPU_REG_CTRL, (SPU_READ(SPU_REG_CTRL) & ~SPU_CTRL_NOISE_MASK) | (noise_clock << SPU_CTRL_NOISE_SHIFT));
+  }
+  tickprof_flush_end();
 }
 
 void spu_play_sample(const u32 ch, const u32 addr, const u32 freq) {
   spu_update_voice_volume(ch); // restore volume
   voice_state[ch].freq = freq2pitch(freq);
   voice_state[ch].addr = (addr >> 3);
-  SPU_VOICE(ch)->sample_rate = voice_state[ch].freq;
-  SPU_VOICE(ch)->sample_startaddr = voice_state[ch].addr;
+  SPU_VOICE_WRITE(ch, PITCH, voice_state[ch].freq);
+  SPU_VOICE_WRITE(ch, ADDR, voice_state[ch].addr);
   spu_key_on(SPU_VOICECH(ch)); // this restarts the channel on the new address
 }
 
 void spu_wait_for_transfer(void) {
+#ifndef HOST_BUILD
   while ((DMA_CTRL(DMA_CTRL_SPU)->chcr & 0x01000000) != 0) { }
+#endif
   SpuWait();
 }
+
+void spu_set_master_volume(const s16 vol) {
+  master_vol = vol;
+  SPU_WRITE(SPU_REG_MAIN_LEFT, vol);
+  SPU_WRITE(SPU_REG_MAIN_RIGHT, vol);
+}
+
+void spu_fade_master(const s16 vol, const u32 ms) {
+  // like voices, the main volume can only sweep down to silence or up to full volume
+  const int up = vol > master_vol;
+  const u32 delta = up ? SPU_MAX_VOLUME - master_vol : master_vol;
+  const u16 val = spu_sweep_rate(delta << 1, ms, up);
+  master_vol = up ? SPU_MAX_VOLUME : 0;
+  SPU_WRITE(SPU_REG_MAIN_LEFT, val);
+  SPU_WRITE(SPU_REG_MAIN_RIGHT, val);
+}
+
+void spu_set_cd_volume(const s16 vol) {
+  SPU_WRITE(SPU_REG_CD_VOL_LEFT, vol);
+  SPU_WRITE(SPU_REG_CD_VOL_RIGHT, vol);
+  SPU_WRITE(SPU_REG_CTRL, SPU_READ(SPU_REG_CTRL) | SPU_CTRL_CD_ENABLE);
+}
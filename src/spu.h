@@ -3,10 +3,42 @@
 #include <psxspu.h>
 #include "types.h"
 #include "util.h"
+#include "sputrace.h"
 
 #define SPU_NUM_VOICES 24
 #define SPU_MAX_VOLUME 0x3FFF
 #define SPU_RAM_START 0x1100
+#define SPU_RAM_SIZE  0x80000
+#define SPU_ALL_VOICES ((1 << SPU_NUM_VOICES) - 1)
+
+// voice priorities: a request can steal any voice with the same or a lower priority,
+// released voices (see spu_release_voice()) count as the lowest
+#define SPU_PRIO_MUSIC 64
+#define SPU_PRIO_SFX   128
+
+// the sample doesn't loop, so the voice frees itself once it reaches the end
+#define SPU_VOICE_ONESHOT 1
+
+// what voices get when they're taken: instant attack, full sustain, instant release
+#define SPU_ADSR_LO_DEFAULT 0x000F
+#define SPU_ADSR_HI_DEFAULT 0x0000
+
+// voices on the noise generator still play through a sample, silently, and stop at its end like one-shots;
+// this one is below SPU_RAM_START and lasts SPU_NOISE_CARRIER_SAMPLES at pitch 0x1000
+#define SPU_NOISE_CARRIER_ADDR 0x1000
+#define SPU_NOISE_CARRIER_LEN 256
+#define SPU_NOISE_CARRIER_SAMPLES (SPU_NOISE_CARRIER_LEN / 16 * 28)
+#define SPU_NOISE_CLOCK_MAX 63
+
+// every register write spu.c makes can be traced, see sputrace.h; it costs a check per write and the ring
+// on target, so it's off there unless built with -DSPU_TRACE=1
+#ifndef SPU_TRACE
+#ifdef HOST_BUILD
+#define SPU_TRACE 1
+#else
+#define SPU_TRACE 0
+#endif
+#endif
 
 extern u32 spuram_ptr;
 
@@ -19,15 +51,78 @@ void spu_set_voice_pan(const u32 v, const s16 pan);
 void spu_set_voice_freq(const u32 v, const u32 hz);
 void spu_set_voice_pitch(const u32 v, const u32 pitch);
 void spu_set_voice_addr(const u32 v, const u32 addr);
+// envelope register values, see SPU_ADSR_LO/HI_DEFAULT
+void spu_set_voice_adsr(const u32 v, const u16 lo, const u16 hi);
+// plays the noise generator instead of the voice's sample; taking a voice turns this off again
+void spu_set_voice_noise(const u32 v, const int on);
+// the one clock every noise voice shares, 0 to SPU_NOISE_CLOCK_MAX: 4 steps to an octave, 60 and up change every sample
+void spu_set_noise_clock(const u32 clock);
+// has the SPU ramp the voice's volume linearly from what it was last set to over about `ms`, instead of
+// writing it every tick; sweeps only stop at silence or full volume, so `vol` has to be 0 or higher than
+// the current volume, and an upward sweep has to be ended by setting the volume once it's done
+void spu_sweep_voice(const u32 v, const s16 vol, const u32 ms);
 void spu_flush_voices(void);
 void spu_play_sample(const u32 ch, const u32 addr, const u32 srate);
 void spu_wait_for_transfer(void);
 void spu_clear_all_voices(void);
 
+// voice allocator, shared by the sequencer and SFX; not reentrant, so code outside the sequencer's
+// timer IRQ has to run it in a critical section
+// gets a voice from `mask` for `owner`: a free one if there is any, otherwise the oldest of the
+// lowest-priority ones not above `prio`; returns -1 if everything in `mask` is more important
+s32 spu_alloc_voice(const u32 mask, const u8 prio, const u8 flags, const void *owner);
+// restarts the age and priority of a voice the caller still owns, for playing a new note on it
+void spu_renew_voice(const u32 v, const u8 prio, const u8 flags);
+// the voice has been keyed off: it frees itself once its release has faded out
+void spu_release_voice(const u32 v);
+void spu_free_voice(const u32 v);
+// whether `owner` still has `v`, it might have been stolen or freed
+int spu_voice_owned(const u32 v, const void *owner);
+// frees the voices that have finished playing, going by ENDX and the envelope volume;
+// the sequencer calls this every tick
+void spu_update_voices(void);
+u32 spu_get_free_voices(void);
+// whether a voice that's taken was started somewhere in [addr, addr + len), e.g. before replacing sample data
+int spu_addr_in_use(const u32 addr, const u32 len);
+
+// main volume, applied to the mix of every voice and CD audio
+void spu_set_master_volume(const s16 vol);
+// sweeps the main volume down to silence (vol 0) or up to full volume (anything higher) over about `ms`
+void spu_fade_master(const s16 vol, const u32 ms);
+
+// volume of CD audio (XA and CD-DA) in the SPU mix, also makes sure it's enabled
+void spu_set_cd_volume(const s16 vol);
+
+#if SPU_TRACE
+
+// starts a new trace, on the host into `fname`, on target into the ring (`fname` isn't used there);
+// returns 0 if the file can't be opened. on target, call it in a critical section while the timer runs
+int spu_trace_start(const char *fname);
+// finishes the file on the host; the ring stays as it is
+void spu_trace_stop(void);
+// the sequencer's timer calls this once per tick, before it does anything
+void spu_trace_tick(void);
+// NULL on the host
+const spu_trace_header_t *spu_trace_get_ring(void);
+
+#else
+
+static inline int spu_trace_start(const char *fname) { (void)fname; return 0; }
+#define spu_trace_stop() ((void)0)
+#define spu_trace_tick() ((void)0)
+#define spu_trace_get_ring() ((const spu_trace_header_t *)NULL)
+
+#endif
+
 static inline u16 freq2pitch(const u32 hz) {
   return (hz << 12) / 44100;
 }
 
+// same as above, but also scales the result by a 4.12 multiplier
+static inline u16 freq2pitch_scaled(const u32 hz, const u32 mul) {
+  return (hz * mul) / 44100;
+}
+
 // unfortunately the psn00bsdk function for this is bugged:
 // it checks against 0x1000..0xffff instead of 0x1000..0x7ffff
 // fortunately, the address is stored in a global variable
@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "util.h"
+#include "spu.h"
+#include "spumap.h"
+
+static spumap_region_t *regions;
+static u32 num_regions;
+static u32 max_regions;
+static int dirty; // has to be sorted and nested again
+
+static const char *kind_names[SPUMAP_NUM_KINDS] = { "BANK", "SYNTH", "POOL", "SFX", "SLOT" };
+
+static inline int is_container(const u8 kind) {
+  return kind == SPUMAP_POOL || kind == SPUMAP_SLOT;
+}
+
+void spumap_add(const u8 kind, const u32 addr, const u32 len, const char *name, const struct sfx_bank *bank) {
+  if (num_regions == max_regions) {
+    max_regions += 16;
+    regions = realloc(regions, max_regions * sizeof(*regions));
+    ASSERT(regions);
+  }
+
+  spumap_region_t *r = &regions[num_regions++];
+  r->addr = addr;
+  r->len = len;
+  r->used = len;
+  r->kind = kind;
+  r->nested = 0;
+  r->bank = bank;
+
+  // just the file name of a CD path, without the version
+  u32 i = 0;
+  if (name) {
+    const char *slash = strrchr(name, '\\');
+    if (slash) name = slash + 1;
+    for (; i < SPUMAP_NAME_LEN - 1 && name[i] && name[i] != ';'; ++i)
+      r->name[i] = name[i];
+  }
+  r->name[i] = '\0';
+
+  dirty = 1;
+}
+
+static void spumap_remove_at(const u32 i) {
+  --num_regions;
+  memmove(&regions[i], &regions[i + 1], (num_regions - i) * sizeof(*regions));
+  dirty = 1;
+}
+
+void spumap_remove(const u8 kind, const u32 addr) {
+  for (u32 i = 0; i < num_regions; ++i) {
+    if (regions[i].kind == kind && regions[i].addr == addr) {
+      spumap_remove_at(i);
+      return;
+    }
+  }
+}
+
+void spumap_remove_bank(const struct sfx_bank *bank) {
+  for (u32 i = num_regions; i-- > 0; )
+    if (regions[i].bank == bank)
+      spumap_remove_at(i);
+}
+
+// sorts by address, containers first and bigger ones first where they start at the same place,
+// then works out what's in which container
+static void spumap_update(void) {
+  if (!dirty)
+    return;
+  dirty = 0;
+
+  for (u32 i = 1; i < num_regions; ++i) {
+    const spumap_region_t r = regions[i];
+    u32 j = i;
+    for (; j > 0; --j) {
+      const spumap_region_t *p = &regions[j - 1];
+      if (p->addr < r.addr) break;
+      if (p->addr == r.addr && (is_container(p->kind) > is_container(r.kind) ||
+          (is_container(p->kind) == is_container(r.kind) && p->len >= r.len)))
+        break;
+      regions[j] = *p;
+    }
+    regions[j] = r;
+  }
+
+  for (u32 i = 0; i < num_regions; ++i) {
+    regions[i].nested = 0;
+    regions[i].used = is_container(regions[i].kind) ? 0 : regions[i].len;
+  }
+  for (u32 c = 0; c < num_regions; ++c) {
+    spumap_region_t *cont = &regions[c];
+    if (!is_container(cont->kind))
+      continue;
+    for (u32 i = c + 1; i < num_regions && regions[i].addr < cont->addr + cont->len; ++i) {
+      spumap_region_t *r = &regions[i];
+      if (!is_container(r->kind) && r->addr + r->len <= cont->addr + cont->len) {
+        r->nested = 1;
+        cont->used += r->len;
+      }
+    }
+  }
+}
+
+const spumap_region_t *spumap_get_regions(u32 *count) {
+  spumap_update();
+  *count = num_regions;
+  return regions;
+}
+
+u32 spumap_get_samples(const spumap_region_t *region, spumap_sample_t *out, const u32 max) {
+  const struct sfx_bank *bank = region->bank;
+  if (!bank)
+    return 0;
+
+  u32 n = 0;
+  for (u32 id = 0; id < bank->num_sfx; ++id) {
+    const u32 addr = bank->sfx_addr[id];
+    if (!addr || addr < region->addr || addr >= region->addr + region->len)
+      continue;
+    if (n < max) {
+      u32 j = n;
+      for (; j > 0 && out[j - 1].addr > addr; --j)
+        out[j] = out[j - 1];
+      out[j].addr = addr;
+      out[j].id = id;
+    }
+    ++n;
+  }
+
+  const u32 num = (n < max) ? n : max;
+  for (u32 i = 0; i < num; ++i)
+    out[i].len = ((i + 1 < num) ? out[i + 1].addr : region->addr + region->len) - out[i].addr;
+  return n;
+}
+
+void spumap_get_stats(spumap_stats_t *stats) {
+  spumap_update();
+  memset(stats, 0, sizeof(*stats));
+  stats->ptr = spuram_ptr;
+  stats->num_regions = num_regions;
+
+  u32 end = SPU_RAM_START;
+  for (u32 i = 0; i < num_regions; ++i) {
+    const spumap_region_t *r = &regions[i];
+    if (r->nested || r->addr + r->len <= SPU_RAM_START)
+      continue;
+    if (r->addr < end && r->addr >= SPU_RAM_START) {
+      ++stats->overlaps;
+    } else if (r->addr > end) {
+      const u32 gap = r->addr - end;
+      stats->free += gap;
+      ++stats->num_gaps;
+      if (gap > stats->largest_gap) stats->largest_gap = gap;
+    }
+    if (r->addr + r->len > end)
+      end = r->addr + r->len;
+  }
+  if (end < SPU_RAM_SIZE) {
+    const u32 gap = SPU_RAM_SIZE - end;
+    stats->free += gap;
+    ++stats->num_gaps;
+    if (gap > stats->largest_gap) stats->largest_gap = gap;
+  }
+
+  stats->used = SPU_RAM_SIZE - SPU_RAM_START - stats->free;
+  stats->fragmentation = stats->free ? 100 - stats->largest_gap * 100 / stats->free : 0;
+}
+
+const char *spumap_kind_name(const u8 kind) {
+  return (kind < SPUMAP_NUM_KINDS) ? kind_names[kind] : "?";
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "types.h"
+#include "util.h"
+
+// what's where in SPU RAM, for debugging: everything that puts data there or sets space aside registers
+// it here. pools and playlist slots are containers, what gets put in them is registered on its own too.
+// it mallocs, so it's only for the main loop, not the timer IRQ
+
+#define SPUMAP_NAME_LEN 12
+
+enum spumap_kind {
+  SPUMAP_BANK,        // from load_sfx_bank() and load_sfx_bank_at()
+  SPUMAP_SYNTH,       // instruments org_load() made from the wavetable
+  SPUMAP_POOL,        // the SFX pool, a container
+  SPUMAP_POOL_SAMPLE, // a sample that's in the pool right now
+  SPUMAP_SLOT,        // a playlist slot, a container
+  SPUMAP_NUM_KINDS,
+};
+
+typedef struct spumap_region {
+  u32 addr;
+  u32 len;
+  u32 used; // for containers, bytes of it taken by what's in them; len for the rest
+  u8 kind;
+  u8 nested; // inside a container
+  char name[SPUMAP_NAME_LEN];
+  const struct sfx_bank *bank; // where its samples are, NULL if it has none or is a single one
+} spumap_region_t;
+
+typedef struct spumap_sample {
+  u32 addr;
+  u32 len; // up to the next sample in the bank, or the end of the region
+  u32 id;  // index in the bank
+} spumap_sample_t;
+
+typedef struct spumap_stats {
+  u32 used;  // bytes from SPU_RAM_START on in some region that isn't nested, containers count as used
+  u32 free;  // the rest up to SPU_RAM_SIZE
+  u32 num_gaps;
+  u32 largest_gap;
+  u32 fragmentation; // percent of the free bytes that aren't in the largest gap
+  u32 ptr;   // spuram_ptr
+  u32 num_regions;
+  u32 overlaps; // regions that aren't nested but overlap another one; should always be 0
+} spumap_stats_t;
+
+// `name` can be a CD path, it's cut down to the file name
+void spumap_add(const u8 kind, const u32 addr, const u32 len, const char *name, const struct sfx_bank *bank);
+void spumap_remove(const u8 kind, const u32 addr);
+void spumap_remove_bank(const struct sfx_bank *bank);
+// every region sorted by address, containers before what's in them; valid until the next add or remove
+const spumap_region_t *spumap_get_regions(u32 *count);
+// the samples of a region with a bank, sorted by address; returns how many there are, fills in up to `max`
+u32 spumap_get_samples(const spumap_region_t *region, spumap_sample_t *out, const u32 max);
+void spumap_get_stats(spumap_stats_t *stats);
+const char *spumap_kind_name(const u8 kind);
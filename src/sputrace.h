@@ -0,0 +1,29 @@
+#pragma once
+
+#include "types.h"
+
+// SPU register write traces: spu.c records every write as (tick, register, value) when SPU_TRACE is on.
+// the host build streams them to a file, the player keeps the last SPU_TRACE_RING_LEN in a ring in RAM
+// that starts with the same header, so it can be cut out of a RAM dump; tools/sputrace reads both
+
+#define SPU_TRACE_MAGIC 0x52545053 // 'SPTR'
+#define SPU_TRACE_VERSION 1
+
+// ~256 ticks of a busy song, 32KB
+#define SPU_TRACE_RING_LEN 4096
+
+typedef struct spu_trace_header {
+  u32 magic;
+  u16 version;
+  u16 rec_size; // sizeof(spu_trace_rec_t)
+  u32 num_recs; // in the file, or in the ring so far (up to ring_len)
+  u32 ring_len; // 0 in a file, where the records are in order
+  u32 head;     // in a ring, where the next record goes; the oldest one once it's full
+  u32 pad;
+} spu_trace_header_t;
+
+typedef struct spu_trace_rec {
+  u32 tick; // 0 is everything before the first spu_trace_tick()
+  u16 reg;  // offset from 0x1F801C00
+  u16 val;
+} spu_trace_rec_t;
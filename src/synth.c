@@ -0,0 +1,127 @@
+#include "types.h"
+#include "synth.h"
+
+#define NUM_FILTERS 5
+
+#define FLAG_LOOP_END 1
+#define FLAG_LOOP_REPEAT 2
+#define FLAG_LOOP_START 4
+
+const synth_oct_t synth_oct[SYNTH_NUM_OCTS] = {
+  { 256,   1,  4 }, // 0 Oct
+  { 256,   2,  8 }, // 1 Oct
+  { 128,   4, 12 }, // 2 Oct
+  { 128,   8, 16 }, // 3 Oct
+  {  64,  16, 20 }, // 4 Oct
+  {  32,  32, 24 }, // 5 Oct
+  {  16,  64, 28 }, // 6 Oct
+  {   8, 128, 32 }, // 7 Oct
+};
+
+static const s32 filter_k1[NUM_FILTERS] = { 0, 60, 115, 98, 122 };
+static const s32 filter_k2[NUM_FILTERS] = { 0, 0, -52, -55, -60 };
+
+u32 synth_loop_len(const int oct) {
+  const u32 step = synth_oct[oct].wave_size;
+  u32 x = step;
+  while (x % SYNTH_BLOCK_LEN)
+    x += step;
+  return x;
+}
+
+// this is basically MakeSoundObject8 from Organya.cpp, except the waveform can be resampled
+// to fit a whole number of periods into a loop of any length
+void synth_build_sample(s16 *out, const s8 *wave, const int oct, const u32 len, const u32 periods) {
+  const u32 wave_size = synth_oct[oct].wave_size;
+  const u32 wave_step = SYNTH_WAVEFORM_LEN / wave_size;
+  for (u32 i = 0; i < len; ++i) {
+    // position in the wave_size-point waveform in 1/len steps;
+    // this is always on a point when the sample is not stretched
+    const u32 pos = i * periods * wave_size;
+    const u32 wav_tp = (pos / len) % wave_size;
+    const s32 frac = pos % len;
+    const s32 a = wave[wav_tp * wave_step];
+    const s32 b = wave[((wav_tp + 1) % wave_size) * wave_step];
+    out[i] = (s16)(a * 256 + (b - a) * 256 * frac / (s32)len);
+  }
+}
+
+static inline s32 predict(const int filter, const s32 prev1, const s32 prev2) {
+  return (filter_k1[filter] * prev1 + filter_k2[filter] * prev2 + 32) >> 6;
+}
+
+static void encode_block(u8 *out, const s16 *pcm, const u32 count, s32 *prev1, s32 *prev2) {
+  s16 block[SYNTH_BLOCK_LEN];
+  for (u32 i = 0; i < SYNTH_BLOCK_LEN; ++i)
+    block[i] = (i < count) ? pcm[i] : 0;
+
+  // pick the filter that predicts the source best, ignoring quantization
+  int filter = 0;
+  s32 res_min = 0, res_max = 0;
+  s32 best_range = 0x7FFFFFFF;
+  for (int f = 0; f < NUM_FILTERS; ++f) {
+    s32 p1 = *prev1, p2 = *prev2;
+    s32 f_min = 0, f_max = 0;
+    for (u32 i = 0; i < SYNTH_BLOCK_LEN; ++i) {
+      const s32 res = block[i] - predict(f, p1, p2);
+      if (res < f_min) f_min = res;
+      if (res > f_max) f_max = res;
+      p2 = p1;
+      p1 = block[i];
+    }
+    if (f_max - f_min < best_range) {
+      best_range = f_max - f_min;
+      res_min = f_min;
+      res_max = f_max;
+      filter = f;
+    }
+  }
+
+  // smallest shift that fits the residual into a nibble
+  int right_shift = 0;
+  while (right_shift < 12 && (res_max >> right_shift) > 7) ++right_shift;
+  while (right_shift < 12 && (res_min >> right_shift) < -8) ++right_shift;
+  const int shift = 12 - right_shift;
+
+  out[0] = shift | (filter << 4);
+  out[1] = 0;
+
+  // encode with the decoded samples as history, like the SPU will see them
+  s32 p1 = *prev1, p2 = *prev2;
+  for (u32 i = 0; i < SYNTH_BLOCK_LEN; ++i) {
+    const s32 pred = predict(filter, p1, p2);
+    s32 enc = (((block[i] - pred) << shift) + (1 << 11)) >> 12;
+    if (enc < -8) enc = -8;
+    if (enc > +7) enc = +7;
+    s32 dec = ((s32)(s16)(enc << 12) >> shift) + pred;
+    if (dec > +0x7FFF) dec = +0x7FFF;
+    if (dec < -0x8000) dec = -0x8000;
+    p2 = p1;
+    p1 = dec;
+    if (i & 1)
+      out[2 + (i >> 1)] |= (enc & 0xF) << 4;
+    else
+      out[2 + (i >> 1)] = enc & 0xF;
+  }
+
+  *prev1 = p1;
+  *prev2 = p2;
+}
+
+u32 synth_encode_adpcm(u8 *out, const s16 *pcm, const u32 len, const int loop) {
+  s32 prev1 = 0, prev2 = 0;
+  u32 size = 0;
+
+  for (u32 i = 0; i < len; i += SYNTH_BLOCK_LEN, size += SYNTH_BLOCK_SIZE)
+    encode_block(out + size, pcm + i, len - i, &prev1, &prev2);
+
+  // same flags as psx_audio_spu_encode_simple() with the loop starting at 0 if `loop` is set
+  if (size >= 2 * SYNTH_BLOCK_SIZE) {
+    out[1] = FLAG_LOOP_START;
+    out[size - SYNTH_BLOCK_SIZE + 1] = loop ? (FLAG_LOOP_END | FLAG_LOOP_REPEAT) : FLAG_LOOP_END;
+  } else if (size) {
+    out[1] = FLAG_LOOP_START | FLAG_LOOP_END | (loop ? FLAG_LOOP_REPEAT : 0);
+  }
+
+  return size;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "types.h"
+
+// builds Organya instrument samples from the wavetable (wave.dat) and encodes them to SPU ADPCM
+// this is also compiled into the host tools, so it has to stay integer-only and deterministic
+
+#define SYNTH_NUM_WAVEFORMS 100
+#define SYNTH_WAVEFORM_LEN 256
+#define SYNTH_NUM_OCTS 8
+#define SYNTH_BLOCK_LEN 28  // samples per SPU ADPCM block
+#define SYNTH_BLOCK_SIZE 16 // bytes per SPU ADPCM block
+
+typedef struct {
+  s16 wave_size;
+  s16 oct_par;
+  s16 oct_size;
+} synth_oct_t;
+
+extern const synth_oct_t synth_oct[SYNTH_NUM_OCTS];
+
+// default sample length for an octave: lcm(wave_size, SYNTH_BLOCK_LEN)
+u32 synth_loop_len(const int oct);
+
+// renders `periods` periods of the octave's waveform into `len` samples
+void synth_build_sample(s16 *out, const s8 *wave, const int oct, const u32 len, const u32 periods);
+
+// encodes `len` samples, returns the size of the ADPCM data
+// this only picks the filter and shift once per block instead of trying them all, so it's
+// fast enough to run on the console, but the output is a bit worse than what libpsxav makes
+u32 synth_encode_adpcm(u8 *out, const s16 *pcm, const u32 len, const int loop);
+
+static inline u32 synth_adpcm_size(const u32 len) {
+  return (len + SYNTH_BLOCK_LEN - 1) / SYNTH_BLOCK_LEN * SYNTH_BLOCK_SIZE;
+}
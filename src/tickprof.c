@@ -0,0 +1,101 @@
+#include <string.h>
+
+#include "types.h"
+#include "util.h"
+#include "tickprof.h"
+
+#if TICK_PROFILE
+
+// root counter 1 runs the sequencer: it counts hblanks up to the tick length and starts over;
+// bit 11 of its mode is set when it reaches that and cleared when the mode is read
+#define RCNT1_MODE (*(volatile u32 *)0x1F801114)
+#define RCNT1_MODE_TARGET_REACHED (1 << 11)
+
+static volatile int active;
+static u16 tick_start;
+static u16 flush_start;
+static u32 flush_cycles; // in the tick going on
+
+// all in root counter 2 cycles, get_stats() makes them us
+static u32 num_ticks;
+static u32 min_cycles;
+static u32 max_cycles;
+static u32 sum_cycles;
+static u32 flush_max_cycles;
+static u32 flush_sum_cycles;
+static u32 overruns;
+static u32 last_overrun;
+static u16 hist[TICKPROF_BUCKETS];
+
+void tickprof_reset(void) {
+  rcnt2_start();
+  active = 0;
+  num_ticks = 0;
+  min_cycles = 0xFFFFFFFF;
+  max_cycles = 0;
+  sum_cycles = 0;
+  flush_max_cycles = 0;
+  flush_sum_cycles = 0;
+  overruns = 0;
+  last_overrun = 0;
+  memset(hist, 0, sizeof(hist));
+}
+
+void tickprof_begin(void) {
+  // clear the flag from the target that started this tick
+  (void)RCNT1_MODE;
+  flush_cycles = 0;
+  active = 1;
+  tick_start = rcnt2_read();
+}
+
+void tickprof_end(void) {
+  const u32 cycles = (u16)(rcnt2_read() - tick_start);
+  // if root counter 1 reached its target again, the next tick was due before this one was done
+  const int overrun = (RCNT1_MODE & RCNT1_MODE_TARGET_REACHED) != 0;
+  active = 0;
+
+  ++num_ticks;
+  if (cycles < min_cycles) min_cycles = cycles;
+  if (cycles > max_cycles) max_cycles = cycles;
+  sum_cycles += cycles;
+  if (flush_cycles > flush_max_cycles) flush_max_cycles = flush_cycles;
+  flush_sum_cycles += flush_cycles;
+  if (overrun) {
+    ++overruns;
+    last_overrun = num_ticks;
+  }
+
+  u32 bucket = cycles >> TICKPROF_BUCKET_SHIFT;
+  if (bucket >= TICKPROF_BUCKETS) bucket = TICKPROF_BUCKETS - 1;
+  if (hist[bucket] < 0xFFFF) ++hist[bucket];
+}
+
+void tickprof_flush_begin(void) {
+  if (active)
+    flush_start = rcnt2_read();
+}
+
+void tickprof_flush_end(void) {
+  if (active)
+    flush_cycles += (u16)(rcnt2_read() - flush_start);
+}
+
+static inline u32 cycles_to_us(const u32 cycles) {
+  return cycles * 1000 / (RCNT2_HZ / 1000);
+}
+
+void tickprof_get_stats(tickprof_stats_t *stats) {
+  const u32 n = num_ticks ? num_ticks : 1;
+  stats->ticks = num_ticks;
+  stats->min_us = num_ticks ? cycles_to_us(min_cycles) : 0;
+  stats->avg_us = cycles_to_us(sum_cycles / n);
+  stats->max_us = cycles_to_us(max_cycles);
+  stats->flush_avg_us = cycles_to_us(flush_sum_cycles / n);
+  stats->flush_max_us = cycles_to_us(flush_max_cycles);
+  stats->overruns = overruns;
+  stats->last_overrun = last_overrun;
+  memcpy(stats->hist, hist, sizeof(hist));
+}
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "types.h"
+
+// times the timer IRQ that runs the sequencer with root counter 2, and how much of that is
+// spu_flush_voices(); with TICK_PROFILE 0 every call here is an empty macro and nothing is linked in.
+// the host tools have no root counters, so it's always off there.
+// root counter 2 wraps after about 15.5 ms, so ticks longer than that alias to shorter ones;
+// they still count as overruns, which root counter 1 catches
+#ifndef TICK_PROFILE
+#ifdef HOST_BUILD
+#define TICK_PROFILE 0
+#else
+#define TICK_PROFILE 1
+#endif
+#endif
+
+// ticks are sorted into this many buckets of (1 << TICKPROF_BUCKET_SHIFT) root counter 2 cycles,
+// about 60 us each; the last one gets everything longer
+#define TICKPROF_BUCKETS 16
+#define TICKPROF_BUCKET_SHIFT 8
+
+typedef struct tickprof_stats {
+  u32 ticks;
+  u32 min_us;
+  u32 avg_us;
+  u32 max_us;
+  u32 flush_avg_us; // of the ticks above, in spu_flush_voices()
+  u32 flush_max_us;
+  u32 overruns;     // ticks that weren't done when the next one was due
+  u32 last_overrun; // number of the last tick that overran
+  u16 hist[TICKPROF_BUCKETS];
+} tickprof_stats_t;
+
+#if TICK_PROFILE
+
+// starts over, e.g. for a new song
+void tickprof_reset(void);
+// around everything the timer IRQ does
+void tickprof_begin(void);
+void tickprof_end(void);
+// around spu_flush_voices(), only counts while a tick is being timed
+void tickprof_flush_begin(void);
+void tickprof_flush_end(void);
+void tickprof_get_stats(tickprof_stats_t *stats);
+
+#else
+
+#define tickprof_reset() ((void)0)
+#define tickprof_begin() ((void)0)
+#define tickprof_end() ((void)0)
+#define tickprof_flush_begin() ((void)0)
+#define tickprof_flush_end() ((void)0)
+#define tickprof_get_stats(stats) ((void)(stats))
+
+#endif
@@ -6,9 +6,11 @@
 #include <string.h>
 
 #include "cd.h"
-#include "spu.h"
 #include "util.h"
 
+#define RCNT2_VALUE (*(volatile u32 *)0x1F801120)
+#define RCNT2_MODE  (*(volatile u32 *)0x1F801124)
+
 static char errmsg[512];
 
 static void __attribute__((noreturn)) fatal(void) {
@@ -47,51 +49,23 @@ void panic(const char *fmt, ...) {
   fatal();
 }
 
-struct sfx_bank *load_sfx_bank(const char *fname) {
+void *load_file(const char *fname, u32 *out_size) {
   cd_file_t *f = cd_fopen(fname, 0);
-  if (!f) panic("could not open bank file '%s'", fname);
-
-  printf("loading bank '%s' at addr %u\n", fname, spuram_ptr);
-
-  const u32 buflen = cd_fread_u32le(f);
-  const u32 num_sfx = cd_fread_u32le(f);
-
-  struct sfx_bank *bank = malloc(sizeof(*bank) + sizeof(u32) * num_sfx);
-  ASSERT(bank);
-  bank->data_len = buflen;
-  bank->num_sfx = num_sfx;
-  cd_freadordie(&bank->sfx_addr[0], sizeof(u32) * num_sfx, 1, f);
-
-  u8 *buf = malloc(buflen);
+  if (!f) return NULL;
+  const u32 size = cd_fsize(f);
+  void *buf = malloc(size);
   ASSERT(buf);
-  cd_freadordie(buf, buflen, 1, f);
-
+  cd_freadordie(buf, size, 1, f);
   cd_fclose(f);
+  if (out_size) *out_size = size;
+  return buf;
+}
 
-  ASSERT(spuram_ptr == bank->sfx_addr[0] || spuram_ptr == bank->sfx_addr[1]);
-
-  SpuSetTransferMode(SPU_TRANSFER_BY_DMA);
-  spu_set_transfer_addr(spuram_ptr);
-  SpuWrite((void *)buf, buflen);
-  spu_wait_for_transfer();
-
-  spuram_ptr += buflen;
-
-  printf("bank '%s': read %u bytes of sample data (%u samples), spuram_ptr=%u\n", fname, buflen, num_sfx, spuram_ptr);
-  printf("bank ident: %02x %02x %02x %02x\n", buf[0], buf[1], buf[2], buf[3]);
-  /*
-  for (u32 i = 0; i < bank->num_sfx; ++i)
-    printf("* (%03d) 0x%06x\n", i, bank->sfx_addr[i]);
-  */
-
-  free(buf);
-
-  return bank;
+void rcnt2_start(void) {
+  // sysclock / 8, free-running: no IRQ and no reset at the target
+  RCNT2_MODE = 0x0200;
 }
 
-int free_sfx_bank(struct sfx_bank *bank) {
-  const u32 prevaddr = spuram_ptr - bank->data_len;
-  if (prevaddr == bank->sfx_addr[0] || prevaddr == bank->sfx_addr[1])
-    spuram_ptr = prevaddr; // free SPU RAM if this is the last loaded bank
-  free(bank);
+u16 rcnt2_read(void) {
+  return RCNT2_VALUE;
 }
@@ -3,16 +3,33 @@
 #include "types.h"
 
 #define ALIGN(x, align) (((x) + ((align) - 1)) & ~((align) - 1))
-#define ASSERT(x) do_assert((int)(x), #x, __FILE__, __LINE__)
+#define ASSERT(x) do_assert(!!(x), #x, __FILE__, __LINE__)
 
 void panic(const char *fmt, ...) __attribute__((noreturn));
 void do_assert(const int, const char *, const char *, const int);
 
+#define SFX_PITCH_ONE 0x1000 // 1.0 in 4.12 fixed point
+
 struct sfx_bank {
   u32 data_len;
   u32 num_sfx;
+  u16 *sfx_pitch; // [num_sfx] pitch multipliers, NULL if the bank has none
   u32 sfx_addr[]; // [num_sfx];
 };
 
+void *load_file(const char *fname, u32 *out_size);
+// reads a bank and its sample data into main RAM without uploading it; sfx_addr[] is where it was built for
+struct sfx_bank *read_sfx_bank(const char *fname, u8 **data);
+// loads a bank to spuram_ptr and moves that past it
 struct sfx_bank *load_sfx_bank(const char *fname);
+// loads a bank to a fixed place in SPU RAM, NULL if its data is longer than max_len
+struct sfx_bank *load_sfx_bank_at(const char *fname, const u32 addr, const u32 max_len);
+// gives back the bank's SPU RAM if it's the last one load_sfx_bank() loaded
 int free_sfx_bank(struct sfx_bank *bank);
+// just frees the bank's tables, for ones from load_sfx_bank_at()
+void free_sfx_bank_tables(struct sfx_bank *bank);
+
+// root counter 2, free-running at the system clock / 8; wraps every ~15 ms, so only good for short intervals
+#define RCNT2_HZ (33868800 / 8)
+void rcnt2_start(void);
+u16 rcnt2_read(void);
@@ -5,6 +5,4 @@ if [[ $# -eq 0 ]] ; then
     exit 0
 fi
 
-for fn in `ls "$1"`; do
-  ./orgconv "$1/$fn" "$2" "$3/${fn%%.*}.bnk" $4
-done
+./orgconv -b "$1" "$2" "$3" $4
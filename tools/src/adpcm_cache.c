@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "adpcm_cache.h"
+
+#define CACHE_MAGIC 0x41435350 // 'PSCA'
+
+#pragma pack(push, 1)
+
+struct cache_hdr {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t len; // length of the ADPCM data following the header
+};
+
+#pragma pack(pop)
+
+static char cache_dir[2048];
+static int cache_hits, cache_misses, cache_stores;
+static int tmp_counter;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+  const uint8_t *p = data;
+  while (size--) {
+    hash ^= *p++;
+    hash *= 0x100000001B3ull;
+  }
+  return hash;
+}
+
+static void entry_path(char *out, const size_t size, const uint64_t key) {
+  snprintf(out, size, "%s/%016llx.adp", cache_dir, (unsigned long long)key);
+}
+
+bool adpcm_cache_init(const char *dir) {
+  struct stat st;
+#ifdef _WIN32
+  mkdir(dir);
+#else
+  mkdir(dir, 0777);
+#endif
+  if (stat(dir, &st) || !S_ISDIR(st.st_mode)) {
+    fprintf(stderr, "error: could not create cache directory '%s'\n", dir);
+    return false;
+  }
+  snprintf(cache_dir, sizeof(cache_dir), "%s", dir);
+  return true;
+}
+
+uint64_t adpcm_cache_key_begin(const uint32_t len, const int loop_start, const int encoder, const int effort) {
+  const int32_t params[4] = { ADPCM_CACHE_VERSION, encoder, loop_start, effort };
+  uint64_t hash = 0xCBF29CE484222325ull;
+  hash = fnv1a(hash, params, sizeof(params));
+  return fnv1a(hash, &len, sizeof(len));
+}
+
+uint64_t adpcm_cache_key_update(const uint64_t key, const int16_t *pcm, const uint32_t len) {
+  return fnv1a(key, pcm, len * sizeof(*pcm));
+}
+
+uint64_t adpcm_cache_key(const int16_t *pcm, const uint32_t len, const int loop_start, const int encoder, const int effort) {
+  return adpcm_cache_key_update(adpcm_cache_key_begin(len, loop_start, encoder, effort), pcm, len);
+}
+
+int adpcm_cache_load(const uint64_t key, uint8_t *out, const int max_len) {
+  if (!cache_dir[0])
+    return -1;
+
+  char path[4096];
+  entry_path(path, sizeof(path), key);
+
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    __atomic_add_fetch(&cache_misses, 1, __ATOMIC_RELAXED);
+    return -1;
+  }
+
+  // anything that doesn't look exactly right is treated as a miss and gets overwritten
+  struct cache_hdr hdr;
+  int len = -1;
+  if (fread(&hdr, sizeof(hdr), 1, f) == 1 && hdr.magic == CACHE_MAGIC && hdr.version == ADPCM_CACHE_VERSION &&
+      hdr.key == key && hdr.len > 0 && (int)hdr.len <= max_len && fread(out, hdr.len, 1, f) == 1 && fgetc(f) == EOF)
+    len = hdr.len;
+  fclose(f);
+
+  __atomic_add_fetch(len < 0 ? &cache_misses : &cache_hits, 1, __ATOMIC_RELAXED);
+  return len;
+}
+
+void adpcm_cache_store(const uint64_t key, const uint8_t *adpcm, const int len) {
+  if (!cache_dir[0] || len <= 0)
+    return;
+
+  char path[4096];
+  char tmp_path[4096 + 64];
+  entry_path(path, sizeof(path), key);
+  snprintf(tmp_path, sizeof(tmp_path), "%s.%d.%d.tmp", path, (int)getpid(), __atomic_add_fetch(&tmp_counter, 1, __ATOMIC_RELAXED));
+
+  FILE *f = fopen(tmp_path, "wb");
+  if (!f) {
+    fprintf(stderr, "warning: could not write cache entry '%s'\n", tmp_path);
+    return;
+  }
+
+  const struct cache_hdr hdr = { CACHE_MAGIC, ADPCM_CACHE_VERSION, key, len };
+  const bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 && fwrite(adpcm, len, 1, f) == 1;
+  if (fclose(f) || !ok) {
+    fprintf(stderr, "warning: could not write cache entry '%s'\n", tmp_path);
+    remove(tmp_path);
+    return;
+  }
+
+  // if this fails someone else has just stored the same thing
+  if (rename(tmp_path, path))
+    remove(tmp_path);
+  else
+    __atomic_add_fetch(&cache_stores, 1, __ATOMIC_RELAXED);
+}
+
+void adpcm_cache_print_stats(void) {
+  if (cache_dir[0])
+    printf("adpcm cache: %d hits, %d misses, %d new entries in '%s'\n", cache_hits, cache_misses, cache_stores, cache_dir);
+}
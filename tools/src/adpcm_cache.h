@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// persistent content-addressed cache of encoded SPU ADPCM samples, shared by orgconv and sfxconv
+
+// bump this whenever an encoder's output changes, which invalidates all existing entries
+#define ADPCM_CACHE_VERSION 2
+
+// encoders that can produce cached data, part of the key
+enum adpcm_encoder {
+  ADPCM_ENC_PSXAV, // psx_audio_spu_encode_simple()
+  ADPCM_ENC_SYNTH, // synth_encode_adpcm()
+};
+
+// enables the cache in `dir`, creating it if needed; without this every lookup misses
+bool adpcm_cache_init(const char *dir);
+
+// hash of everything that determines the encoded output
+uint64_t adpcm_cache_key(const int16_t *pcm, const uint32_t len, const int loop_start, const int encoder, const int effort);
+
+// same key for input that comes in chunks: begin with the total length, then update with every chunk in order
+uint64_t adpcm_cache_key_begin(const uint32_t len, const int loop_start, const int encoder, const int effort);
+uint64_t adpcm_cache_key_update(const uint64_t key, const int16_t *pcm, const uint32_t len);
+
+// copies the cached data for `key` into `out` and returns its length, or -1 if it's not cached
+int adpcm_cache_load(const uint64_t key, uint8_t *out, const int max_len);
+
+// saves encoded data for `key`; the entry appears atomically, so concurrent writers are fine
+void adpcm_cache_store(const uint64_t key, const uint8_t *adpcm, const int len);
+
+void adpcm_cache_print_stats(void);
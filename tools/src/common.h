@@ -1,6 +1,12 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "libpsxav/libpsxav.h"
 
 #define NUM_INST 100
 #define INST_LEN 256
@@ -13,6 +19,8 @@
 
 #define ALIGN(x, align) (((x) + ((align) - 1)) & ~((align) - 1))
 
+#define PITCH_ONE 0x1000 // 1.0 in 4.12 fixed point, same format as the SPU pitch register
+
 #pragma pack(push, 1)
 
 struct bank_hdr {
@@ -20,6 +28,7 @@ struct bank_hdr {
   uint32_t num_sfx;     // number of samples in bank, including #0 (dummy) and all the unused samples
   uint32_t sfx_addr[1]; // address in SPU RAM of each sample, first one is always 0, others may be 0 (means it's unused)
   // after the last sfx_addr, raw SPU data follows
+  // after the SPU data, an optional uint16_t pitch multiplier (4.12) for every sample may follow
 };
 
 struct sfx {
@@ -27,6 +36,55 @@ struct sfx {
   uint32_t len; // in samples
   uint32_t freq;
   uint32_t addr;
+  uint8_t *adpcm; // encoded data before it's packed into SPU RAM
+  int adpcm_len;
+  double enc_time; // time spent encoding, in ms
+  double signal;   // energy of the input, for SNR
+  double noise;    // energy of the encoding error
 };
 
 #pragma pack(pop)
+
+static inline double time_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+#define MAX_SNR 999.0 // reported for lossless encodes
+
+static inline double snr_db(const double signal, const double noise) {
+  if (noise <= 0.0)
+    return MAX_SNR;
+  const double snr = 10.0 * log10(signal / noise);
+  return (snr > MAX_SNR) ? MAX_SNR : snr;
+}
+
+// decodes adpcm and adds the energy of pcm and of the difference to *signal and *noise
+static inline void measure_adpcm_error(const int16_t *pcm, const uint32_t len, const uint8_t *adpcm, const int adpcm_len, double *signal, double *noise) {
+  int16_t *dec = malloc((adpcm_len / 16) * 28 * sizeof(int16_t));
+  const uint32_t dec_len = psx_audio_spu_decode_simple(adpcm, adpcm_len, dec);
+  for (uint32_t i = 0; i < len && i < dec_len; ++i) {
+    const double err = dec[i] - pcm[i];
+    *signal += (double)pcm[i] * pcm[i];
+    *noise += err * err;
+  }
+  free(dec);
+}
+
+static inline bool parse_effort(const char *str, psx_audio_effort_t *out) {
+  if (!strcmp(str, "fast"))
+    *out = PSX_AUDIO_EFFORT_FAST;
+  else if (!strcmp(str, "default"))
+    *out = PSX_AUDIO_EFFORT_DEFAULT;
+  else if (!strcmp(str, "max"))
+    *out = PSX_AUDIO_EFFORT_MAX;
+  else
+    return false;
+  return true;
+}
+
+static inline const char *effort_name(const psx_audio_effort_t effort) {
+  static const char *names[] = { "fast", "default", "max" };
+  return names[effort];
+}
@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "types.h"
+#include "cd.h"
+#include "util.h"
+#include "spu.h"
+#include "host.h"
+#include "../spuemu.h"
+
+struct cd_file_s {
+  FILE *fp;
+  s32 size;
+};
+
+static char data_root[1024] = ".";
+static u32 transfer_addr = SPU_RAM_START;
+static host_write_hook_t write_hook;
+
+void host_init(const char *data_dir) {
+  snprintf(data_root, sizeof(data_root), "%s", data_dir);
+}
+
+// \BNK\SFX.BNK;1 -> <data_dir>/bnk/sfx.bnk
+static void cd_to_host_path(const char *fname, char *out, const size_t outlen) {
+  size_t n = snprintf(out, outlen, "%s/", data_root);
+  for (const char *p = fname; *p && *p != ';' && n + 1 < outlen; ++p) {
+    if (*p == '\\' && p == fname)
+      continue;
+    out[n++] = (*p == '\\') ? '/' : tolower(*p);
+  }
+  out[n] = '\0';
+}
+
+void cd_init(void) { }
+
+cd_file_t *cd_fopen(const char *fname, const int reopen) {
+  char path[2048];
+  cd_to_host_path(fname, path, sizeof(path));
+  FILE *fp = fopen(path, "rb");
+  if (!fp) {
+    printf("cd_fopen(%s): file not found\n", fname);
+    return NULL;
+  }
+  cd_file_t *f = calloc(1, sizeof(*f));
+  f->fp = fp;
+  fseek(fp, 0, SEEK_END);
+  f->size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  return f;
+}
+
+int cd_fexists(const char *fname) {
+  char path[2048];
+  cd_to_host_path(fname, path, sizeof(path));
+  FILE *fp = fopen(path, "rb");
+  if (!fp) return 0;
+  fclose(fp);
+  return 1;
+}
+
+void cd_fclose(cd_file_t *f) {
+  if (!f) return;
+  fclose(f->fp);
+  free(f);
+}
+
+s32 cd_fread(void *ptr, s32 size, s32 num, cd_file_t *f) {
+  if (!f || !ptr) return -1;
+  return fread(ptr, 1, size * num, f->fp);
+}
+
+void cd_freadordie(void *ptr, s32 size, s32 num, cd_file_t *f) {
+  if (cd_fread(ptr, size, num, f) < size * num)
+    panic("cd_freadordie(%d, %d): unexpected end of file", size, num);
+}
+
+s32 cd_fseek(cd_file_t *f, s32 ofs, int whence) {
+  if (!f) return -1;
+  return fseek(f->fp, ofs, whence);
+}
+
+s32 cd_ftell(cd_file_t *f) {
+  return f ? ftell(f->fp) : -1;
+}
+
+s32 cd_fsize(cd_file_t *f) {
+  return f ? f->size : -1;
+}
+
+int cd_feof(cd_file_t *f) {
+  return f ? (ftell(f->fp) >= f->size) : -1;
+}
+
+u8 cd_fread_u8(cd_file_t *f) {
+  u8 res = 0;
+  cd_freadordie(&res, 1, 1, f);
+  return res;
+}
+
+u16 cd_fread_u16le(cd_file_t *f) {
+  u16 res = 0;
+  cd_freadordie(&res, 2, 1, f);
+  return res;
+}
+
+u32 cd_fread_u32le(cd_file_t *f) {
+  u32 res = 0;
+  cd_freadordie(&res, 4, 1, f);
+  return res;
+}
+
+void do_assert(const int expr, const char *strexpr, const char *file, const int line) {
+  if (!expr) {
+    fprintf(stderr, "error: assertion failed: `%s` at %s:%d\n", strexpr, file, line);
+    exit(-3);
+  }
+}
+
+void panic(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "error: ");
+  vfprintf(stderr, fmt, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+  exit(-3);
+}
+
+void *load_file(const char *fname, u32 *out_size) {
+  cd_file_t *f = cd_fopen(fname, 0);
+  if (!f) return NULL;
+  const u32 size = cd_fsize(f);
+  void *buf = malloc(size);
+  ASSERT(buf);
+  cd_freadordie(buf, size, 1, f);
+  cd_fclose(f);
+  if (out_size) *out_size = size;
+  return buf;
+}
+
+// PSn00bSDK and spu_a.s
+
+void SpuInit(void) {
+  spuemu_reset();
+}
+
+void SpuWait(void) { }
+
+void SpuSetTransferMode(int mode) { }
+
+unsigned int SpuWrite(void *data, unsigned int size) {
+  spuemu_write_ram(transfer_addr, data, size);
+  return size;
+}
+
+u32 spu_set_transfer_addr(const u32 addr) {
+  if (addr < 0x1000 || addr > 0x7FFFF)
+    return 0;
+  transfer_addr = addr;
+  return addr;
+}
+
+// spu.c register access
+
+void host_set_write_hook(host_write_hook_t hook) {
+  write_hook = hook;
+}
+
+void spu_host_write(const u32 reg, const u16 val) {
+  if (write_hook)
+    write_hook(reg, val);
+  spuemu_write(reg, val);
+}
+
+u16 spu_host_read(const u32 reg) {
+  return spuemu_read(reg);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "types.h"
+
+// runs the player's sequencer and SPU code (../src/org.c, ../src/spu.c) on the host:
+// CD paths are looked up in a data directory and SPU writes go to the emulator in spuemu.c
+
+// sets the directory \BNK\SFX.BNK;1 and such are looked up in (as data/bnk/sfx.bnk)
+void host_init(const char *data_dir);
+
+// called with every SPU register write before it reaches the emulator, NULL to remove
+typedef void (*host_write_hook_t)(const u32 reg, const u16 val);
+void host_set_write_hook(host_write_hook_t hook);
@@ -0,0 +1,13 @@
+#pragma once
+
+// just enough of PSn00bSDK's psxspu.h for the player's SPU code to build on the host, see host.c
+
+#define SPU_VOICECH(x) (1 << (x))
+
+#define SPU_TRANSFER_BY_DMA 0
+#define SPU_TRANSFER_BY_IO  1
+
+void SpuInit(void);
+void SpuWait(void);
+void SpuSetTransferMode(int mode);
+unsigned int SpuWrite(void *data, unsigned int size);
@@ -24,15 +24,15 @@ freely, subject to the following restrictions:
 #include <assert.h>
 #include <string.h>
 #include "libpsxav.h"
+#include "adpcm_simd.h"
 
-#define ADPCM_FILTER_COUNT 5
 #define XA_ADPCM_FILTER_COUNT 4
 #define SPU_ADPCM_FILTER_COUNT 5
 
 static const int16_t filter_k1[ADPCM_FILTER_COUNT] = {0, 60, 115, 98, 122};
 static const int16_t filter_k2[ADPCM_FILTER_COUNT] = {0, 0, -52, -55, -60};
 
-static int find_min_shift(const psx_audio_encoder_channel_state_t *state, int16_t *samples, int pitch, int filter) {
+static int find_min_shift(const psx_audio_encoder_channel_state_t *state, int16_t *samples, int sample_limit, int pitch, int filter) {
 	// Assumption made:
 	//
 	// There is value in shifting right one step further to allow the nibbles to clip.
@@ -51,7 +51,7 @@ static int find_min_shift(const psx_audio_encoder_channel_state_t *state, int16_
 	int32_t s_min = 0;
 	int32_t s_max = 0;
 	for (int i = 0; i < 28; i++) {
-		int32_t raw_sample = samples[i * pitch];
+		int32_t raw_sample = (i * pitch) >= sample_limit ? 0 : samples[i * pitch];
 		int32_t previous_values = (k1*prev1 + k2*prev2 + (1<<5))>>6;
 		int32_t sample = raw_sample - previous_values;
 		if (sample < s_min) { s_min = sample; }
@@ -114,35 +114,174 @@ static uint8_t attempt_to_encode_nibbles(psx_audio_encoder_channel_state_t *outs
 	return hdr;
 }
 
-static uint8_t encode_nibbles(psx_audio_encoder_channel_state_t *state, int16_t *samples, int sample_limit, int pitch, uint8_t *data, int data_shift, int data_pitch, int filter_count) {
-    psx_audio_encoder_channel_state_t proposed;
+static psx_audio_simd_t simd_level = PSX_AUDIO_SIMD_NONE;
+static evaluate_candidates_t evaluate_candidates = evaluate_candidates_scalar;
+
+psx_audio_simd_t psx_audio_set_simd(psx_audio_simd_t simd) {
+	psx_audio_simd_t supported = get_supported_simd();
+	if (simd == PSX_AUDIO_SIMD_AUTO || simd > supported) {
+		simd = supported;
+	}
+
+	simd_level = simd;
+	evaluate_candidates = get_candidate_kernel(simd);
+	return simd_level;
+}
+
+psx_audio_simd_t psx_audio_get_simd(void) {
+	return simd_level;
+}
+
+static psx_audio_effort_t effort_level = PSX_AUDIO_EFFORT_DEFAULT;
+
+void psx_audio_set_effort(psx_audio_effort_t effort) {
+	effort_level = effort;
+}
+
+psx_audio_effort_t psx_audio_get_effort(void) {
+	return effort_level;
+}
+
+#ifdef PSX_AUDIO_HAVE_X86_SIMD
+// pick the best supported level before anyone gets to spawn encoder threads
+__attribute__((constructor))
+static void psx_audio_simd_init(void) {
+	psx_audio_set_simd(PSX_AUDIO_SIMD_AUTO);
+}
+#endif
+
+static void build_candidates(candidate_list_t *list, const psx_audio_encoder_channel_state_t *state, int16_t *samples, int sample_limit, int pitch, int filter_count) {
+	list->count = 0;
+	for (int filter = 0; filter < filter_count; filter++) {
+		int min_shift = 0;
+		int max_shift = 12;
+
+		if (effort_level != PSX_AUDIO_EFFORT_MAX) {
+			int true_min_shift = find_min_shift(state, samples, sample_limit, pitch, filter);
+
+			// Testing has shown that the optimal shift can be off the true minimum shift
+			// by 1 in *either* direction.
+			// This is NOT the case when dither is used.
+			min_shift = true_min_shift - 1;
+			max_shift = true_min_shift + 1;
+			if (min_shift < 0) { min_shift = 0; }
+			if (max_shift > 12) { max_shift = 12; }
+		}
+
+		for (int sample_shift = min_shift; sample_shift <= max_shift; sample_shift++) {
+			list->k1[list->count] = filter_k1[filter];
+			list->k2[list->count] = filter_k2[filter];
+			list->filter[list->count] = filter;
+			list->shift[list->count] = sample_shift;
+			list->count++;
+		}
+	}
+
+	// the vector paths read whole registers, keep the unused lanes harmless
+	for (int c = list->count; c < CANDIDATE_SLOTS; c++) {
+		list->k1[c] = list->k2[c] = list->filter[c] = list->shift[c] = 0;
+	}
+}
+
+static void gather_block(int32_t *block, const psx_audio_encoder_channel_state_t *state, int16_t *samples, int sample_limit, int pitch) {
+	for (int i = 0; i < 28; i++) {
+		block[i] = ((i * pitch) >= sample_limit ? 0 : samples[i * pitch]) + state->qerr;
+	}
+}
+
+// Number of this block's best candidates that max effort re-checks against the following block.
+#define LOOKAHEAD_CANDIDATES 4
+
+// Picks the candidate whose error plus the best error it allows in the next block is lowest,
+// since the greedy choice can leave the predictor in a bad state for what comes after.
+static int lookahead(const candidate_list_t *list, const psx_audio_encoder_channel_state_t *state, int16_t *samples, int sample_limit, int pitch, int next_offset, int filter_count) {
+	int order[LOOKAHEAD_CANDIDATES];
+	int num_order = 0;
+	int best = -1;
+	uint64_t best_total = 0;
+
+	// the few lowest errors, earlier candidates first on ties like the greedy search
+	for (int c = 0; c < list->count; c++) {
+		int pos = num_order;
+		while (pos > 0 && list->mse[c] < list->mse[order[pos - 1]]) { pos--; }
+		if (pos >= LOOKAHEAD_CANDIDATES) { continue; }
+		if (num_order < LOOKAHEAD_CANDIDATES) { num_order++; }
+		memmove(order + pos + 1, order + pos, (num_order - pos - 1) * sizeof(int));
+		order[pos] = c;
+	}
+
+	for (int n = 0; n < num_order; n++) {
+		int c = order[n];
+		psx_audio_encoder_channel_state_t next_state;
+		candidate_list_t next;
+		int32_t block[28];
+		uint8_t scratch[28];
+
+		attempt_to_encode_nibbles(
+			&next_state, state,
+			samples, sample_limit, pitch,
+			scratch, 0, 1,
+			list->filter[c], list->shift[c]);
+
+		build_candidates(&next, &next_state, samples + next_offset, sample_limit - next_offset, pitch, filter_count);
+		gather_block(block, &next_state, samples + next_offset, sample_limit - next_offset, pitch);
+		evaluate_candidates(&next, &next_state, block);
+
+		uint64_t next_mse = next.mse[0];
+		for (int i = 1; i < next.count; i++) {
+			if (next.mse[i] < next_mse) { next_mse = next.mse[i]; }
+		}
+
+		uint64_t total = list->mse[c] + next_mse;
+		if (best < 0 || total < best_total) {
+			best = c;
+			best_total = total;
+		}
+	}
+
+	return best;
+}
+
+// next_offset is where the following block for the same channel starts in samples
+static uint8_t encode_nibbles(psx_audio_encoder_channel_state_t *state, int16_t *samples, int sample_limit, int pitch, int next_offset, uint8_t *data, int data_shift, int data_pitch, int filter_count) {
+	candidate_list_t list;
+	int32_t block[28];
 	int64_t best_mse = ((int64_t)1<<(int64_t)50);
 	int best_filter = 0;
 	int best_sample_shift = 0;
 
-	for (int filter = 0; filter < filter_count; filter++) {
-		int true_min_shift = find_min_shift(state, samples, pitch, filter);
+	if (effort_level == PSX_AUDIO_EFFORT_FAST) {
+		// trust the prediction: the filter that leaves the smallest residual, at its minimum shift
+		best_sample_shift = -1;
+		for (int filter = 0; filter < filter_count; filter++) {
+			int true_min_shift = find_min_shift(state, samples, sample_limit, pitch, filter);
+			if (true_min_shift > best_sample_shift) {
+				best_filter = filter;
+				best_sample_shift = true_min_shift;
+			}
+		}
 
-		// Testing has shown that the optimal shift can be off the true minimum shift
-		// by 1 in *either* direction.
-		// This is NOT the case when dither is used.
-		int min_shift = true_min_shift - 1;
-		int max_shift = true_min_shift + 1;
-		if (min_shift < 0) { min_shift = 0; }
-		if (max_shift > 12) { max_shift = 12; }
+		return attempt_to_encode_nibbles(
+			state, state,
+			samples, sample_limit, pitch,
+			data, data_shift, data_pitch,
+			best_filter, best_sample_shift);
+	}
 
-		for (int sample_shift = min_shift; sample_shift <= max_shift; sample_shift++) {
-			// ignore header here
-			attempt_to_encode_nibbles(
-				&proposed, state,
-				samples, sample_limit, pitch,
-				data, data_shift, data_pitch,
-				filter, sample_shift);
-
-			if (best_mse > proposed.mse) {
-				best_mse = proposed.mse;
-				best_filter = filter;
-				best_sample_shift = sample_shift;
+	build_candidates(&list, state, samples, sample_limit, pitch, filter_count);
+	gather_block(block, state, samples, sample_limit, pitch);
+	evaluate_candidates(&list, state, block);
+
+	if (effort_level == PSX_AUDIO_EFFORT_MAX && next_offset + 28 * pitch <= sample_limit) {
+		int best = lookahead(&list, state, samples, sample_limit, pitch, next_offset, filter_count);
+		best_filter = list.filter[best];
+		best_sample_shift = list.shift[best];
+	} else {
+		for (int c = 0; c < list.count; c++) {
+			if (best_mse > (int64_t)list.mse[c]) {
+				best_mse = list.mse[c];
+				best_filter = list.filter[c];
+				best_sample_shift = list.shift[c];
 			}
 		}
 	}
@@ -158,23 +297,23 @@ static uint8_t encode_nibbles(psx_audio_encoder_channel_state_t *state, int16_t
 static void encode_block_xa(int16_t *audio_samples, int audio_samples_limit, uint8_t *data, psx_audio_xa_settings_t settings, psx_audio_encoder_state_t *state) {
 	if (settings.bits_per_sample == 4) {
 		if (settings.stereo) {
-			data[0]  = encode_nibbles(&(state->left), audio_samples, audio_samples_limit,           2, data + 0x10, 0, 4, XA_ADPCM_FILTER_COUNT);
-			data[1]  = encode_nibbles(&(state->right), audio_samples + 1, audio_samples_limit - 1,        2, data + 0x10, 4, 4, XA_ADPCM_FILTER_COUNT);
-			data[2]  = encode_nibbles(&(state->left), audio_samples + 56, audio_samples_limit - 56,       2, data + 0x11, 0, 4, XA_ADPCM_FILTER_COUNT);
-			data[3]  = encode_nibbles(&(state->right), audio_samples + 56 + 1, audio_samples_limit - 56 - 1,  2, data + 0x11, 4, 4, XA_ADPCM_FILTER_COUNT);
-			data[8]  = encode_nibbles(&(state->left), audio_samples + 56*2, audio_samples_limit - 56*2,    2, data + 0x12, 0, 4, XA_ADPCM_FILTER_COUNT);
-			data[9]  = encode_nibbles(&(state->right), audio_samples + 56*2 + 1, audio_samples_limit - 56*2 - 1, 2, data + 0x12, 4, 4, XA_ADPCM_FILTER_COUNT);
-			data[10] = encode_nibbles(&(state->left), audio_samples + 56*3, audio_samples_limit - 56*3,     2, data + 0x13, 0, 4, XA_ADPCM_FILTER_COUNT);
-			data[11] = encode_nibbles(&(state->right), audio_samples + 56*3 + 1, audio_samples_limit - 56*3 - 1, 2, data + 0x13, 4, 4, XA_ADPCM_FILTER_COUNT);
+			data[0]  = encode_nibbles(&(state->left), audio_samples, audio_samples_limit,           2, 56, data + 0x10, 0, 4, XA_ADPCM_FILTER_COUNT);
+			data[1]  = encode_nibbles(&(state->right), audio_samples + 1, audio_samples_limit - 1,        2, 56, data + 0x10, 4, 4, XA_ADPCM_FILTER_COUNT);
+			data[2]  = encode_nibbles(&(state->left), audio_samples + 56, audio_samples_limit - 56,       2, 56, data + 0x11, 0, 4, XA_ADPCM_FILTER_COUNT);
+			data[3]  = encode_nibbles(&(state->right), audio_samples + 56 + 1, audio_samples_limit - 56 - 1,  2, 56, data + 0x11, 4, 4, XA_ADPCM_FILTER_COUNT);
+			data[8]  = encode_nibbles(&(state->left), audio_samples + 56*2, audio_samples_limit - 56*2,    2, 56, data + 0x12, 0, 4, XA_ADPCM_FILTER_COUNT);
+			data[9]  = encode_nibbles(&(state->right), audio_samples + 56*2 + 1, audio_samples_limit - 56*2 - 1, 2, 56, data + 0x12, 4, 4, XA_ADPCM_FILTER_COUNT);
+			data[10] = encode_nibbles(&(state->left), audio_samples + 56*3, audio_samples_limit - 56*3,     2, 56, data + 0x13, 0, 4, XA_ADPCM_FILTER_COUNT);
+			data[11] = encode_nibbles(&(state->right), audio_samples + 56*3 + 1, audio_samples_limit - 56*3 - 1, 2, 56, data + 0x13, 4, 4, XA_ADPCM_FILTER_COUNT);
 		} else {
-			data[0]  = encode_nibbles(&(state->left), audio_samples, audio_samples_limit,           1, data + 0x10, 0, 4, XA_ADPCM_FILTER_COUNT);
-			data[1]  = encode_nibbles(&(state->right), audio_samples + 28, audio_samples_limit - 28,       1, data + 0x10, 4, 4, XA_ADPCM_FILTER_COUNT);
-			data[2]  = encode_nibbles(&(state->left), audio_samples + 28*2, audio_samples_limit - 28*2,     1, data + 0x11, 0, 4, XA_ADPCM_FILTER_COUNT);
-			data[3]  = encode_nibbles(&(state->right), audio_samples + 28*3, audio_samples_limit - 28*3,     1, data + 0x11, 4, 4, XA_ADPCM_FILTER_COUNT);
-			data[8]  = encode_nibbles(&(state->left), audio_samples + 28*4, audio_samples_limit - 28*4,     1, data + 0x12, 0, 4, XA_ADPCM_FILTER_COUNT);
-			data[9]  = encode_nibbles(&(state->right), audio_samples + 28*5, audio_samples_limit - 28*5,     1, data + 0x12, 4, 4, XA_ADPCM_FILTER_COUNT);
-			data[10] = encode_nibbles(&(state->left), audio_samples + 28*6, audio_samples_limit - 28*6,     1, data + 0x13, 0, 4, XA_ADPCM_FILTER_COUNT);
-			data[11] = encode_nibbles(&(state->right), audio_samples + 28*7, audio_samples_limit - 28*7,     1, data + 0x13, 4, 4, XA_ADPCM_FILTER_COUNT);
+			data[0]  = encode_nibbles(&(state->left), audio_samples, audio_samples_limit,           1, 56, data + 0x10, 0, 4, XA_ADPCM_FILTER_COUNT);
+			data[1]  = encode_nibbles(&(state->right), audio_samples + 28, audio_samples_limit - 28,       1, 56, data + 0x10, 4, 4, XA_ADPCM_FILTER_COUNT);
+			data[2]  = encode_nibbles(&(state->left), audio_samples + 28*2, audio_samples_limit - 28*2,     1, 56, data + 0x11, 0, 4, XA_ADPCM_FILTER_COUNT);
+			data[3]  = encode_nibbles(&(state->right), audio_samples + 28*3, audio_samples_limit - 28*3,     1, 56, data + 0x11, 4, 4, XA_ADPCM_FILTER_COUNT);
+			data[8]  = encode_nibbles(&(state->left), audio_samples + 28*4, audio_samples_limit - 28*4,     1, 56, data + 0x12, 0, 4, XA_ADPCM_FILTER_COUNT);
+			data[9]  = encode_nibbles(&(state->right), audio_samples + 28*5, audio_samples_limit - 28*5,     1, 56, data + 0x12, 4, 4, XA_ADPCM_FILTER_COUNT);
+			data[10] = encode_nibbles(&(state->left), audio_samples + 28*6, audio_samples_limit - 28*6,     1, 56, data + 0x13, 0, 4, XA_ADPCM_FILTER_COUNT);
+			data[11] = encode_nibbles(&(state->right), audio_samples + 28*7, audio_samples_limit - 28*7,     1, 56, data + 0x13, 4, 4, XA_ADPCM_FILTER_COUNT);
 		}
 	} else {
 /*		if (settings->stereo) {
@@ -237,36 +376,37 @@ static void psx_audio_xa_encode_init_sector(uint8_t *buffer, psx_audio_xa_settin
 	memcpy(buffer + 0x014, buffer + 0x010, 4);
 }
 
-int psx_audio_xa_encode(psx_audio_xa_settings_t settings, psx_audio_encoder_state_t *state, int16_t* samples, int sample_count, uint8_t *output) {
+// encodes the 18 sound groups of one sector; sample_count is what's left of the input from samples on
+static void encode_sector_xa(psx_audio_xa_settings_t settings, psx_audio_encoder_state_t *state, int16_t* samples, int sample_count, uint8_t *sector_data) {
 	int sample_jump = (settings.bits_per_sample == 8) ? 112 : 224;
-	int i, j;
-	int xa_sector_size = settings.format == PSX_AUDIO_XA_FORMAT_XA ? 2336 : 2352;
-	int xa_offset = 2352 - xa_sector_size;
-	uint8_t init_sector = 1;
 
-	if (settings.stereo) { sample_count <<= 1; }
-	
-	for (i = 0, j = 0; i < sample_count || ((j % 18) != 0); i += sample_jump, j++) {
-		uint8_t *sector_data = output + ((j/18) * xa_sector_size) - xa_offset;
-		uint8_t *block_data = sector_data + 0x18 + ((j%18) * 0x80);
-
-		if (init_sector) {
-			psx_audio_xa_encode_init_sector(sector_data, settings);
-			init_sector = 0;
-		}
+	psx_audio_xa_encode_init_sector(sector_data, settings);
+
+	for (int i = 0, j = 0; j < 18; i += sample_jump, j++) {
+		uint8_t *block_data = sector_data + 0x18 + (j * 0x80);
 
 		encode_block_xa(samples + i, sample_count - i, block_data, settings, state);
 
 		memcpy(block_data + 4, block_data, 4);
 		memcpy(block_data + 12, block_data + 8, 4);
+	}
 
-		if ((j+1)%18 == 0) {
-			psx_cdrom_calculate_checksums(sector_data, PSX_CDROM_SECTOR_TYPE_MODE2_FORM2);
-			init_sector = 1;
-		}
+	psx_cdrom_calculate_checksums(sector_data, PSX_CDROM_SECTOR_TYPE_MODE2_FORM2);
+}
+
+int psx_audio_xa_encode(psx_audio_xa_settings_t settings, psx_audio_encoder_state_t *state, int16_t* samples, int sample_count, uint8_t *output) {
+	int sector_jump = ((settings.bits_per_sample == 8) ? 112 : 224) * 18;
+	int i, j;
+	int xa_sector_size = settings.format == PSX_AUDIO_XA_FORMAT_XA ? 2336 : 2352;
+	int xa_offset = 2352 - xa_sector_size;
+
+	if (settings.stereo) { sample_count <<= 1; }
+
+	for (i = 0, j = 0; i < sample_count; i += sector_jump, j++) {
+		encode_sector_xa(settings, state, samples + i, sample_count - i, output + (j * xa_sector_size) - xa_offset);
 	}
 
-	return (((j + 17) / 18) * xa_sector_size);
+	return j * xa_sector_size;
 }
 
 int psx_audio_xa_encode_finalize(psx_audio_xa_settings_t settings, uint8_t *output, int output_length) {
@@ -285,18 +425,22 @@ int psx_audio_xa_encode_simple(psx_audio_xa_settings_t settings, int16_t* sample
 	return length;
 }
 
-int psx_audio_spu_encode(psx_audio_encoder_state_t *state, int16_t* samples, int sample_count, uint8_t *output) {
+static void encode_block_spu(psx_audio_encoder_state_t *state, int16_t* samples, int sample_count, uint8_t *buffer) {
 	uint8_t prebuf[28];
+
+	buffer[0] = encode_nibbles(&(state->left), samples, sample_count, 1, 28, prebuf, 0, 1, SPU_ADPCM_FILTER_COUNT);
+	buffer[1] = 0;
+
+	for (int j = 0; j < 28; j+=2) {
+		buffer[2 + (j>>1)] = (prebuf[j] & 0x0F) | (prebuf[j+1] << 4);
+	}
+}
+
+int psx_audio_spu_encode(psx_audio_encoder_state_t *state, int16_t* samples, int sample_count, uint8_t *output) {
 	uint8_t *buffer = output;
-	uint8_t *data;
 
 	for (int i = 0; i < sample_count; i += 28, buffer += 16) {
-		buffer[0] = encode_nibbles(&(state->left), samples + i, sample_count - i, 1, prebuf, 0, 1, SPU_ADPCM_FILTER_COUNT);
-		buffer[1] = 0;
-
-		for (int j = 0; j < 28; j+=2) {
-			buffer[2 + (j>>1)] = (prebuf[j] & 0x0F) | (prebuf[j+1] << 4);
-		}
+		encode_block_spu(state, samples + i, sample_count - i, buffer);
 	}
 
 	return buffer - output;
@@ -326,3 +470,227 @@ void psx_audio_spu_set_flag_at_sample(uint8_t* spu_data, int sample_pos, int fla
 	int buffer_pos = (sample_pos / 28) << 4;
 	spu_data[buffer_pos + 1] = flag;
 }
+
+static void spu_stream_emit(psx_audio_spu_stream_t *stream, uint8_t *output, int end) {
+	memcpy(output, stream->held, 16);
+	if (stream->loop_start < 0 ? stream->emitted == 0 : stream->emitted == stream->loop_start / 28) {
+		output[1] = PSX_AUDIO_SPU_LOOP_START;
+	}
+	if (end) {
+		if (stream->emitted == 0) {
+			output[1] = stream->loop_start >= 0 ? 7 : 5;
+		} else {
+			output[1] = stream->loop_start >= 0 ? PSX_AUDIO_SPU_LOOP_REPEAT : PSX_AUDIO_SPU_LOOP_END;
+		}
+	}
+	stream->emitted++;
+	stream->has_held = false;
+}
+
+// encodes the block at the start of the buffer and holds it back until it's known whether it's the last one
+static int spu_stream_encode_block(psx_audio_spu_stream_t *stream, uint8_t *output) {
+	int written = 0;
+	if (stream->has_held) {
+		spu_stream_emit(stream, output, 0);
+		written = 16;
+	}
+
+	encode_block_spu(&stream->state, stream->buffer, stream->buffered, stream->held);
+	stream->has_held = true;
+
+	int consumed = stream->buffered < 28 ? stream->buffered : 28;
+	stream->buffered -= consumed;
+	memmove(stream->buffer, stream->buffer + consumed, stream->buffered * sizeof(int16_t));
+	return written;
+}
+
+void psx_audio_spu_stream_init(psx_audio_spu_stream_t *stream, int loop_start) {
+	memset(stream, 0, sizeof(psx_audio_spu_stream_t));
+	stream->loop_start = loop_start;
+}
+
+int psx_audio_spu_stream_feed(psx_audio_spu_stream_t *stream, const int16_t *samples, int sample_count, uint8_t *output) {
+	uint8_t *out = output;
+
+	while (sample_count > 0) {
+		int count = PSX_AUDIO_SPU_STREAM_BUFFER - stream->buffered;
+		if (count > sample_count) { count = sample_count; }
+		memcpy(stream->buffer + stream->buffered, samples, count * sizeof(int16_t));
+		stream->buffered += count;
+		samples += count;
+		sample_count -= count;
+
+		// the encoder looks one block ahead, so only encode once the next one is complete too
+		if (stream->buffered == PSX_AUDIO_SPU_STREAM_BUFFER) {
+			out += spu_stream_encode_block(stream, out);
+		}
+	}
+
+	return out - output;
+}
+
+int psx_audio_spu_stream_flush(psx_audio_spu_stream_t *stream, uint8_t *output) {
+	uint8_t *out = output;
+
+	while (stream->buffered > 0) {
+		out += spu_stream_encode_block(stream, out);
+	}
+	if (stream->has_held) {
+		spu_stream_emit(stream, out, 1);
+		out += 16;
+	}
+
+	return out - output;
+}
+
+static int xa_stream_sector_entries(const psx_audio_xa_stream_t *stream) {
+	return ((stream->settings.bits_per_sample == 8) ? 112 : 224) * 18;
+}
+
+static int xa_stream_emit(psx_audio_xa_stream_t *stream, uint8_t *output, int last) {
+	int xa_sector_size = stream->settings.format == PSX_AUDIO_XA_FORMAT_XA ? 2336 : 2352;
+	memcpy(output, stream->held + 2352 - xa_sector_size, xa_sector_size);
+	if (last) {
+		psx_audio_xa_encode_finalize(stream->settings, output, xa_sector_size);
+	}
+	stream->has_held = false;
+	return xa_sector_size;
+}
+
+// encodes the sector at the start of the buffer and holds it back until it's known whether it's the last one
+static int xa_stream_encode_sector(psx_audio_xa_stream_t *stream, uint8_t *output) {
+	int sector_entries = xa_stream_sector_entries(stream);
+	int written = 0;
+	if (stream->has_held) {
+		written = xa_stream_emit(stream, output, 0);
+	}
+
+	encode_sector_xa(stream->settings, &stream->state, stream->buffer, stream->buffered, stream->held);
+	stream->has_held = true;
+
+	int consumed = stream->buffered < sector_entries ? stream->buffered : sector_entries;
+	stream->buffered -= consumed;
+	memmove(stream->buffer, stream->buffer + consumed, stream->buffered * sizeof(int16_t));
+	return written;
+}
+
+void psx_audio_xa_stream_init(psx_audio_xa_stream_t *stream, psx_audio_xa_settings_t settings) {
+	memset(stream, 0, sizeof(psx_audio_xa_stream_t));
+	stream->settings = settings;
+}
+
+int psx_audio_xa_stream_feed(psx_audio_xa_stream_t *stream, const int16_t *samples, int sample_count, uint8_t *output) {
+	// one sound group past the sector covers the encoder's lookahead
+	int needed = xa_stream_sector_entries(stream) + xa_stream_sector_entries(stream) / 18;
+	uint8_t *out = output;
+
+	if (stream->settings.stereo) { sample_count <<= 1; }
+
+	while (sample_count > 0) {
+		int count = needed - stream->buffered;
+		if (count > sample_count) { count = sample_count; }
+		memcpy(stream->buffer + stream->buffered, samples, count * sizeof(int16_t));
+		stream->buffered += count;
+		samples += count;
+		sample_count -= count;
+
+		if (stream->buffered == needed) {
+			out += xa_stream_encode_sector(stream, out);
+		}
+	}
+
+	return out - output;
+}
+
+int psx_audio_xa_stream_flush(psx_audio_xa_stream_t *stream, uint8_t *output) {
+	uint8_t *out = output;
+
+	while (stream->buffered > 0) {
+		out += xa_stream_encode_sector(stream, out);
+	}
+	if (stream->has_held) {
+		out += xa_stream_emit(stream, out, 1);
+	}
+
+	return out - output;
+}
+
+static void decode_nibbles(psx_audio_decoder_channel_state_t *state, const uint8_t *data, int data_shift, int data_pitch, uint8_t hdr, int16_t *output, int output_pitch) {
+	int shift = hdr & 0x0F;
+	int filter = (hdr >> 4) & 0x07;
+	// the hardware treats the reserved shift values like 9, reserved filters never come out of the encoder
+	if (shift > 12) { shift = 9; }
+	if (filter >= ADPCM_FILTER_COUNT) { filter = 0; }
+	int k1 = filter_k1[filter];
+	int k2 = filter_k2[filter];
+
+	for (int i = 0; i < 28; i++) {
+		int32_t sample = (int16_t) (((data[i * data_pitch] >> data_shift) & 0x0F) << 12);
+		sample >>= shift;
+		sample += (k1*state->prev1 + k2*state->prev2 + (1<<5))>>6;
+		if (sample > +0x7FFF) { sample = +0x7FFF; }
+		if (sample < -0x8000) { sample = -0x8000; }
+		output[i * output_pitch] = sample;
+		state->prev2 = state->prev1;
+		state->prev1 = sample;
+	}
+}
+
+int psx_audio_spu_decode(psx_audio_decoder_channel_state_t *state, const uint8_t *data, int data_length, int16_t *output) {
+	int16_t *out = output;
+	uint8_t nibbles[28];
+
+	for (int i = 0; i + 16 <= data_length; i += 16, out += 28) {
+		for (int j = 0; j < 28; j += 2) {
+			nibbles[j] = data[i + 2 + (j>>1)] & 0x0F;
+			nibbles[j+1] = data[i + 2 + (j>>1)] >> 4;
+		}
+		decode_nibbles(state, nibbles, 0, 1, data[i], out, 1);
+	}
+
+	return out - output;
+}
+
+int psx_audio_spu_decode_simple(const uint8_t *data, int data_length, int16_t *output) {
+	psx_audio_decoder_channel_state_t state;
+	memset(&state, 0, sizeof(psx_audio_decoder_channel_state_t));
+	return psx_audio_spu_decode(&state, data, data_length, output);
+}
+
+int psx_audio_xa_decode(psx_audio_xa_format_t format, psx_audio_decoder_state_t *state, const uint8_t *sector, int16_t *output) {
+	// same layout as the encoder's output: the subheader is at 0x10 of a raw sector
+	const uint8_t *sector_data = sector - (format == PSX_AUDIO_XA_FORMAT_XA ? 0x10 : 0);
+	uint8_t submode = sector_data[0x012];
+	uint8_t coding = sector_data[0x013];
+	if (!(submode & 0x04) || (coding & 0x30)) { return 0; }
+	bool stereo = coding & 0x01;
+
+	int16_t *out = output;
+	for (int j = 0; j < 18; j++, out += 224) {
+		const uint8_t *block_data = sector_data + 0x18 + (j * 0x80);
+		// eight sound units, headers at 0-3 and 8-11 (4-7 and 12-15 are copies)
+		for (int u = 0; u < 8; u++) {
+			uint8_t hdr = block_data[(u < 4) ? u : (u + 4)];
+			const uint8_t *data = block_data + 0x10 + (u >> 1);
+			int data_shift = (u & 1) * 4;
+			if (stereo) {
+				decode_nibbles((u & 1) ? &(state->right) : &(state->left), data, data_shift, 4, hdr, out + (u >> 1) * 56 + (u & 1), 2);
+			} else {
+				decode_nibbles(&(state->left), data, data_shift, 4, hdr, out + u * 28, 1);
+			}
+		}
+	}
+
+	return out - output;
+}
+
+int psx_audio_xa_decode_simple(psx_audio_xa_format_t format, const uint8_t *data, int data_length, int16_t *output) {
+	psx_audio_decoder_state_t state;
+	memset(&state, 0, sizeof(psx_audio_decoder_state_t));
+	int sector_size = format == PSX_AUDIO_XA_FORMAT_XA ? 2336 : 2352;
+	int16_t *out = output;
+	for (int i = 0; i + sector_size <= data_length; i += sector_size) {
+		out += psx_audio_xa_decode(format, &state, data + i, out);
+	}
+	return out - output;
+}
@@ -0,0 +1,269 @@
+/*
+libpsxav: MDEC video + SPU/XA-ADPCM audio library
+
+Copyright (c) 2019, 2020 Adrian "asie" Siekierka
+Copyright (c) 2019 Ben "GreaseMonkey" Russell
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <string.h>
+#include "adpcm_simd.h"
+
+#ifdef PSX_AUDIO_HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// Same arithmetic as attempt_to_encode_nibbles(), minus the nibble output.
+void evaluate_candidates_scalar(candidate_list_t *list, const psx_audio_encoder_channel_state_t *state, const int32_t *samples) {
+	for (int c = 0; c < list->count; c++) {
+		int32_t prev1 = state->prev1;
+		int32_t prev2 = state->prev2;
+		int32_t k1 = list->k1[c];
+		int32_t k2 = list->k2[c];
+		int min_shift = list->shift[c];
+		uint64_t mse = 0;
+
+		for (int i = 0; i < 28; i++) {
+			int32_t sample = samples[i];
+			int32_t previous_values = (k1*prev1 + k2*prev2 + (1<<5))>>6;
+			int32_t sample_enc = sample - previous_values;
+			sample_enc <<= min_shift;
+			sample_enc += (1<<(12-1));
+			sample_enc >>= 12;
+			if(sample_enc < -8) { sample_enc = -8; }
+			if(sample_enc > +7) { sample_enc = +7; }
+			sample_enc &= 0xF;
+
+			int32_t sample_dec = (int16_t) ((sample_enc&0xF) << 12);
+			sample_dec >>= min_shift;
+			sample_dec += previous_values;
+			if (sample_dec > +0x7FFF) { sample_dec = +0x7FFF; }
+			if (sample_dec < -0x8000) { sample_dec = -0x8000; }
+			int64_t sample_error = sample_dec - sample;
+			mse += ((uint64_t)sample_error) * (uint64_t)sample_error;
+
+			prev2 = prev1;
+			prev1 = sample_dec;
+		}
+
+		list->mse[c] = mse;
+	}
+}
+
+#ifdef PSX_AUDIO_HAVE_X86_SIMD
+
+// The per-lane shifts are turned into multiplies by 1 << shift, since SSE2 can only shift all lanes by the same amount.
+// (enc << 12) >> shift is exact because the low 12 bits are zero, so it equals enc * (1 << (12 - shift)).
+
+__attribute__((target("sse2")))
+static inline __m128i mullo_epi32_sse2(__m128i a, __m128i b) {
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i clamp_epi32_sse2(__m128i a, __m128i lo, __m128i hi) {
+	__m128i below = _mm_cmplt_epi32(a, lo);
+	__m128i above = _mm_cmpgt_epi32(a, hi);
+	a = _mm_or_si128(_mm_and_si128(below, lo), _mm_andnot_si128(below, a));
+	return _mm_or_si128(_mm_and_si128(above, hi), _mm_andnot_si128(above, a));
+}
+
+__attribute__((target("sse2")))
+void evaluate_candidates_sse2(candidate_list_t *list, const psx_audio_encoder_channel_state_t *state, const int32_t *samples) {
+	const __m128i round_pred = _mm_set1_epi32(1<<5);
+	const __m128i round_enc = _mm_set1_epi32(1<<(12-1));
+	const __m128i nibble_min = _mm_set1_epi32(-8);
+	const __m128i nibble_max = _mm_set1_epi32(+7);
+
+	for (int c = 0; c < list->count; c += 4) {
+		int32_t enc_mul[4], dec_mul[4];
+		for (int l = 0; l < 4; l++) {
+			enc_mul[l] = 1 << list->shift[c + l];
+			dec_mul[l] = 1 << (12 - list->shift[c + l]);
+		}
+
+		const __m128i k1 = _mm_loadu_si128((const __m128i *)(list->k1 + c));
+		const __m128i k2 = _mm_loadu_si128((const __m128i *)(list->k2 + c));
+		const __m128i emul = _mm_loadu_si128((const __m128i *)enc_mul);
+		const __m128i dmul = _mm_loadu_si128((const __m128i *)dec_mul);
+		__m128i prev1 = _mm_set1_epi32(state->prev1);
+		__m128i prev2 = _mm_set1_epi32(state->prev2);
+		__m128i mse_even = _mm_setzero_si128();
+		__m128i mse_odd = _mm_setzero_si128();
+
+		for (int i = 0; i < 28; i++) {
+			__m128i sample = _mm_set1_epi32(samples[i]);
+			__m128i previous_values = _mm_add_epi32(mullo_epi32_sse2(k1, prev1), mullo_epi32_sse2(k2, prev2));
+			previous_values = _mm_srai_epi32(_mm_add_epi32(previous_values, round_pred), 6);
+
+			__m128i sample_enc = mullo_epi32_sse2(_mm_sub_epi32(sample, previous_values), emul);
+			sample_enc = _mm_srai_epi32(_mm_add_epi32(sample_enc, round_enc), 12);
+			sample_enc = clamp_epi32_sse2(sample_enc, nibble_min, nibble_max);
+
+			// saturating pack to 16 bits and sign extend back does the int16 clamp
+			__m128i sample_dec = _mm_add_epi32(mullo_epi32_sse2(sample_enc, dmul), previous_values);
+			sample_dec = _mm_packs_epi32(sample_dec, sample_dec);
+			sample_dec = _mm_srai_epi32(_mm_unpacklo_epi16(sample_dec, sample_dec), 16);
+
+			__m128i sample_error = _mm_sub_epi32(sample_dec, sample);
+			__m128i sign = _mm_srai_epi32(sample_error, 31);
+			sample_error = _mm_sub_epi32(_mm_xor_si128(sample_error, sign), sign);
+			mse_even = _mm_add_epi64(mse_even, _mm_mul_epu32(sample_error, sample_error));
+			sample_error = _mm_srli_epi64(sample_error, 32);
+			mse_odd = _mm_add_epi64(mse_odd, _mm_mul_epu32(sample_error, sample_error));
+
+			prev2 = prev1;
+			prev1 = sample_dec;
+		}
+
+		uint64_t even[2], odd[2];
+		_mm_storeu_si128((__m128i *)even, mse_even);
+		_mm_storeu_si128((__m128i *)odd, mse_odd);
+		const uint64_t mse[4] = { even[0], odd[0], even[1], odd[1] };
+		for (int l = 0; l < 4 && c + l < list->count; l++)
+			list->mse[c + l] = mse[l];
+	}
+}
+
+__attribute__((target("avx2")))
+void evaluate_candidates_avx2(candidate_list_t *list, const psx_audio_encoder_channel_state_t *state, const int32_t *samples) {
+	const __m256i round_pred = _mm256_set1_epi32(1<<5);
+	const __m256i round_enc = _mm256_set1_epi32(1<<(12-1));
+	const __m256i nibble_min = _mm256_set1_epi32(-8);
+	const __m256i nibble_max = _mm256_set1_epi32(+7);
+	const __m256i twelve = _mm256_set1_epi32(12);
+
+	for (int c = 0; c < list->count; c += 8) {
+		const __m256i k1 = _mm256_loadu_si256((const __m256i *)(list->k1 + c));
+		const __m256i k2 = _mm256_loadu_si256((const __m256i *)(list->k2 + c));
+		const __m256i eshift = _mm256_loadu_si256((const __m256i *)(list->shift + c));
+		const __m256i dshift = _mm256_sub_epi32(twelve, eshift);
+		__m256i prev1 = _mm256_set1_epi32(state->prev1);
+		__m256i prev2 = _mm256_set1_epi32(state->prev2);
+		__m256i mse_even = _mm256_setzero_si256();
+		__m256i mse_odd = _mm256_setzero_si256();
+
+		for (int i = 0; i < 28; i++) {
+			__m256i sample = _mm256_set1_epi32(samples[i]);
+			__m256i previous_values = _mm256_add_epi32(_mm256_mullo_epi32(k1, prev1), _mm256_mullo_epi32(k2, prev2));
+			previous_values = _mm256_srai_epi32(_mm256_add_epi32(previous_values, round_pred), 6);
+
+			__m256i sample_enc = _mm256_sllv_epi32(_mm256_sub_epi32(sample, previous_values), eshift);
+			sample_enc = _mm256_srai_epi32(_mm256_add_epi32(sample_enc, round_enc), 12);
+			sample_enc = _mm256_min_epi32(_mm256_max_epi32(sample_enc, nibble_min), nibble_max);
+
+			__m256i sample_dec = _mm256_add_epi32(_mm256_sllv_epi32(sample_enc, dshift), previous_values);
+			sample_dec = _mm256_packs_epi32(sample_dec, sample_dec);
+			sample_dec = _mm256_srai_epi32(_mm256_unpacklo_epi16(sample_dec, sample_dec), 16);
+
+			__m256i sample_error = _mm256_abs_epi32(_mm256_sub_epi32(sample_dec, sample));
+			mse_even = _mm256_add_epi64(mse_even, _mm256_mul_epu32(sample_error, sample_error));
+			sample_error = _mm256_srli_epi64(sample_error, 32);
+			mse_odd = _mm256_add_epi64(mse_odd, _mm256_mul_epu32(sample_error, sample_error));
+
+			prev2 = prev1;
+			prev1 = sample_dec;
+		}
+
+		uint64_t even[4], odd[4];
+		_mm256_storeu_si256((__m256i *)even, mse_even);
+		_mm256_storeu_si256((__m256i *)odd, mse_odd);
+		const uint64_t mse[8] = { even[0], odd[0], even[1], odd[1], even[2], odd[2], even[3], odd[3] };
+		for (int l = 0; l < 8 && c + l < list->count; l++)
+			list->mse[c + l] = mse[l];
+	}
+}
+
+#endif
+
+psx_audio_simd_t get_supported_simd(void) {
+#ifdef PSX_AUDIO_HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return PSX_AUDIO_SIMD_AVX2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		return PSX_AUDIO_SIMD_SSE2;
+	}
+#endif
+	return PSX_AUDIO_SIMD_NONE;
+}
+
+evaluate_candidates_t get_candidate_kernel(psx_audio_simd_t simd) {
+	switch (simd) {
+#ifdef PSX_AUDIO_HAVE_X86_SIMD
+		case PSX_AUDIO_SIMD_AVX2: return evaluate_candidates_avx2;
+		case PSX_AUDIO_SIMD_SSE2: return evaluate_candidates_sse2;
+#endif
+		default: return evaluate_candidates_scalar;
+	}
+}
+
+static uint32_t check_rand(uint32_t *seed) {
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+int psx_audio_check_simd(psx_audio_simd_t simd, int num_lists) {
+	if (simd <= PSX_AUDIO_SIMD_NONE || simd > get_supported_simd()) {
+		return -1;
+	}
+
+	evaluate_candidates_t kernel = get_candidate_kernel(simd);
+	uint32_t seed = 1;
+	int failed = 0;
+
+	for (int n = 0; n < num_lists; n++) {
+		candidate_list_t list, ref;
+		psx_audio_encoder_channel_state_t state;
+		int32_t samples[28];
+
+		// any count, so the last register is partly filled; k1/k2 cover the range of the real filters
+		memset(&list, 0, sizeof(list));
+		list.count = 1 + check_rand(&seed) % MAX_CANDIDATES;
+		for (int c = 0; c < list.count; c++) {
+			list.k1[c] = check_rand(&seed) % 123;
+			list.k2[c] = -(int32_t)(check_rand(&seed) % 61);
+			list.shift[c] = check_rand(&seed) % 13;
+		}
+
+		// a quarter of the blocks are full scale square waves, which clip both the nibbles and the decoded samples;
+		// gather_block() adds the quantization error, so samples can be a bit past 16 bits
+		memset(&state, 0, sizeof(state));
+		state.prev1 = (int16_t)check_rand(&seed);
+		state.prev2 = (int16_t)check_rand(&seed);
+		bool square = (n & 3) == 0;
+		for (int i = 0; i < 28; i++) {
+			if (square) {
+				samples[i] = (check_rand(&seed) & 1) ? 0x7FFF + 0x100 : -0x8000 - 0x100;
+			} else {
+				samples[i] = (int16_t)check_rand(&seed) + (int32_t)(check_rand(&seed) % 0x201) - 0x100;
+			}
+		}
+
+		ref = list;
+		evaluate_candidates_scalar(&ref, &state, samples);
+		kernel(&list, &state, samples);
+		if (memcmp(list.mse, ref.mse, sizeof(uint64_t) * list.count)) {
+			failed++;
+		}
+	}
+
+	return failed;
+}
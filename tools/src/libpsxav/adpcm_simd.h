@@ -0,0 +1,65 @@
+/*
+libpsxav: MDEC video + SPU/XA-ADPCM audio library
+
+Copyright (c) 2019, 2020 Adrian "asie" Siekierka
+Copyright (c) 2019 Ben "GreaseMonkey" Russell
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef __ADPCM_SIMD_H__
+#define __ADPCM_SIMD_H__
+
+// internal to libpsxav: scoring a block's filter/shift candidates, with a kernel per instruction set
+
+#include "libpsxav.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PSX_AUDIO_HAVE_X86_SIMD
+#endif
+
+#define ADPCM_FILTER_COUNT 5
+
+// Every (filter, shift) pair that encode_nibbles() tries for a block, in the order it tries them;
+// that's all 13 shifts per filter at max effort.
+// The arrays are padded to a whole number of AVX2 registers.
+#define MAX_CANDIDATES (ADPCM_FILTER_COUNT * 13)
+#define CANDIDATE_SLOTS ((MAX_CANDIDATES + 7) & ~7)
+
+typedef struct {
+	int count;
+	int32_t k1[CANDIDATE_SLOTS];
+	int32_t k2[CANDIDATE_SLOTS];
+	int32_t filter[CANDIDATE_SLOTS];
+	int32_t shift[CANDIDATE_SLOTS];
+	uint64_t mse[CANDIDATE_SLOTS];
+} candidate_list_t;
+
+typedef void (*evaluate_candidates_t)(candidate_list_t *list, const psx_audio_encoder_channel_state_t *state, const int32_t *samples);
+
+void evaluate_candidates_scalar(candidate_list_t *list, const psx_audio_encoder_channel_state_t *state, const int32_t *samples);
+#ifdef PSX_AUDIO_HAVE_X86_SIMD
+void evaluate_candidates_sse2(candidate_list_t *list, const psx_audio_encoder_channel_state_t *state, const int32_t *samples);
+void evaluate_candidates_avx2(candidate_list_t *list, const psx_audio_encoder_channel_state_t *state, const int32_t *samples);
+#endif
+
+// the best level this build and CPU can run
+psx_audio_simd_t get_supported_simd(void);
+// the kernel for `simd`, the scalar one for PSX_AUDIO_SIMD_NONE
+evaluate_candidates_t get_candidate_kernel(psx_audio_simd_t simd);
+
+#endif /* __ADPCM_SIMD_H__ */
@@ -24,20 +24,111 @@ freely, subject to the following restrictions:
 #include <string.h>
 #include "libpsxav.h"
 
-static uint32_t psx_cdrom_calculate_edc(uint8_t *sector, uint32_t offset, uint32_t size)
+#define EDC_POLY 0xD8018001
+#define ECC_POLY 0x11D
+
+// EDC is a reflected CRC-32, done 8 bytes at a time with slice-by-8 tables
+static uint32_t edc_table[8][256];
+// GF(2^8) multiply by 2, and the inverse of x ^ 2x, for the Reed-Solomon ECC
+static uint8_t ecc_f_lut[256];
+static uint8_t ecc_b_lut[256];
+static int tables_ready;
+
+#ifdef __GNUC__
+__attribute__((constructor))
+#endif
+static void psx_cdrom_init_tables(void)
 {
-	uint32_t edc = 0;
-	for (int i = offset; i < offset+size; i++) {
-		edc ^= 0xFF&(uint32_t)sector[i];
+	for (int i = 0; i < 256; i++) {
+		uint32_t edc = i;
 		for (int ibit = 0; ibit < 8; ibit++) {
-			edc = (edc>>1)^(0xD8018001*(edc&0x1));
+			edc = (edc>>1)^(EDC_POLY*(edc&0x1));
 		}
+		edc_table[0][i] = edc;
+	}
+	for (int k = 1; k < 8; k++) {
+		for (int i = 0; i < 256; i++) {
+			edc_table[k][i] = (edc_table[k-1][i] >> 8) ^ edc_table[0][edc_table[k-1][i] & 0xFF];
+		}
+	}
+
+	for (int i = 0; i < 256; i++) {
+		uint32_t j = (i << 1) ^ ((i & 0x80) ? ECC_POLY : 0);
+		ecc_f_lut[i] = j;
+		ecc_b_lut[i ^ j] = i;
+	}
+
+	tables_ready = 1;
+}
+
+static uint32_t psx_cdrom_calculate_edc(uint8_t *sector, uint32_t offset, uint32_t size)
+{
+	uint32_t edc = 0;
+	const uint8_t *p = sector + offset;
+
+	for (; size >= 8; size -= 8, p += 8) {
+		uint32_t one = edc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+		uint32_t two = p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32_t)p[7] << 24);
+		edc = edc_table[7][one & 0xFF] ^ edc_table[6][(one >> 8) & 0xFF]
+			^ edc_table[5][(one >> 16) & 0xFF] ^ edc_table[4][one >> 24]
+			^ edc_table[3][two & 0xFF] ^ edc_table[2][(two >> 8) & 0xFF]
+			^ edc_table[1][(two >> 16) & 0xFF] ^ edc_table[0][two >> 24];
+	}
+	for (; size > 0; size--, p++) {
+		edc = (edc >> 8) ^ edc_table[0][(edc ^ *p) & 0xFF];
 	}
+
 	return edc;
 }
 
+// One of the two RS product code passes over the 2340 bytes from the header on:
+// major_count codewords of minor_count bytes each, then the two parity bytes of every codeword
+// go to dest[major] and dest[major + major_count].
+static void psx_cdrom_calculate_ecc_block(const uint8_t *src, uint32_t major_count, uint32_t minor_count, uint32_t major_mult, uint32_t minor_inc, uint8_t *dest)
+{
+	uint32_t size = major_count * minor_count;
+	for (uint32_t major = 0; major < major_count; major++) {
+		uint32_t index = (major >> 1) * major_mult + (major & 1);
+		uint8_t ecc_a = 0;
+		uint8_t ecc_b = 0;
+		for (uint32_t minor = 0; minor < minor_count; minor++) {
+			uint8_t temp = src[index];
+			index += minor_inc;
+			if (index >= size) { index -= size; }
+			ecc_a ^= temp;
+			ecc_b ^= temp;
+			ecc_a = ecc_f_lut[ecc_a];
+		}
+		ecc_a = ecc_b_lut[ecc_f_lut[ecc_a] ^ ecc_b];
+		dest[major] = ecc_a;
+		dest[major + major_count] = ecc_a ^ ecc_b;
+	}
+}
+
+// P parity (86 codewords of 24 bytes) at 0x81C, then Q parity (52 codewords of 43 bytes, covering P) at 0x8C8.
+// Mode 2 computes it as if the header was zero, so sectors can be relocated without redoing ECC.
+static void psx_cdrom_calculate_ecc(uint8_t *sector, int zero_header)
+{
+	uint8_t header[4];
+	if (zero_header) {
+		memcpy(header, sector + 0xC, 4);
+		memset(sector + 0xC, 0, 4);
+	}
+
+	psx_cdrom_calculate_ecc_block(sector + 0xC, 86, 24, 2, 86, sector + 0x81C);
+	psx_cdrom_calculate_ecc_block(sector + 0xC, 52, 43, 86, 88, sector + 0x8C8);
+
+	if (zero_header) {
+		memcpy(sector + 0xC, header, 4);
+	}
+}
+
 void psx_cdrom_calculate_checksums(uint8_t *sector, psx_cdrom_sector_type_t type)
 {
+	if (!tables_ready) {
+		psx_cdrom_init_tables();
+	}
+
 	switch (type) {
 		case PSX_CDROM_SECTOR_TYPE_MODE1: {
 			uint32_t edc = psx_cdrom_calculate_edc(sector, 0x0, 0x810);
@@ -47,7 +138,7 @@ void psx_cdrom_calculate_checksums(uint8_t *sector, psx_cdrom_sector_type_t type
 			sector[0x813] = (uint8_t)(edc >> 24);
 
 			memset(sector + 0x814, 0, 8);
-			// TODO: ECC
+			psx_cdrom_calculate_ecc(sector, 0);
 		} break;
 		case PSX_CDROM_SECTOR_TYPE_MODE2_FORM1: {
 			uint32_t edc = psx_cdrom_calculate_edc(sector, 0x10, 0x808);
@@ -56,7 +147,7 @@ void psx_cdrom_calculate_checksums(uint8_t *sector, psx_cdrom_sector_type_t type
 			sector[0x81A] = (uint8_t)(edc >> 16);
 			sector[0x81B] = (uint8_t)(edc >> 24);
 
-			// TODO: ECC
+			psx_cdrom_calculate_ecc(sector, 1);
 		} break;
 		case PSX_CDROM_SECTOR_TYPE_MODE2_FORM2: {
 			uint32_t edc = psx_cdrom_calculate_edc(sector, 0x10, 0x91C);
@@ -66,4 +157,4 @@ void psx_cdrom_calculate_checksums(uint8_t *sector, psx_cdrom_sector_type_t type
 			sector[0x92F] = (uint8_t)(edc >> 24);
 		} break;
 	}
-}
\ No newline at end of file
+}
@@ -57,6 +57,60 @@ typedef struct {
 	psx_audio_encoder_channel_state_t right;
 } psx_audio_encoder_state_t;
 
+typedef struct {
+	int prev1, prev2;
+} psx_audio_decoder_channel_state_t;
+
+typedef struct {
+	psx_audio_decoder_channel_state_t left;
+	psx_audio_decoder_channel_state_t right;
+} psx_audio_decoder_state_t;
+
+// instruction sets the encoder can use to try out filter/shift candidates;
+// every level produces exactly the same output
+typedef enum {
+	PSX_AUDIO_SIMD_AUTO = -1,
+	PSX_AUDIO_SIMD_NONE,
+	PSX_AUDIO_SIMD_SSE2,
+	PSX_AUDIO_SIMD_AVX2
+} psx_audio_simd_t;
+
+// incremental encoders: feed them any number of samples at a time, then flush once;
+// the output is identical to encoding everything at once with the _simple functions
+
+#define PSX_AUDIO_SPU_STREAM_BUFFER (28 * 2)
+#define PSX_AUDIO_XA_STREAM_BUFFER (224 * 19)
+
+// most bytes flush() writes: the held block or sector, and what's still buffered
+#define PSX_AUDIO_SPU_STREAM_FLUSH_MAX (16 * 3)
+#define PSX_AUDIO_XA_STREAM_FLUSH_MAX (2352 * 3)
+
+typedef struct {
+	psx_audio_encoder_state_t state;
+	int16_t buffer[PSX_AUDIO_SPU_STREAM_BUFFER]; // input that hasn't been encoded yet
+	int buffered;
+	uint8_t held[16]; // last encoded block, its flags depend on whether more follow
+	bool has_held;
+	int emitted; // number of blocks output so far
+	int loop_start;
+} psx_audio_spu_stream_t;
+
+typedef struct {
+	psx_audio_xa_settings_t settings;
+	psx_audio_encoder_state_t state;
+	int16_t buffer[PSX_AUDIO_XA_STREAM_BUFFER]; // input that hasn't been encoded yet, interleaved if stereo
+	int buffered;
+	uint8_t held[2352]; // last encoded sector, the final one gets the end of file flags
+	bool has_held;
+} psx_audio_xa_stream_t;
+
+// how hard the encoder searches for the best filter and shift of every block
+typedef enum {
+	PSX_AUDIO_EFFORT_FAST, // only the predicted filter and shift
+	PSX_AUDIO_EFFORT_DEFAULT, // every filter, predicted shift +-1
+	PSX_AUDIO_EFFORT_MAX // every filter and shift
+} psx_audio_effort_t;
+
 #define PSX_AUDIO_SPU_LOOP_END 1
 #define PSX_AUDIO_SPU_LOOP_REPEAT 3
 #define PSX_AUDIO_SPU_LOOP_START 4
@@ -73,6 +127,31 @@ int psx_audio_spu_encode(psx_audio_encoder_state_t *state, int16_t* samples, int
 int psx_audio_spu_encode_simple(int16_t* samples, int sample_count, uint8_t *output, int loop_start);
 int psx_audio_xa_encode_finalize(psx_audio_xa_settings_t settings, uint8_t *output, int output_length);
 void psx_audio_spu_set_flag_at_sample(uint8_t* spu_data, int sample_pos, int flag);
+// feed() writes at most psx_audio_spu_get_buffer_size(sample_count) + 16 bytes, flush() at most PSX_AUDIO_SPU_STREAM_FLUSH_MAX
+void psx_audio_spu_stream_init(psx_audio_spu_stream_t *stream, int loop_start);
+int psx_audio_spu_stream_feed(psx_audio_spu_stream_t *stream, const int16_t *samples, int sample_count, uint8_t *output);
+int psx_audio_spu_stream_flush(psx_audio_spu_stream_t *stream, uint8_t *output);
+// feed() writes at most psx_audio_xa_get_buffer_size(settings, sample_count) plus one sector,
+// flush() at most PSX_AUDIO_XA_STREAM_FLUSH_MAX
+void psx_audio_xa_stream_init(psx_audio_xa_stream_t *stream, psx_audio_xa_settings_t settings);
+int psx_audio_xa_stream_feed(psx_audio_xa_stream_t *stream, const int16_t *samples, int sample_count, uint8_t *output);
+int psx_audio_xa_stream_flush(psx_audio_xa_stream_t *stream, uint8_t *output);
+// decodes whole 16-byte blocks, ignoring their loop flags; returns the number of samples written
+int psx_audio_spu_decode(psx_audio_decoder_channel_state_t *state, const uint8_t *data, int data_length, int16_t *output);
+int psx_audio_spu_decode_simple(const uint8_t *data, int data_length, int16_t *output);
+// decodes one 4-bit XA sector (2336 bytes for PSX_AUDIO_XA_FORMAT_XA, 2352 for XACD) into
+// interleaved samples if it's stereo; returns the number of samples written, 0 if it's not a 4-bit audio sector
+int psx_audio_xa_decode(psx_audio_xa_format_t format, psx_audio_decoder_state_t *state, const uint8_t *sector, int16_t *output);
+int psx_audio_xa_decode_simple(psx_audio_xa_format_t format, const uint8_t *data, int data_length, int16_t *output);
+// not thread safe, call before encoding; returns the level that will actually be used
+psx_audio_simd_t psx_audio_set_simd(psx_audio_simd_t simd);
+psx_audio_simd_t psx_audio_get_simd(void);
+// scores num_lists random candidate lists with the kernel for `simd` and the scalar one; returns how many
+// came out different, -1 if this build or CPU can't run that level
+int psx_audio_check_simd(psx_audio_simd_t simd, int num_lists);
+// not thread safe either
+void psx_audio_set_effort(psx_audio_effort_t effort);
+psx_audio_effort_t psx_audio_get_effort(void);
 
 // cdrom.c
 
@@ -4,7 +4,12 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <string.h>
+#include <math.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <strings.h>
+#include <pthread.h>
 
 // #define SAVE_WAVS 1
 
@@ -15,16 +20,27 @@
 
 #include "libpsxav/libpsxav.h"
 #include "common.h"
+#include "pool.h"
+#include "adpcm_cache.h"
+#include "synth.h"
 
 #define MAX_TRACKS 16
 #define MAX_MELODY_TRACKS 8
-#define NUM_WAVEFORMS 100
-#define WAVEFORM_LEN 256
-#define NUM_OCT 8
+#define NUM_DRUMS (MAX_TRACKS - MAX_MELODY_TRACKS)
+#define DRUM_SFX_BASE 150 // where the drums are in SFX.BNK, ORG_DRUM_BANK_BASE in the player
+#define NUM_WAVEFORMS SYNTH_NUM_WAVEFORMS
+#define WAVEFORM_LEN SYNTH_WAVEFORM_LEN
+#define NUM_OCT SYNTH_NUM_OCTS
 
 #define ORG_MAGIC "Org-0"
 #define ORG_MAGICLEN 6 // +1 char for version
 
+#define KEYDUMMY 0xFF
+
+#define ADPCM_BLOCK_LEN SYNTH_BLOCK_LEN
+#define MAX_STRETCH_DIV 16 // short loops may stretch the waveform period by at most 1/16th
+#define DEF_MAX_CENTS 2.0
+
 #pragma pack(push, 1)
 
 typedef struct {
@@ -45,41 +61,63 @@ typedef struct {
 
 #pragma pack(pop)
 
-// organya header
-static org_hdr_t org_data;
+// a song's header and the octaves that are actually played by each of its melody tracks
+struct song {
+  org_hdr_t hdr;
+  uint8_t oct_used[MAX_MELODY_TRACKS]; // one bit per octave
+  uint8_t drum_used; // one bit per drum track that plays anything
+};
+
+// a bank being laid out in PSX SPURAM
+struct bank {
+  uint8_t *spuram; // SPURAM_SIZE + 1024 bytes, 1kb of grace zone
+  int ptr;
+  int start;
+};
 
-// output PSX SPURAM
-static uint8_t spuram[SPURAM_SIZE + 1024]; // 1kb of grace zone
-static int spuram_ptr = SPURAM_START;
 static int spuram_start = SPURAM_START;
 
+// output PSX SPURAM for the single bank modes
+static uint8_t spuram[SPURAM_SIZE + 1024];
+
 // wave.dat
 static int8_t wavetable[NUM_WAVEFORMS][WAVEFORM_LEN];
 
 // output instrument samples
 static struct sfx inst[MAX_MELODY_TRACKS][NUM_OCT];
 
-static const struct {
-  short wave_size;
-  short oct_par;
-  short oct_size;
-} oct_wave[NUM_OCT] = {
-  { 256,   1,  4 }, // 0 Oct
-  { 256,   2,  8 }, // 1 Oct
-  { 128,   4, 12 }, // 2 Oct
-  { 128,   8, 16 }, // 3 Oct
-  {  64,  16, 20 }, // 4 Oct
-  {  32,  32, 24 }, // 5 Oct
-  {  16,  64, 28 }, // 6 Oct
-  {   8, 128, 32 }, // 7 Oct
-};
-
-static struct bank_hdr bank_hdr;
+// output samples for the shared wave bank, indexed by wave_no instead of track;
+// in batch mode this is a cache of encoded samples shared by all songs
+static struct sfx wave_inst[NUM_WAVEFORMS][NUM_OCT];
+static uint8_t wave_used[NUM_WAVEFORMS]; // one bit per octave, like song.oct_used
+static pthread_mutex_t wave_lock[NUM_WAVEFORMS][NUM_OCT];
+static int cache_hits, cache_misses;
+
+// drum samples from SFX.BNK, copied into banks as they are; adpcm points into sfx_bank_data
+static struct sfx drums[NUM_DRUMS];
+static uint8_t *sfx_bank_data;
+static bool with_drums = false;
+static uint8_t noise_drums = 0; // drums the player puts on the noise generator, they need no samples
+
+static const short freq_tbl[12] = { 262, 277, 294, 311, 330, 349, 370, 392, 415, 440, 466, 494 };
+
+// loop layout of every octave's sample
+static struct {
+  uint32_t len;     // sample length, always a multiple of ADPCM_BLOCK_LEN
+  uint32_t periods; // number of waveform periods in the sample
+  uint16_t pitch;   // pitch multiplier that restores the original period, 4.12
+  double cents;     // worst pitch error of the multiplier vs the original sample
+} oct_loop[NUM_OCT];
+
+static bool short_loops = false;
+static bool fast_encode = false;
+static int num_jobs = 0; // 0 = one per CPU
+static double max_cents = DEF_MAX_CENTS;
 
 #ifdef SAVE_WAVS
-static void save_track_sample(const int i, const int j, const char *fmask) {
+static void save_track_sample(const struct sfx *sample, const int idx, const char *fmask) {
   char path[2048];
-  snprintf(path, sizeof(path), "%s%d.wav", fmask, i * NUM_OCT + j);
+  snprintf(path, sizeof(path), "%s%d.wav", fmask, idx);
   drwav wav;
   drwav_data_format format;
   format.container = drwav_container_riff;
@@ -88,50 +126,91 @@ static void save_track_sample(const int i, const int j, const char *fmask) {
   format.sampleRate = 22050;
   format.bitsPerSample = 16;
   if (drwav_init_file_write(&wav, path, &format, NULL)) {
-    drwav_write_pcm_frames(&wav, inst[i][j].len, inst[i][j].data);
+    drwav_write_pcm_frames(&wav, sample->len, sample->data);
     drwav_uninit(&wav);
   }
 }
 #endif
 
-static inline int lcm(const int a, const int b) {
-  register int step, div, x;
-  if (a > b) {
-    step = b;
-    div = a;
-  } else {
-    step = a;
-    div = b;
+// worst pitch error in cents that playing a sample with `periods` periods in `len` samples
+// using the pitch multiplier `pitch` would cause in the given octave, compared to how
+// the player plays the full-size sample; this includes the pitch register rounding
+static double loop_pitch_error(const int oct, const uint32_t len, const uint32_t periods, const uint16_t pitch) {
+  const double wave_size = synth_oct[oct].wave_size;
+  const double period = (double)len / periods;
+  double max_err = 0.0;
+  for (int key = 0; key < 12; ++key) {
+    // see org_play_melodic()
+    const uint32_t hz = (synth_oct[oct].wave_size * freq_tbl[key] * synth_oct[oct].oct_par) / 8;
+    const uint32_t old_reg = (hz << 12) / 44100;
+    const uint32_t new_reg = (hz * pitch) / 44100;
+    const double err = fabs(1200.0 * log2((new_reg / period) / (old_reg / wave_size)));
+    if (err > max_err)
+      max_err = err;
   }
-  x = step;
-  while (x % div)
-    x += step;
-  return x;
+  return max_err;
 }
 
-// this is basically MakeSoundObject8 from Organya.cpp
-static void build_track_samples(const int idx, const int8_t *wavep, const bool pipi) {
+// finds the shortest block-aligned loop for every octave that can hold a whole number of
+// (slightly stretched) waveform periods, the stretch being undone by a pitch multiplier
+static void find_octave_loops(void) {
   for (int j = 0; j < NUM_OCT; ++j) {
-    // generate unsigned 8-bit PCM sample
-    const uint32_t wave_size = oct_wave[j].wave_size;
-    const uint32_t num_samples = lcm(wave_size, 28);
-    int16_t *wp = malloc(num_samples * sizeof(int16_t));
-    assert(wp);
-    uint32_t wav_tp = 0;
-    int16_t *wp_sub = wp;
-    for (uint32_t i = 0; i < num_samples; ++i) {
-      int work = *(wavep + wav_tp);
-      work *= 256;
-      *wp_sub = (int16_t)work;
-      wav_tp += 0x100 / wave_size;
-      if (wav_tp > 0xFF)
-        wav_tp -= 0x100;
-      wp_sub++;
+    const uint32_t wave_size = synth_oct[j].wave_size;
+    const uint32_t full_len = synth_loop_len(j);
+    oct_loop[j].len = full_len;
+    oct_loop[j].periods = full_len / wave_size;
+    oct_loop[j].pitch = PITCH_ONE;
+    oct_loop[j].cents = 0.0;
+    if (!short_loops)
+      continue;
+    bool found = false;
+    for (uint32_t len = ADPCM_BLOCK_LEN; len < full_len && !found; len += ADPCM_BLOCK_LEN) {
+      for (uint32_t periods = 1; periods * wave_size <= len + len / MAX_STRETCH_DIV; ++periods) {
+        const uint32_t orig_len = periods * wave_size;
+        const uint32_t stretch = (len > orig_len) ? len - orig_len : orig_len - len;
+        if (stretch * MAX_STRETCH_DIV > orig_len)
+          continue;
+        const uint16_t pitch = (uint16_t)lround((double)PITCH_ONE * len / orig_len);
+        const double cents = loop_pitch_error(j, len, periods, pitch);
+        if (cents <= max_cents) {
+          oct_loop[j].len = len;
+          oct_loop[j].periods = periods;
+          oct_loop[j].pitch = pitch;
+          oct_loop[j].cents = cents;
+          found = true;
+          break;
+        }
+      }
     }
-    inst[idx][j].data = wp;
-    inst[idx][j].len = num_samples;
+  }
+}
+
+static void print_octave_loops(void) {
+  uint32_t saved = 0;
+  for (int j = 0; j < NUM_OCT; ++j) {
+    const uint32_t full_len = synth_loop_len(j);
+    const uint32_t oct_saved = psx_audio_spu_get_buffer_size(full_len) - psx_audio_spu_get_buffer_size(oct_loop[j].len);
+    printf("octave %d: loop %4u -> %4u samples (%u periods), pitch 0x%04x, error %.2f cents, saved %u bytes\n",
+      j, full_len, oct_loop[j].len, oct_loop[j].periods, oct_loop[j].pitch, oct_loop[j].cents, oct_saved);
+    saved += oct_saved * MAX_MELODY_TRACKS;
+  }
+  printf("short loops saved %u bytes of SPU RAM\n", saved);
+}
+
+static void build_sample(struct sfx *out, const int8_t *wavep, const int oct) {
+  const uint32_t num_samples = oct_loop[oct].len;
+  int16_t *wp = malloc(num_samples * sizeof(int16_t));
+  assert(wp);
+  synth_build_sample(wp, wavep, oct, num_samples, oct_loop[oct].periods);
+  out->data = wp;
+  out->len = num_samples;
+}
+
+static void build_track_samples(const int idx, const int8_t *wavep, const bool pipi) {
+  for (int j = 0; j < NUM_OCT; ++j) {
+    build_sample(&inst[idx][j], wavep, j);
 #ifdef SAVE_WAVS
-    save_track_sample(idx, j, "orgwave/");
+    save_track_sample(&inst[idx][j], idx * NUM_OCT + j, "orgwave/");
 #endif
   }
 }
@@ -144,7 +223,7 @@ static bool load_wavetable(const char *fname) {
   return (rx > 0);
 }
 
-static bool load_org_tracks(const char *fname) {
+static bool load_org_tracks(struct song *song, const char *fname) {
   FILE *f = fopen(fname, "rb");
   if (!f) return false;
 
@@ -163,81 +242,281 @@ static bool load_org_tracks(const char *fname) {
     return false;
   }
 
-  fread(&org_data, sizeof(org_data), 1, f);
+  fread(&song->hdr, sizeof(song->hdr), 1, f);
+
+  // find out which octaves each melody track plays; the note data is stored
+  // one track after another as positions, keys, lengths, volumes, pans
+  // batch mode loads songs on several threads
+  uint8_t *keys = malloc(0x10000);
+  assert(keys);
+  memset(song->oct_used, 0, sizeof(song->oct_used));
+  song->drum_used = 0;
+  for (int i = 0; i < MAX_TRACKS; ++i) {
+    const uint32_t num = song->hdr.tdata[i].note_num;
+    fseek(f, num * sizeof(int32_t), SEEK_CUR);
+    if (fread(keys, 1, num, f) != num) {
+      free(keys);
+      fclose(f);
+      fprintf(stderr, "error: '%s' is truncated\n", fname);
+      return false;
+    }
+    if (i >= MAX_MELODY_TRACKS) {
+      for (uint32_t n = 0; n < num; ++n)
+        if (keys[n] != KEYDUMMY)
+          song->drum_used |= 1 << (i - MAX_MELODY_TRACKS);
+      fseek(f, num * 3, SEEK_CUR);
+      continue;
+    }
+    if (song->hdr.tdata[i].wave_no >= NUM_WAVEFORMS) {
+      if (num) {
+        free(keys);
+        fclose(f);
+        fprintf(stderr, "error: '%s' track %d has invalid waveform %d\n", fname, i, song->hdr.tdata[i].wave_no);
+        return false;
+      }
+      // samples still get built for empty tracks, from whatever waveform they have
+      song->hdr.tdata[i].wave_no = 0;
+    }
+    for (uint32_t n = 0; n < num; ++n) {
+      if (keys[n] != KEYDUMMY && keys[n] / 12 < NUM_OCT)
+        song->oct_used[i] |= 1 << (keys[n] / 12);
+    }
+    fseek(f, num * 3, SEEK_CUR);
+  }
+
+  free(keys);
   fclose(f);
 
   // don't know if this is required
   if (ver == 1) {
     for (int i = 0; i < MAX_TRACKS; ++i)
-        org_data.tdata[i].pipi = 0;
+        song->hdr.tdata[i].pipi = 0;
   }
 
-  for (int i = 0; i < MAX_MELODY_TRACKS; ++i)
-    build_track_samples(i, wavetable[org_data.tdata[i].wave_no], org_data.tdata[i].pipi);
+  return true;
+}
+
+// reads the drums out of an SFX bank, each one ending where the next sample after it starts
+static bool load_drums(const char *fname) {
+  FILE *f = fopen(fname, "rb");
+  if (!f) {
+    fprintf(stderr, "error: could not open '%s'\n", fname);
+    return false;
+  }
+
+  uint32_t hdr[2];
+  uint32_t *addr = NULL;
+  bool ok = fread(hdr, sizeof(hdr), 1, f) == 1 && hdr[1] >= DRUM_SFX_BASE + 1;
+  if (ok) {
+    addr = malloc(hdr[1] * sizeof(uint32_t));
+    sfx_bank_data = malloc(hdr[0]);
+    assert(addr && sfx_bank_data);
+    ok = fread(addr, sizeof(uint32_t), hdr[1], f) == hdr[1] && fread(sfx_bank_data, 1, hdr[0], f) == hdr[0];
+  }
+  fclose(f);
+  if (!ok) {
+    fprintf(stderr, "error: '%s' is not an SFX bank with drums at %d\n", fname, DRUM_SFX_BASE);
+    free(addr);
+    return false;
+  }
+
+  uint32_t start = 0;
+  for (uint32_t i = 0; i < hdr[1]; ++i)
+    if (addr[i] && (!start || addr[i] < start))
+      start = addr[i];
+
+  for (int d = 0; d < NUM_DRUMS && DRUM_SFX_BASE + d < (int)hdr[1]; ++d) {
+    const uint32_t a = addr[DRUM_SFX_BASE + d];
+    if (!a)
+      continue;
+    uint32_t end = start + hdr[0];
+    for (uint32_t i = 0; i < hdr[1]; ++i)
+      if (addr[i] > a && addr[i] < end)
+        end = addr[i];
+    drums[d].adpcm = sfx_bank_data + (a - start);
+    drums[d].adpcm_len = end - a;
+  }
 
+  free(addr);
   return true;
 }
 
-static void cleanup(void) {
-  for (int i = 0; i < MAX_MELODY_TRACKS; ++i) {
-    for (int j = 0; j < NUM_OCT; ++j) {
-      if (inst[i][j].data)
-        free(inst[i][j].data);
-    }
+static void encode_sample(struct sfx *sample) {
+  const double start = time_ms();
+  const int max_len = psx_audio_spu_get_buffer_size(sample->len);
+  const uint64_t key = fast_encode ?
+    adpcm_cache_key(sample->data, sample->len, 0, ADPCM_ENC_SYNTH, PSX_AUDIO_EFFORT_DEFAULT) :
+    adpcm_cache_key(sample->data, sample->len, 0, ADPCM_ENC_PSXAV, psx_audio_get_effort());
+  sample->adpcm = malloc(max_len);
+  assert(sample->adpcm);
+  sample->adpcm_len = adpcm_cache_load(key, sample->adpcm, max_len);
+  if (sample->adpcm_len < 0) {
+    sample->adpcm_len = fast_encode ?
+      (int)synth_encode_adpcm(sample->adpcm, sample->data, sample->len, 1) :
+      psx_audio_spu_encode_simple(sample->data, sample->len, sample->adpcm, 0);
+    adpcm_cache_store(key, sample->adpcm, sample->adpcm_len);
   }
+  sample->enc_time = time_ms() - start;
+  sample->signal = sample->noise = 0.0;
+  if (sample->adpcm_len > 0)
+    measure_adpcm_error(sample->data, sample->len, sample->adpcm, sample->adpcm_len, &sample->signal, &sample->noise);
 }
 
-int main(int argc, char **argv) {
-  if (argc < 4) {
-    printf("usage: orgconv <org_file> <wave_dat> <out_bank> [<spu_start_addr>]\n");
-    return -1;
+static void encode_sample_job(int idx, void *arg) {
+  encode_sample(((struct sfx **)arg)[idx]);
+}
+
+// encodes all the samples in parallel, each into its own buffer
+static void encode_samples(struct sfx **samples, const int count) {
+  const int jobs = num_jobs ? num_jobs : pool_num_cpus();
+  const double start = time_ms();
+  pool_run(jobs, count, encode_sample_job, samples);
+  const double wall = time_ms() - start;
+  double total = 0.0;
+  for (int i = 0; i < count; ++i)
+    total += samples[i]->enc_time;
+  printf("encoded %d samples in %.1f ms on %d threads (%.1f ms of encoding, %.2fx)\n",
+    count, wall, (jobs < count) ? jobs : count, total, (wall > 0.0) ? total / wall : 1.0);
+}
+
+static const char *encoder_name(void) {
+  return fast_encode ? "synth" : effort_name(psx_audio_get_effort());
+}
+
+// SNR over all the samples of a bank
+static double bank_snr(const struct sfx *samples, const int count) {
+  double signal = 0.0;
+  double noise = 0.0;
+  for (int i = 0; i < count; ++i) {
+    signal += samples[i].signal;
+    noise += samples[i].noise;
   }
+  return snr_db(signal, noise);
+}
 
-  atexit(cleanup);
+// copies an encoded sample to the current SPU RAM position
+// returns 0 on success, < 0 on failure
+static int pack_sample(struct bank *bank, struct sfx *sample) {
+  if (sample->adpcm_len <= 0)
+    return -4;
+  if (bank->ptr + ALIGN(sample->adpcm_len, 8) >= SPURAM_SIZE)
+    return -5;
+  memcpy(bank->spuram + bank->ptr, sample->adpcm, sample->adpcm_len);
+  sample->addr = bank->ptr;
+  bank->ptr += ALIGN(sample->adpcm_len, 8);
+  return 0;
+}
 
-  const char *orgfname = argv[1];
-  const char *datfname = argv[2];
-  const char *outfname = argv[3];
-  if (argc > 4) {
-    int addr = atoi(argv[4]);
-    if (addr > SPURAM_START)
-      spuram_ptr = spuram_start = addr;
+// packs the drums in `used` that the SFX bank has, the rest get address 0
+static int pack_drums(struct bank *bank, struct sfx *out, const uint8_t used) {
+  for (int d = 0; d < NUM_DRUMS; ++d) {
+    out[d] = drums[d];
+    out[d].addr = 0;
+    if ((used & ~noise_drums & (1 << d)) && drums[d].adpcm_len > 0) {
+      const int res = pack_sample(bank, &out[d]);
+      if (res < 0)
+        return res;
+    }
   }
+  return 0;
+}
 
-  if (!load_wavetable(datfname)) {
-    fprintf(stderr, "error: could not load wavetable from '%s'\n", datfname);
-    return -2;
+// writes out the bank; samples are assumed to be grouped by NUM_OCT octaves, then the drums if there are any
+static int write_bank(const struct bank *bank, const char *outfname, const struct sfx *samples, const int num_samples,
+    const struct sfx *drum_samples, const int num_drums) {
+  struct bank_hdr bank_hdr;
+  bank_hdr.num_sfx = num_samples + num_drums;
+  bank_hdr.data_size = bank->ptr - bank->start;
+
+  FILE *f = fopen(outfname, "wb");
+  if (!f) {
+    fprintf(stderr, "error: could not open '%s' for writing\n", outfname);
+    return -5;
   }
 
-#ifdef SAVE_WAVS
-  mkdir("orgwave");
-#endif
+  // write header without the first address because fuck this shit
+  fwrite(&bank_hdr, sizeof(bank_hdr) - sizeof(uint32_t), 1, f);
+  // write sample addresses starting with 0, 0
+  for (int i = 0; i < num_samples; ++i)
+    fwrite(&samples[i].addr, sizeof(uint32_t), 1, f);
+  for (int i = 0; i < num_drums; ++i)
+    fwrite(&drum_samples[i].addr, sizeof(uint32_t), 1, f);
+  // write sample data
+  fwrite(bank->spuram + bank->start, bank_hdr.data_size, 1, f);
+  // write pitch multipliers if they're needed; drums play at their own rate
+  if (short_loops) {
+    const uint16_t one = 0x1000;
+    for (int i = 0; i < num_samples; ++i)
+      fwrite(&oct_loop[i % NUM_OCT].pitch, sizeof(uint16_t), 1, f);
+    for (int i = 0; i < num_drums; ++i)
+      fwrite(&one, sizeof(uint16_t), 1, f);
+  }
 
-  if (!load_org_tracks(orgfname)) {
+  fclose(f);
+
+  return 0;
+}
+
+static void print_bank_info(const struct bank *bank) {
+  printf("SPU RAM total usage: %u/%u bytes\n", bank->ptr, SPURAM_SIZE);
+  printf("SPU RAM start address: %u\n", SPURAM_START);
+  printf("bank size: %u bytes\n", bank->ptr - bank->start);
+  printf("bank start: %u\n", bank->start);
+  printf("bank ident: %02x %02x %02x %02x\n",
+    bank->spuram[bank->start+0], bank->spuram[bank->start+1], bank->spuram[bank->start+2], bank->spuram[bank->start+3]);
+}
+
+static void free_sample(struct sfx *sample) {
+  if (sample->data)
+    free(sample->data);
+  if (sample->adpcm)
+    free(sample->adpcm);
+}
+
+static void cleanup(void) {
+  adpcm_cache_print_stats();
+  free(sfx_bank_data);
+  for (int i = 0; i < MAX_MELODY_TRACKS; ++i)
+    for (int j = 0; j < NUM_OCT; ++j)
+      free_sample(&inst[i][j]);
+  for (int i = 0; i < NUM_WAVEFORMS; ++i)
+    for (int j = 0; j < NUM_OCT; ++j)
+      free_sample(&wave_inst[i][j]);
+}
+
+// makes a bank with the instruments of a single song, 8 octaves for each melody track
+static int convert_song(const char *orgfname, const char *outfname) {
+  struct song song;
+  struct bank bank = { spuram, spuram_start, spuram_start };
+
+  if (!load_org_tracks(&song, orgfname)) {
     fprintf(stderr, "error: could not load track data from '%s'\n", orgfname);
     return -3;
   }
 
+  struct sfx *samples[MAX_MELODY_TRACKS * NUM_OCT];
+  for (int i = 0; i < MAX_MELODY_TRACKS; ++i) {
+    build_track_samples(i, wavetable[song.hdr.tdata[i].wave_no], song.hdr.tdata[i].pipi);
+    for (int j = 0; j < NUM_OCT; ++j)
+      samples[i * NUM_OCT + j] = &inst[i][j];
+  }
+
+  encode_samples(samples, MAX_MELODY_TRACKS * NUM_OCT);
+
   for (int i = 0; i < MAX_MELODY_TRACKS; ++i) {
     for (int j = 0; j < NUM_OCT; ++j) {
-      const int adpcm_len = psx_audio_spu_encode_simple(inst[i][j].data, inst[i][j].len, spuram + spuram_ptr, 0);
-      if (adpcm_len <= 0) {
+      const int res = pack_sample(&bank, &inst[i][j]);
+      if (res == -4) {
         fprintf(stderr, "error: could not encode instrument sample %d/%d\n", i, j);
-        return -4;
-      }
-      inst[i][j].addr = spuram_ptr;
-      spuram_ptr += ALIGN(adpcm_len, 8);
-      if (spuram_ptr >= SPURAM_SIZE) {
+        return res;
+      } else if (res < 0) {
         fprintf(stderr, "error: ran out of SPU RAM packing instrument sample %d/%d\n", i, j);
-        return -5;
+        return res;
       }
       // printf(" * instrument [%d][%d]: addr=%05x pcmlen=%06u adpcmlen=%06d\n", i, j, inst[i][j].addr, inst[i][j].len, adpcm_len);
     }
   }
 
-  bank_hdr.num_sfx = MAX_MELODY_TRACKS * NUM_OCT;
-  bank_hdr.data_size = spuram_ptr - spuram_start;
-
   /*
   printf("bank addr:\n");
   for (int i = 0; i < MAX_MELODY_TRACKS; ++i)
@@ -245,29 +524,359 @@ int main(int argc, char **argv) {
       printf("* (%03d) 0x%06x\n", i*NUM_OCT + j, inst[i][j].addr);
   */
 
-  printf("SPU RAM total usage: %u/%u bytes\n", spuram_ptr, SPURAM_SIZE);
-  printf("SPU RAM start address: %u\n", SPURAM_START);
-  printf("bank size: %u bytes\n", bank_hdr.data_size);
-  printf("bank start: %u\n", spuram_start);
-  printf("bank ident: %02x %02x %02x %02x\n",
-    spuram[spuram_start+0], spuram[spuram_start+1], spuram[spuram_start+2], spuram[spuram_start+3]);
+  struct sfx song_drums[NUM_DRUMS];
+  if (with_drums && pack_drums(&bank, song_drums, song.drum_used) < 0) {
+    fprintf(stderr, "error: ran out of SPU RAM packing drums\n");
+    return -5;
+  }
 
-  FILE *f = fopen(outfname, "wb");
-  if (!f) {
-    fprintf(stderr, "error: could not open '%s' for writing\n", outfname);
+  print_bank_info(&bank);
+  printf("encoder: %s, SNR: %.2f dB\n", encoder_name(), bank_snr(&inst[0][0], MAX_MELODY_TRACKS * NUM_OCT));
+
+  return write_bank(&bank, outfname, &inst[0][0], MAX_MELODY_TRACKS * NUM_OCT, song_drums, with_drums ? NUM_DRUMS : 0);
+}
+
+// makes a single bank with every waveform and octave combination played in any of the songs,
+// indexed by wave_no * NUM_OCT + octave; unused combinations have address 0
+static int convert_wave_bank(char **orgfnames, const int num_orgs, const char *outfname) {
+  struct song song;
+  struct bank bank = { spuram, spuram_start, spuram_start };
+
+  for (int n = 0; n < num_orgs; ++n) {
+    if (!load_org_tracks(&song, orgfnames[n])) {
+      fprintf(stderr, "error: could not load track data from '%s'\n", orgfnames[n]);
+      return -3;
+    }
+    for (int i = 0; i < MAX_MELODY_TRACKS; ++i) {
+      if (song.hdr.tdata[i].wave_no < NUM_WAVEFORMS)
+        wave_used[song.hdr.tdata[i].wave_no] |= song.oct_used[i];
+    }
+  }
+
+  static struct sfx *samples[NUM_WAVEFORMS * NUM_OCT];
+  int num_waves = 0;
+  int num_samples = 0;
+  for (int i = 0; i < NUM_WAVEFORMS; ++i) {
+    if (!wave_used[i])
+      continue;
+    ++num_waves;
+    for (int j = 0; j < NUM_OCT; ++j) {
+      if (wave_used[i] & (1 << j)) {
+        build_sample(&wave_inst[i][j], wavetable[i], j);
+        samples[num_samples++] = &wave_inst[i][j];
+      }
+    }
+  }
+
+  encode_samples(samples, num_samples);
+
+  for (int i = 0; i < NUM_WAVEFORMS; ++i) {
+    for (int j = 0; j < NUM_OCT; ++j) {
+      if (!(wave_used[i] & (1 << j)))
+        continue;
+      const int res = pack_sample(&bank, &wave_inst[i][j]);
+      if (res == -4) {
+        fprintf(stderr, "error: could not encode waveform %d octave %d\n", i, j);
+        return res;
+      } else if (res < 0) {
+        fprintf(stderr, "error: ran out of SPU RAM packing waveform %d octave %d\n", i, j);
+        return res;
+      }
+    }
+  }
+
+  print_bank_info(&bank);
+  printf("encoder: %s, SNR: %.2f dB\n", encoder_name(), bank_snr(&wave_inst[0][0], NUM_WAVEFORMS * NUM_OCT));
+  printf("shared bank: %d songs use %d waveforms, %d/%d samples, %u bytes of SPU RAM, %u bytes left\n",
+    num_orgs, num_waves, num_samples, NUM_WAVEFORMS * NUM_OCT, bank.ptr - bank.start, SPURAM_SIZE - bank.ptr);
+
+  return write_bank(&bank, outfname, &wave_inst[0][0], NUM_WAVEFORMS * NUM_OCT, NULL, 0);
+}
+
+// makes a bank with just the drums any of the songs play, for songs whose banks don't have their own
+static int convert_drum_bank(char **orgfnames, const int num_orgs, const char *outfname) {
+  struct song song;
+  struct bank bank = { spuram, spuram_start, spuram_start };
+
+  uint8_t used = 0;
+  for (int n = 0; n < num_orgs; ++n) {
+    if (!load_org_tracks(&song, orgfnames[n])) {
+      fprintf(stderr, "error: could not load track data from '%s'\n", orgfnames[n]);
+      return -3;
+    }
+    used |= song.drum_used;
+  }
+
+  struct sfx bank_drums[NUM_DRUMS];
+  if (pack_drums(&bank, bank_drums, used) < 0) {
+    fprintf(stderr, "error: ran out of SPU RAM packing drums\n");
     return -5;
   }
 
-  // write header without the first address because fuck this shit
-  fwrite(&bank_hdr, sizeof(bank_hdr) - sizeof(uint32_t), 1, f);
-  // write sample addresses starting with 0, 0
-  for (int i = 0; i < MAX_MELODY_TRACKS; ++i)
+  int num_used = 0;
+  for (int d = 0; d < NUM_DRUMS; ++d)
+    num_used += bank_drums[d].addr != 0;
+  print_bank_info(&bank);
+  printf("drum bank: %d songs use %d drums, %u bytes of SPU RAM\n", num_orgs, num_used, bank.ptr - bank.start);
+
+  return write_bank(&bank, outfname, NULL, 0, bank_drums, NUM_DRUMS);
+}
+
+// returns the encoded sample for a waveform and octave, encoding it if it's not in the cache yet
+static const struct sfx *get_cached_sample(const int wave_no, const int oct) {
+  struct sfx *sample = &wave_inst[wave_no][oct];
+  pthread_mutex_lock(&wave_lock[wave_no][oct]);
+  if (sample->adpcm) {
+    __atomic_add_fetch(&cache_hits, 1, __ATOMIC_RELAXED);
+  } else {
+    __atomic_add_fetch(&cache_misses, 1, __ATOMIC_RELAXED);
+    build_sample(sample, wavetable[wave_no], oct);
+    encode_sample(sample);
+    free(sample->data);
+    sample->data = NULL;
+  }
+  pthread_mutex_unlock(&wave_lock[wave_no][oct]);
+  return sample;
+}
+
+struct batch {
+  const char *indir;
+  const char *outdir;
+  char **names;
+  int *results;
+};
+
+static void convert_batch_song(int idx, void *arg) {
+  const struct batch *batch = arg;
+  const char *name = batch->names[idx];
+  char inpath[4096];
+  char outpath[4096];
+  snprintf(inpath, sizeof(inpath), "%s/%s", batch->indir, name);
+  snprintf(outpath, sizeof(outpath), "%s/%.*s.bnk", batch->outdir, (int)(strrchr(name, '.') - name), name);
+
+  const double start = time_ms();
+  struct song song;
+  if (!load_org_tracks(&song, inpath)) {
+    batch->results[idx] = -3;
+    return;
+  }
+
+  struct bank bank = { malloc(SPURAM_SIZE + 1024), spuram_start, spuram_start };
+  assert(bank.spuram);
+
+  // the encoded data is borrowed from the cache, so these must not be freed
+  struct sfx samples[MAX_MELODY_TRACKS][NUM_OCT];
+  int res = 0;
+  for (int i = 0; i < MAX_MELODY_TRACKS && !res; ++i) {
+    for (int j = 0; j < NUM_OCT && !res; ++j) {
+      samples[i][j] = *get_cached_sample(song.hdr.tdata[i].wave_no, j);
+      res = pack_sample(&bank, &samples[i][j]);
+      if (res == -4)
+        fprintf(stderr, "error: '%s': could not encode instrument sample %d/%d\n", name, i, j);
+      else if (res < 0)
+        fprintf(stderr, "error: '%s': ran out of SPU RAM packing instrument sample %d/%d\n", name, i, j);
+    }
+  }
+
+  struct sfx song_drums[NUM_DRUMS];
+  if (!res && with_drums && pack_drums(&bank, song_drums, song.drum_used) < 0) {
+    fprintf(stderr, "error: '%s': ran out of SPU RAM packing drums\n", name);
+    res = -5;
+  }
+
+  if (!res)
+    res = write_bank(&bank, outpath, &samples[0][0], MAX_MELODY_TRACKS * NUM_OCT, song_drums, with_drums ? NUM_DRUMS : 0);
+  if (!res)
+    printf("%s -> %s: %u bytes in %.1f ms, SNR: %.2f dB\n", inpath, outpath, bank.ptr - bank.start,
+      time_ms() - start, bank_snr(&samples[0][0], MAX_MELODY_TRACKS * NUM_OCT));
+
+  free(bank.spuram);
+  batch->results[idx] = res;
+}
+
+static int compare_names(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// converts every .org in a directory to a .bnk in another, all songs sharing one sample cache
+static int convert_batch(const char *indir, const char *outdir) {
+  DIR *dir = opendir(indir);
+  if (!dir) {
+    fprintf(stderr, "error: could not open directory '%s'\n", indir);
+    return -3;
+  }
+
+  char **names = NULL;
+  int count = 0;
+  struct dirent *ent;
+  while ((ent = readdir(dir))) {
+    const size_t len = strlen(ent->d_name);
+    if (len > 4 && !strcasecmp(ent->d_name + len - 4, ".org")) {
+      names = realloc(names, sizeof(char *) * (count + 1));
+      assert(names);
+      names[count++] = strdup(ent->d_name);
+    }
+  }
+  closedir(dir);
+
+  // sort them so the log looks the same every time, at least with one job
+  qsort(names, count, sizeof(char *), compare_names);
+
+  for (int i = 0; i < NUM_WAVEFORMS; ++i)
     for (int j = 0; j < NUM_OCT; ++j)
-      fwrite(&inst[i][j].addr, sizeof(uint32_t), 1, f);
-  // write sample data
-  fwrite(spuram + spuram_start, bank_hdr.data_size, 1, f);
+      pthread_mutex_init(&wave_lock[i][j], NULL);
 
-  fclose(f);
+  struct batch batch = { indir, outdir, names, calloc(count + 1, sizeof(int)) };
+  assert(batch.results);
 
-  return 0;
+  const int jobs = num_jobs ? num_jobs : pool_num_cpus();
+  const double start = time_ms();
+  pool_run(jobs, count, convert_batch_song, &batch);
+  const double wall = time_ms() - start;
+
+  int failed = 0;
+  for (int i = 0; i < count; ++i) {
+    if (batch.results[i]) {
+      fprintf(stderr, "error: could not convert '%s'\n", names[i]);
+      ++failed;
+    }
+    free(names[i]);
+  }
+  free(names);
+  free(batch.results);
+
+  double enc_time = 0.0;
+  for (int i = 0; i < NUM_WAVEFORMS; ++i)
+    for (int j = 0; j < NUM_OCT; ++j)
+      enc_time += wave_inst[i][j].enc_time;
+
+  const int lookups = cache_hits + cache_misses;
+  printf("converted %d/%d songs in %.1f ms on %d threads (%.1f ms of encoding, encoder: %s)\n",
+    count - failed, count, wall, (jobs < count) ? jobs : count, enc_time, encoder_name());
+  printf("sample cache: %d lookups, %d hits, %d misses, %.1f%% hit rate\n",
+    lookups, cache_hits, cache_misses, lookups ? 100.0 * cache_hits / lookups : 0.0);
+
+  return failed ? -4 : 0;
+}
+
+static void usage(void) {
+  printf("usage: orgconv [options] <org_file> <wave_dat> <out_bank> [<spu_start_addr>]\n");
+  printf("       orgconv -w [options] <wave_dat> <out_bank> <org_file> [<org_file> ...]\n");
+  printf("       orgconv -b [options] <org_dir> <wave_dat> <out_dir> [<spu_start_addr>]\n");
+  printf("       orgconv -d [options] <sfx_bank> <out_bank> <org_file> [<org_file> ...]\n");
+  printf("options:\n");
+  printf("  -w, --wave-bank      make one bank with the instruments of all given songs\n");
+  printf("  -b, --batch          convert every .org in a directory, sharing encoded samples between songs\n");
+  printf("  -d, --drum-bank      make one bank with the drums (from SFX.BNK) of all given songs\n");
+  printf("  -s, --sfx-bank <bnk> add the drums each song plays from this SFX bank to its own bank\n");
+  printf("  -n, --noise <mask>   with -s or -d, leave out the drums the player has on the noise generator\n");
+  printf("  -a, --addr <addr>    SPU RAM address the bank will be loaded at (default: %u)\n", SPURAM_START);
+  printf("  -l, --short-loops    use the shortest block-aligned loops instead of lcm(wave size, 28)\n");
+  printf("  -c, --max-cents <c>  max pitch error for short loops in cents (default: %.1f)\n", DEF_MAX_CENTS);
+  printf("  -f, --fast           use the player's own fast encoder, output matches what it synthesizes\n");
+  printf("  -e, --effort <level> encoder effort: fast, default or max (default: default)\n");
+  printf("  -j, --jobs <n>       number of encoding threads, or songs at once with -b (default: one per CPU)\n");
+  printf("  -C, --cache <dir>    reuse encoded samples from, and save new ones to, a cache directory\n");
+}
+
+static void set_start_addr(const char *str) {
+  const int addr = atoi(str);
+  if (addr > SPURAM_START)
+    spuram_start = addr;
+}
+
+int main(int argc, char **argv) {
+  static const struct option long_opts[] = {
+    { "wave-bank",   no_argument,       NULL, 'w' },
+    { "batch",       no_argument,       NULL, 'b' },
+    { "drum-bank",   no_argument,       NULL, 'd' },
+    { "sfx-bank",    required_argument, NULL, 's' },
+    { "noise",       required_argument, NULL, 'n' },
+    { "addr",        required_argument, NULL, 'a' },
+    { "short-loops", no_argument,       NULL, 'l' },
+    { "max-cents",   required_argument, NULL, 'c' },
+    { "fast",        no_argument,       NULL, 'f' },
+    { "effort",      required_argument, NULL, 'e' },
+    { "jobs",        required_argument, NULL, 'j' },
+    { "cache",       required_argument, NULL, 'C' },
+    { "help",        no_argument,       NULL, 'h' },
+    { NULL,          0,                 NULL, 0   },
+  };
+
+  bool wave_bank = false;
+  bool batch = false;
+  bool drum_bank = false;
+  const char *sfx_bank = NULL;
+  psx_audio_effort_t effort;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "wbds:n:a:lc:fe:j:C:h", long_opts, NULL)) != -1) {
+    switch (opt) {
+      case 'w': wave_bank = true; break;
+      case 'b': batch = true; break;
+      case 'd': drum_bank = true; break;
+      case 's': sfx_bank = optarg; break;
+      case 'n': noise_drums = strtoul(optarg, NULL, 0); break;
+      case 'a': set_start_addr(optarg); break;
+      case 'l': short_loops = true; break;
+      case 'c': max_cents = atof(optarg); break;
+      case 'f': fast_encode = true; break;
+      case 'e':
+        if (!parse_effort(optarg, &effort)) {
+          fprintf(stderr, "error: unknown effort level '%s'\n", optarg);
+          return -1;
+        }
+        psx_audio_set_effort(effort);
+        break;
+      case 'j': num_jobs = atoi(optarg); break;
+      case 'C': if (!adpcm_cache_init(optarg)) return -1; break;
+      default: usage(); return -1;
+    }
+  }
+
+  argc -= optind;
+  argv += optind;
+
+  if (argc < 3) {
+    usage();
+    return -1;
+  }
+
+  atexit(cleanup);
+
+  if (drum_bank) {
+    if (!load_drums(argv[0]))
+      return -2;
+    return convert_drum_bank(argv + 2, argc - 2, argv[1]);
+  }
+
+  if (sfx_bank) {
+    if (!load_drums(sfx_bank))
+      return -2;
+    with_drums = true;
+  }
+
+  const char *datfname = wave_bank ? argv[0] : argv[1];
+  if (!wave_bank && argc > 3)
+    set_start_addr(argv[3]);
+
+  find_octave_loops();
+  if (short_loops)
+    print_octave_loops();
+
+  if (!load_wavetable(datfname)) {
+    fprintf(stderr, "error: could not load wavetable from '%s'\n", datfname);
+    return -2;
+  }
+
+#ifdef SAVE_WAVS
+  mkdir("orgwave");
+#endif
+
+  if (wave_bank)
+    return convert_wave_bank(argv + 2, argc - 2, argv[1]);
+  if (batch)
+    return convert_batch(argv[0], argv[2]);
+
+  return convert_song(argv[0], argv[2]);
 }
@@ -0,0 +1,980 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <math.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <strings.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define DR_WAV_IMPLEMENTATION
+#include "dr_wav.h"
+#include "libpsxav/libpsxav.h"
+#include "common.h"
+#include "spuemu.h"
+#include "reglog.h"
+#include "pool.h"
+#include "host/host.h"
+
+#include "types.h"
+#include "util.h"
+#include "spu.h"
+#include "cd.h"
+#include "org.h"
+#include "synth.h"
+#include "spumap.h"
+
+// renders songs the way the player plays them, either to WAVs or encoded to an XA file for the player's
+// XA mode; see org.h for how the XA file is laid out and cd.h for the interleave
+
+#define XA_FILLER_CHANNELS (CD_XA_INTERLEAVE - 1)
+
+// 44100 -> 37800 is 7 -> 6
+#define RESAMPLE_IN 7
+#define RESAMPLE_OUT 6
+#define RESAMPLE_TAPS 32
+#define RESAMPLE_CUTOFF 17500.0
+
+// long enough to get through the intro and into the loop of most songs
+#define GOLDEN_TICKS 2000
+
+static struct sfx_bank *bnk_sfx;
+static struct sfx_bank *bnk_drum;
+static struct sfx_bank *bnk_wave;
+static s8 *wavetable;
+
+static float resample_coef[RESAMPLE_OUT][RESAMPLE_TAPS];
+
+static int num_loops = 1;
+static const char *trace_dir; // with -w, -r writes the SPU register traces of the songs here
+
+static struct reg_log *rec_log; // gets every register write and tick while recording
+
+static const char *simd_names[] = { "none", "sse2", "avx2" };
+
+static void usage(void) {
+  printf("usage: orgrender [options] <data_dir> <song> <out_xa>\n");
+  printf("       orgrender -w [options] <data_dir> <out_dir> [<song> ...]\n");
+  printf("       orgrender -g <golden_dir> [options] <data_dir> [<song> ...]\n");
+  printf("       orgrender -n [options] <data_dir> <out_dir> [<song> ...]\n");
+  printf("       orgrender -m [options] <data_dir> [<song> ...]\n");
+  printf("       orgrender -y <bank_dir> [options] <data_dir> <wave_dat> [<song> ...]\n");
+  printf("renders <data_dir>/org/<song>.org with the banks in <data_dir>/bnk to an XA file,\n");
+  printf("or with -w to 44100 Hz WAVs, every song in <data_dir>/org if none are given;\n");
+  printf("with -g, checks the register writes and audio of every tick against <golden_dir>/<song>.gold\n");
+  printf("options:\n");
+  printf("  -w, --wav            render to <out_dir>/<song>.wav instead\n");
+  printf("  -n, --noise          render each drum from its sample and on the noise generator and compare them\n");
+  printf("  -m, --map            print the SPU RAM map with each song loaded and check it adds up\n");
+  printf("  -r, --trace <dir>    with -w, also write the SPU register writes of each song to <dir>/<song>.spt\n");
+  printf("  -y, --synth <dir>    synthesize the instruments of each song from <wave_dat> like the player does\n");
+  printf("                       and check them against the banks orgconv -b -f made in <dir>\n");
+  printf("  -l, --loops <n>      with -w, play the loop this many times (default: 1)\n");
+  printf("  -g, --golden <dir>   check songs against the goldens in <dir>\n");
+  printf("  -u, --update         with -g, record new goldens instead of checking\n");
+  printf("  -t, --ticks <n>      with -u, ticks to record (default: %d)\n", GOLDEN_TICKS);
+  printf("  -j, --jobs <n>       with -g, songs to run at once (default: number of CPUs)\n");
+  printf("  -e, --effort <level> encoder effort: fast, default or max (default: default)\n");
+  printf("  -s, --simd <level>   mixer instruction set: none, sse2 or avx2 (default: best supported)\n");
+}
+
+// loads the banks the same way the player does
+static void load_banks(void) {
+  spu_init();
+  // songs only need SFX.BNK for the drums, and not even that with a drum bank
+  if (cd_fexists("\\BNK\\DRUM.BNK;1"))
+    bnk_drum = load_sfx_bank("\\BNK\\DRUM.BNK;1");
+  else
+    bnk_sfx = load_sfx_bank("\\BNK\\SFX.BNK;1");
+  if (cd_fexists("\\BNK\\WAVE.BNK;1"))
+    bnk_wave = load_sfx_bank("\\BNK\\WAVE.BNK;1");
+  else if (cd_fexists("\\WAVE.DAT;1"))
+    wavetable = load_file("\\WAVE.DAT;1", NULL);
+  org_init(bnk_drum ? bnk_drum : bnk_sfx, bnk_wave, wavetable);
+}
+
+// runs the sequencer until at least `frames` frames are rendered, tick n starting at frame n * num / den;
+// out needs room for one more tick's worth, returns the number of ticks
+static uint32_t render_ticks(org_state_t *org, int16_t *out, const uint32_t frames, const uint64_t num, const uint64_t den) {
+  uint32_t rendered = 0;
+  uint32_t ticks = 0;
+  while (rendered < frames) {
+    if (rec_log)
+      reglog_tick(rec_log);
+    spu_trace_tick();
+    org_tick(org);
+    ++ticks;
+    const uint32_t next = ticks * num / den;
+    spuemu_render(out + rendered * 2, next - rendered);
+    rendered = next;
+  }
+  return ticks;
+}
+
+// windowed sinc, one set of taps for every output phase
+static void init_resampler(void) {
+  const double fc = 2.0 * RESAMPLE_CUTOFF / SPUEMU_FREQ;
+  for (int p = 0; p < RESAMPLE_OUT; ++p) {
+    double sum = 0.0;
+    for (int t = 0; t < RESAMPLE_TAPS; ++t) {
+      const double d = t - RESAMPLE_TAPS / 2 + 1 - (double)p / RESAMPLE_OUT;
+      const double x = M_PI * fc * d;
+      const double sinc = (d == 0.0) ? 1.0 : sin(x) / x;
+      const double w = 0.42 + 0.5 * cos(M_PI * d / (RESAMPLE_TAPS / 2)) + 0.08 * cos(2.0 * M_PI * d / (RESAMPLE_TAPS / 2));
+      resample_coef[p][t] = fc * sinc * w;
+      sum += resample_coef[p][t];
+    }
+    for (int t = 0; t < RESAMPLE_TAPS; ++t)
+      resample_coef[p][t] /= sum;
+  }
+}
+
+// stereo, `in` has to have RESAMPLE_TAPS frames past what the last output frame needs
+static void resample(const int16_t *in, int16_t *out, const uint32_t out_frames) {
+  for (uint32_t m = 0; m < out_frames; ++m) {
+    const uint32_t pos = m * RESAMPLE_IN;
+    const int base = pos / RESAMPLE_OUT - RESAMPLE_TAPS / 2 + 1;
+    const float *coef = resample_coef[pos % RESAMPLE_OUT];
+    for (int c = 0; c < 2; ++c) {
+      float acc = 0.f;
+      for (int t = 0; t < RESAMPLE_TAPS; ++t) {
+        if (base + t >= 0)
+          acc += in[(base + t) * 2 + c] * coef[t];
+      }
+      const int s = lrintf(acc);
+      out[m * 2 + c] = (s > 0x7FFF) ? 0x7FFF : (s < -0x8000) ? -0x8000 : s;
+    }
+  }
+}
+
+// renders a song to XA, decodes it again and prints the SNR
+static int convert_xa(const char *song, const char *outfname) {
+  org_info_t info;
+  if (!org_get_info(song, &info)) {
+    fprintf(stderr, "error: could not read song '%s'\n", song);
+    return -2;
+  }
+  if (info.repeat_x < 0 || info.end_x <= info.repeat_x) {
+    fprintf(stderr, "error: song '%s' has no loop (%d-%d)\n", song, info.repeat_x, info.end_x);
+    return -2;
+  }
+
+  org_state_t *org = org_load(song, SPU_ALL_VOICES);
+  if (!org) {
+    fprintf(stderr, "error: could not load song '%s'\n", song);
+    return -2;
+  }
+
+  // tick n starts at frame n * loop_frames / loop_ticks, which makes the loop exactly
+  // loop_frames long; the intro is padded so that the loop starts on a sector boundary
+  const uint64_t loop_ticks = info.end_x - info.repeat_x;
+  const uint64_t loop_frames = (uint64_t)org_xa_loop_sectors(&info) * ORG_XA_SECTOR_FRAMES;
+  const uint64_t repeat_frame = info.repeat_x * loop_frames / loop_ticks;
+  const uint32_t pad = (ORG_XA_SECTOR_FRAMES - repeat_frame % ORG_XA_SECTOR_FRAMES) % ORG_XA_SECTOR_FRAMES;
+  const uint32_t song_frames = info.end_x * loop_frames / loop_ticks;
+  const uint32_t num_frames = pad + song_frames;
+  const double exact_frames = (double)loop_ticks * org_wait_to_timer(info.wait) * ORG_XA_FREQ / ORG_TIMER_FREQ;
+
+  // render at the SPU's rate, on past the end into the loop for the resampler
+  const double start = time_ms();
+  const uint32_t render_frames = (uint64_t)song_frames * RESAMPLE_IN / RESAMPLE_OUT + RESAMPLE_TAPS;
+  const uint32_t max_tick_frames = loop_frames * RESAMPLE_IN / RESAMPLE_OUT / loop_ticks + 1;
+  int16_t *render = malloc((render_frames + max_tick_frames) * 2 * sizeof(int16_t));
+  assert(render);
+  const uint32_t ticks = render_ticks(org, render, render_frames, loop_frames * RESAMPLE_IN, loop_ticks * RESAMPLE_OUT);
+  const double render_time = time_ms() - start;
+
+  init_resampler();
+  int16_t *pcm = calloc(num_frames * 2, sizeof(int16_t));
+  assert(pcm);
+  resample(render, pcm + pad * 2, song_frames);
+  free(render);
+
+  psx_audio_xa_settings_t settings = {
+    .format = PSX_AUDIO_XA_FORMAT_XA,
+    .stereo = true,
+    .frequency = PSX_AUDIO_XA_FREQ_DOUBLE,
+    .bits_per_sample = 4,
+    .file_number = CD_XA_FILE,
+    .channel_number = 0,
+  };
+  const double enc_start = time_ms();
+  const uint32_t sector_size = psx_audio_xa_get_buffer_size_per_sector(settings);
+  uint8_t *xa = malloc(psx_audio_xa_get_buffer_size(settings, num_frames));
+  assert(xa);
+  const int xa_len = psx_audio_xa_encode_simple(settings, pcm, num_frames, xa);
+  const uint32_t num_sectors = xa_len / sector_size;
+  const double enc_time = time_ms() - enc_start;
+
+  // the other channels of the interleave are silent
+  static uint8_t filler[XA_FILLER_CHANNELS][2352];
+  static int16_t silence[ORG_XA_SECTOR_FRAMES * 2];
+  for (int i = 0; i < XA_FILLER_CHANNELS; ++i) {
+    psx_audio_encoder_state_t state = { 0 };
+    settings.channel_number = i + 1;
+    psx_audio_xa_encode(settings, &state, silence, ORG_XA_SECTOR_FRAMES, filler[i]);
+  }
+
+  FILE *f = fopen(outfname, "wb");
+  if (!f) {
+    fprintf(stderr, "error: could not open '%s' for writing\n", outfname);
+    free(xa);
+    free(pcm);
+    org_free(org);
+    return -3;
+  }
+  for (uint32_t i = 0; i < num_sectors; ++i) {
+    fwrite(xa + i * sector_size, sector_size, 1, f);
+    for (int j = 0; j < XA_FILLER_CHANNELS; ++j)
+      fwrite(filler[j], sector_size, 1, f);
+  }
+  fclose(f);
+
+  // decode it again and compare with what went in
+  int16_t *dec = malloc(num_sectors * ORG_XA_SECTOR_FRAMES * 2 * sizeof(int16_t));
+  assert(dec);
+  const int dec_len = psx_audio_xa_decode_simple(settings.format, xa, xa_len, dec);
+  double signal = 0.0, noise = 0.0;
+  for (uint32_t i = 0; i < num_frames * 2 && i < (uint32_t)dec_len; ++i) {
+    const double err = dec[i] - pcm[i];
+    signal += (double)pcm[i] * pcm[i];
+    noise += err * err;
+  }
+
+  printf("%s: %u ticks, loop %d-%d, tempo %+.3f%% to fit the loop in %u sectors\n",
+    song, ticks, info.repeat_x, info.end_x, 100.0 * (exact_frames / loop_frames - 1.0), org_xa_loop_sectors(&info));
+  printf("rendered %.1f s of audio in %.1f ms, encoded in %.1f ms (effort: %s)\n",
+    (double)num_frames / ORG_XA_FREQ, render_time, enc_time, effort_name(psx_audio_get_effort()));
+  printf("%s: %u sectors (%u with interleave), loop from sector %u, %u frames of lead-in\n",
+    outfname, num_sectors, num_sectors * CD_XA_INTERLEAVE, num_sectors - org_xa_loop_sectors(&info), pad);
+  printf("SNR: %.2f dB\n", snr_db(signal, noise));
+
+  free(dec);
+  free(xa);
+  free(pcm);
+  org_free(org);
+  spu_clear_all_voices();
+
+  if (dec_len != (int)(num_sectors * ORG_XA_SECTOR_FRAMES * 2)) {
+    fprintf(stderr, "error: decoded %d samples, expected %u\n", dec_len, num_sectors * ORG_XA_SECTOR_FRAMES * 2);
+    return -4;
+  }
+
+  return 0;
+}
+
+// renders a song with the intro and num_loops loops and the tracks in `mute` muted, NULL if it doesn't load
+static int16_t *render_song(const char *song, const u16 mute, uint32_t *out_frames) {
+  org_info_t info;
+  org_state_t *org = org_get_info(song, &info) ? org_load(song, SPU_ALL_VOICES) : NULL;
+  if (!org) {
+    fprintf(stderr, "error: could not load song '%s'\n", song);
+    spu_trace_stop();
+    return NULL;
+  }
+  org_set_mute_mask(org, mute);
+
+  uint32_t ticks = info.end_x;
+  if (info.repeat_x >= 0 && info.end_x > info.repeat_x)
+    ticks += (num_loops - 1) * (info.end_x - info.repeat_x);
+
+  // tick n starts at frame n * timer ticks per tick * 44100 / 15625
+  const uint64_t num = (uint64_t)org_wait_to_timer(info.wait) * SPUEMU_FREQ;
+  const uint64_t den = ORG_TIMER_FREQ;
+  const uint32_t frames = ticks * num / den;
+  int16_t *pcm = malloc((frames + num / den + 1) * 2 * sizeof(int16_t));
+  assert(pcm);
+  render_ticks(org, pcm, frames, num, den);
+  // a trace only has the song, not the cleaning up after it
+  spu_trace_stop();
+  org_free(org);
+  spu_clear_all_voices();
+
+  *out_frames = frames;
+  return pcm;
+}
+
+static bool write_wav(const char *fname, const int16_t *pcm, const uint32_t frames) {
+  drwav_data_format fmt = {
+    .container = drwav_container_riff,
+    .format = DR_WAVE_FORMAT_PCM,
+    .channels = 2,
+    .sampleRate = SPUEMU_FREQ,
+    .bitsPerSample = 16,
+  };
+  drwav wav;
+  if (!drwav_init_file_write(&wav, fname, &fmt, NULL)) {
+    fprintf(stderr, "error: could not open '%s' for writing\n", fname);
+    return false;
+  }
+  drwav_write_pcm_frames(&wav, frames, pcm);
+  drwav_uninit(&wav);
+  return true;
+}
+
+// renders a song to a WAV, returns the length in seconds or < 0
+static double render_wav(const char *song, const char *outdir) {
+  char fname[2048];
+  if (trace_dir) {
+    snprintf(fname, sizeof(fname), "%s/%s.spt", trace_dir, song);
+    if (!spu_trace_start(fname))
+      return -3.0;
+  }
+  uint32_t frames;
+  int16_t *pcm = render_song(song, 0, &frames);
+  if (!pcm)
+    return -2.0;
+
+  snprintf(fname, sizeof(fname), "%s/%s.wav", outdir, song);
+  const bool ok = write_wav(fname, pcm, frames);
+  free(pcm);
+
+  return ok ? (double)frames / SPUEMU_FREQ : -3.0;
+}
+
+static int compare_names(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// every .org in a directory, without the extension
+static char **find_songs(const char *dir, int *count) {
+  char path[2048];
+  snprintf(path, sizeof(path), "%s/org", dir);
+  DIR *d = opendir(path);
+  if (!d) {
+    fprintf(stderr, "error: could not open directory '%s'\n", path);
+    return NULL;
+  }
+
+  char **names = NULL;
+  struct dirent *ent;
+  *count = 0;
+  while ((ent = readdir(d))) {
+    const size_t len = strlen(ent->d_name);
+    if (len > 4 && !strcasecmp(ent->d_name + len - 4, ".org")) {
+      names = realloc(names, sizeof(char *) * (*count + 1));
+      assert(names);
+      names[*count] = strndup(ent->d_name, len - 4);
+      ++*count;
+    }
+  }
+  closedir(d);
+
+  qsort(names, *count, sizeof(char *), compare_names);
+  return names;
+}
+
+static int convert_wavs(const char *datadir, const char *outdir, char **songs, int count) {
+  char **found = NULL;
+  if (!count) {
+    songs = found = find_songs(datadir, &count);
+    if (!songs)
+      return -3;
+  }
+
+  int failed = 0;
+  double total_len = 0.0;
+  const double start = time_ms();
+  for (int i = 0; i < count; ++i) {
+    const double song_start = time_ms();
+    const double len = render_wav(songs[i], outdir);
+    const double song_time = time_ms() - song_start;
+    if (len < 0.0) {
+      ++failed;
+      continue;
+    }
+    total_len += len;
+    printf("%s: %.1f s in %.1f ms (%.0fx realtime)\n", songs[i], len, song_time, len * 1000.0 / song_time);
+  }
+  const double wall = time_ms() - start;
+
+  printf("rendered %d/%d songs, %.1f s of audio in %.1f ms (%.0fx realtime, mixer: %s)\n",
+    count - failed, count, total_len, wall, total_len * 1000.0 / wall, simd_names[spuemu_get_simd()]);
+
+  if (found) {
+    for (int i = 0; i < count; ++i)
+      free(found[i]);
+    free(found);
+  }
+
+  return failed ? -4 : 0;
+}
+
+// loudness of a render in dB full scale, over everything and in three bands split by one-pole lowpasses
+// at 300 Hz and 3 kHz, enough to tell a hat from a hiss and a kick from a rumble
+#define NUM_BANDS 3
+
+static void measure_levels(const int16_t *pcm, const uint32_t frames, double *total, double *bands) {
+  const double a1 = 1.0 - exp(-2.0 * M_PI * 300.0 / SPUEMU_FREQ);
+  const double a2 = 1.0 - exp(-2.0 * M_PI * 3000.0 / SPUEMU_FREQ);
+  double lp1 = 0.0, lp2 = 0.0;
+  double sum = 0.0, sum_band[NUM_BANDS] = { 0.0 };
+  for (uint32_t i = 0; i < frames; ++i) {
+    const double x = (pcm[i * 2] + pcm[i * 2 + 1]) / 65536.0;
+    lp1 += a1 * (x - lp1);
+    lp2 += a2 * (x - lp2);
+    sum += x * x;
+    sum_band[0] += lp1 * lp1;
+    sum_band[1] += (lp2 - lp1) * (lp2 - lp1);
+    sum_band[2] += (x - lp2) * (x - lp2);
+  }
+  const double n = frames ? frames : 1;
+  *total = 10.0 * log10(sum / n + 1e-12);
+  for (int b = 0; b < NUM_BANDS; ++b)
+    bands[b] = 10.0 * log10(sum_band[b] / n + 1e-12);
+}
+
+// renders every drum of every song on its own, once from its sample and once on the noise generator,
+// writes both to <out_dir>/<song>_drum<n>_{sample,noise}.wav and prints how far apart they are
+static int compare_noise_drums(const char *datadir, const char *outdir, char **songs, int count) {
+  char **found = NULL;
+  if (!count) {
+    songs = found = find_songs(datadir, &count);
+    if (!songs)
+      return -3;
+  }
+
+  static const char *band_names[NUM_BANDS] = { "low", "mid", "high" };
+  const u8 old_mask = org_get_noise_drums();
+  const int melody = ORG_MAX_TRACKS - ORG_NUM_DRUMS;
+  int failed = 0;
+  for (int i = 0; i < count; ++i) {
+    for (int d = 0; d < ORG_NUM_DRUMS; ++d) {
+      const u16 mute = ~(1u << (melody + d));
+      int16_t *pcm[2];
+      uint32_t frames[2];
+      double total[2], bands[2][NUM_BANDS];
+      for (int noise = 0; noise < 2; ++noise) {
+        org_set_noise_drums(noise ? (1 << d) : 0);
+        pcm[noise] = render_song(songs[i], mute, &frames[noise]);
+        if (pcm[noise])
+          measure_levels(pcm[noise], frames[noise], &total[noise], bands[noise]);
+      }
+      org_set_noise_drums(old_mask);
+      if (!pcm[0] || !pcm[1]) {
+        free(pcm[0]);
+        free(pcm[1]);
+        ++failed;
+        break;
+      }
+
+      // both silent: the song doesn't play this drum
+      if (total[0] > -100.0 || total[1] > -100.0) {
+        char fname[2048];
+        snprintf(fname, sizeof(fname), "%s/%s_drum%d_sample.wav", outdir, songs[i], d);
+        write_wav(fname, pcm[0], frames[0]);
+        snprintf(fname, sizeof(fname), "%s/%s_drum%d_noise.wav", outdir, songs[i], d);
+        write_wav(fname, pcm[1], frames[1]);
+
+        // the mean band difference is a rough "how different does it sound", the total one is how much louder
+        double dist = 0.0;
+        printf("%s drum %d: sample %6.1f dB, noise %6.1f dB |", songs[i], d, total[0], total[1]);
+        for (int b = 0; b < NUM_BANDS; ++b) {
+          printf(" %s %+5.1f", band_names[b], bands[1][b] - bands[0][b]);
+          dist += fabs(bands[1][b] - bands[0][b]);
+        }
+        printf(" | difference %.1f dB\n", dist / NUM_BANDS);
+      }
+      free(pcm[0]);
+      free(pcm[1]);
+    }
+  }
+
+  if (found) {
+    for (int i = 0; i < count; ++i)
+      free(found[i]);
+    free(found);
+  }
+
+  return failed ? -4 : 0;
+}
+
+static void print_spu_map(void) {
+  u32 count;
+  const spumap_region_t *regions = spumap_get_regions(&count);
+  for (u32 i = 0; i < count; ++i) {
+    const spumap_region_t *r = &regions[i];
+    const u32 samples = spumap_get_samples(r, NULL, 0);
+    printf("  %s%-5s %-12s 0x%05X-0x%05X %6u bytes", r->nested ? "  " : "", spumap_kind_name(r->kind), r->name,
+      r->addr, r->addr + r->len, r->len);
+    if (r->kind == SPUMAP_POOL || r->kind == SPUMAP_SLOT)
+      printf(", %u used", r->used);
+    if (samples)
+      printf(", %u samples", samples);
+    printf("\n");
+  }
+  spumap_stats_t st;
+  spumap_get_stats(&st);
+  printf("  used %u, free %u in %u gaps, largest %u, %u%% fragmented, spuram_ptr 0x%05X\n",
+    st.used, st.free, st.num_gaps, st.largest_gap, st.fragmentation, st.ptr);
+}
+
+// what's below spuram_ptr has to be in the map and nothing in it may overlap or be past it
+static bool check_spu_map(const char *what) {
+  u32 count;
+  const spumap_region_t *regions = spumap_get_regions(&count);
+  spumap_stats_t st;
+  spumap_get_stats(&st);
+  bool ok = true;
+  if (st.overlaps) {
+    printf("%s: FAIL, %u regions overlap\n", what, st.overlaps);
+    ok = false;
+  }
+  u32 end = SPU_RAM_START;
+  for (u32 i = 0; i < count; ++i) {
+    if (regions[i].nested)
+      continue;
+    if (regions[i].addr + regions[i].len > st.ptr) {
+      printf("%s: FAIL, %s '%s' ends at 0x%05X, past spuram_ptr 0x%05X\n", what,
+        spumap_kind_name(regions[i].kind), regions[i].name, regions[i].addr + regions[i].len, st.ptr);
+      ok = false;
+    }
+    if (regions[i].addr + regions[i].len > end)
+      end = regions[i].addr + regions[i].len;
+  }
+  if (end != st.ptr) {
+    printf("%s: FAIL, spuram_ptr is 0x%05X but the map ends at 0x%05X\n", what, st.ptr, end);
+    ok = false;
+  }
+  return ok;
+}
+
+// loads every song, checks the SPU RAM map with it loaded and that freeing it gives everything back
+static int check_spu_maps(const char *datadir, char **songs, int count) {
+  char **found = NULL;
+  if (!count) {
+    songs = found = find_songs(datadir, &count);
+    if (!songs)
+      return -3;
+  }
+
+  printf("banks:\n");
+  print_spu_map();
+  int failed = !check_spu_map("banks");
+  u32 base_count;
+  spumap_get_regions(&base_count);
+  const u32 base_ptr = spuram_ptr;
+
+  for (int i = 0; i < count; ++i) {
+    org_state_t *org = org_load(songs[i], SPU_ALL_VOICES);
+    if (!org) {
+      fprintf(stderr, "error: could not load song '%s'\n", songs[i]);
+      ++failed;
+      continue;
+    }
+    printf("%s:\n", songs[i]);
+    print_spu_map();
+    bool ok = check_spu_map(songs[i]);
+    org_free(org);
+    u32 left;
+    spumap_get_regions(&left);
+    if (left != base_count || spuram_ptr != base_ptr) {
+      printf("%s: FAIL, %u regions and spuram_ptr 0x%05X after freeing it, %u and 0x%05X before\n",
+        songs[i], left, spuram_ptr, base_count, base_ptr);
+      ok = false;
+    }
+    failed += !ok;
+  }
+
+  if (found) {
+    for (int i = 0; i < count; ++i)
+      free(found[i]);
+    free(found);
+  }
+
+  return failed ? -4 : 0;
+}
+
+// a bank orgconv wrote: the addresses of its samples and its data, which starts at the lowest one
+static uint8_t *read_bank(const char *fname, uint32_t *num_sfx, uint32_t **addr, uint32_t *data_len) {
+  FILE *f = fopen(fname, "rb");
+  if (!f) {
+    fprintf(stderr, "error: could not open '%s'\n", fname);
+    return NULL;
+  }
+  uint32_t hdr[2];
+  uint8_t *data = NULL;
+  *addr = NULL;
+  if (fread(hdr, sizeof(hdr), 1, f) == 1 && hdr[1] > 0 && hdr[1] <= MAX_SFX) {
+    *data_len = hdr[0];
+    *num_sfx = hdr[1];
+    *addr = malloc(hdr[1] * sizeof(uint32_t));
+    data = malloc(hdr[0] ? hdr[0] : 1);
+    assert(*addr && data);
+    if (fread(*addr, sizeof(uint32_t), hdr[1], f) != hdr[1] || fread(data, 1, hdr[0], f) != hdr[0]) {
+      free(data);
+      data = NULL;
+    }
+  }
+  fclose(f);
+  if (!data) {
+    fprintf(stderr, "error: '%s' is not a valid bank\n", fname);
+    free(*addr);
+  }
+  return data;
+}
+
+static uint32_t lowest_addr(const uint32_t *addr, const uint32_t count) {
+  uint32_t low = UINT32_MAX;
+  for (uint32_t i = 0; i < count; ++i)
+    if (addr[i] && addr[i] < low)
+      low = addr[i];
+  return low;
+}
+
+// returns 0 if what the player synthesized for the song matches the bank, 1 if not, 2 on error
+static int check_synth_song(const char *song, const char *bankdir) {
+  char fname[2048];
+  snprintf(fname, sizeof(fname), "%s/%s.bnk", bankdir, song);
+  uint32_t num_sfx, data_len, *addr;
+  uint8_t *data = read_bank(fname, &num_sfx, &addr, &data_len);
+  if (!data)
+    return 2;
+
+  org_state_t *org = org_load(song, SPU_ALL_VOICES);
+  if (!org) {
+    fprintf(stderr, "error: could not load song '%s'\n", song);
+    free(data);
+    free(addr);
+    return 2;
+  }
+
+  // the instruments it just synthesized are the last ones in the map
+  u32 count;
+  const spumap_region_t *regions = spumap_get_regions(&count);
+  const spumap_region_t *synth = NULL;
+  for (u32 i = 0; i < count; ++i)
+    if (regions[i].kind == SPUMAP_SYNTH)
+      synth = &regions[i];
+
+  int ret = 0;
+  if (!synth) {
+    printf("%s: FAIL, the player didn't synthesize its instruments\n", song);
+    ret = 1;
+  } else if (synth->bank->num_sfx != num_sfx || synth->len != data_len) {
+    printf("%s: FAIL, the player made %u samples in %u bytes, orgconv %u in %u\n",
+      song, synth->bank->num_sfx, synth->len, num_sfx, data_len);
+    ret = 1;
+  } else {
+    // either of them can be anywhere in SPU RAM, so the addresses are compared from where each one starts
+    const uint32_t start = lowest_addr(addr, num_sfx);
+    uint8_t *spuram = malloc(data_len ? data_len : 1);
+    assert(spuram);
+    spuemu_read_ram(synth->addr, spuram, data_len);
+    for (uint32_t i = 0; i < num_sfx && !ret; ++i) {
+      const uint32_t got = synth->bank->sfx_addr[i] ? synth->bank->sfx_addr[i] - synth->addr : UINT32_MAX;
+      const uint32_t expected = addr[i] ? addr[i] - start : UINT32_MAX;
+      if (got != expected) {
+        printf("%s: FAIL, sample %u is at +%d in the player, +%d from orgconv\n", song, i, (int)got, (int)expected);
+        ret = 1;
+      }
+    }
+    for (uint32_t i = 0; i < data_len && !ret; ++i) {
+      if (spuram[i] != data[i]) {
+        printf("%s: FAIL at byte %u (block %u): 0x%02X in the player, 0x%02X from orgconv\n",
+          song, i, i / 16, spuram[i], data[i]);
+        ret = 1;
+      }
+    }
+    if (!ret)
+      printf("%s: ok, %u samples, %u bytes\n", song, num_sfx, data_len);
+    free(spuram);
+  }
+
+  org_free(org);
+  free(data);
+  free(addr);
+  return ret;
+}
+
+// the instruments the player synthesizes from a wavetable have to be exactly what orgconv -f makes of it;
+// checks every song against <bank_dir>/<song>.bnk
+static int check_synth(const char *datadir, const char *wavefname, const char *bankdir, char **songs, int count) {
+  FILE *f = fopen(wavefname, "rb");
+  static s8 synth_wave[SYNTH_NUM_WAVEFORMS * SYNTH_WAVEFORM_LEN];
+  const bool ok = f && fread(synth_wave, sizeof(synth_wave), 1, f) == 1;
+  if (f)
+    fclose(f);
+  if (!ok) {
+    fprintf(stderr, "error: could not read a wavetable from '%s'\n", wavefname);
+    return -2;
+  }
+  // and not from WAVE.BNK, even if there is one
+  org_init(bnk_drum ? bnk_drum : bnk_sfx, NULL, synth_wave);
+
+  char **found = NULL;
+  if (!count) {
+    songs = found = find_songs(datadir, &count);
+    if (!songs)
+      return -3;
+  }
+
+  int failed = 0, errors = 0;
+  for (int i = 0; i < count; ++i) {
+    const int res = check_synth_song(songs[i], bankdir);
+    failed += res == 1;
+    errors += res == 2;
+  }
+  printf("%d/%d songs synthesize what orgconv -f makes, %d failed, %d errors\n", count - failed - errors, count, failed, errors);
+
+  if (found) {
+    for (int i = 0; i < count; ++i)
+      free(found[i]);
+    free(found);
+  }
+
+  return (failed || errors) ? -4 : 0;
+}
+
+static void record_write(const u32 reg, const u16 val) {
+  reglog_write(rec_log, reg, val);
+}
+
+// runs a song for `ticks` ticks in real time, logging every register write and hashing the audio
+static bool record_song(const char *song, const uint32_t ticks, struct reg_log *log) {
+  org_info_t info;
+  org_state_t *org = org_get_info(song, &info) ? org_load(song, SPU_ALL_VOICES) : NULL;
+  if (!org) {
+    fprintf(stderr, "error: could not load song '%s'\n", song);
+    return false;
+  }
+
+  const uint64_t num = (uint64_t)org_wait_to_timer(info.wait) * SPUEMU_FREQ;
+  const uint64_t den = ORG_TIMER_FREQ;
+  const uint32_t frames = ticks * num / den;
+  int16_t *pcm = malloc((frames + num / den + 1) * 2 * sizeof(int16_t));
+  assert(pcm);
+
+  reglog_init(log);
+  rec_log = log;
+  host_set_write_hook(record_write);
+  render_ticks(org, pcm, frames, num, den);
+  host_set_write_hook(NULL);
+  rec_log = NULL;
+  org_free(org);
+
+  log->audio_hash = reglog_hash(REGLOG_HASH_INIT, pcm, frames * 2 * sizeof(int16_t));
+  free(pcm);
+  return true;
+}
+
+static void print_write(const struct reg_write *w) {
+  char name[64];
+  if (w)
+    printf("%s = 0x%04X", reglog_reg_name(w->reg, name, sizeof(name)), w->val);
+  else
+    printf("nothing");
+}
+
+// returns 0 if the song matches its golden (or the golden was updated), 1 if not, 2 on error
+static int golden_song(const char *song, const char *goldendir, const bool update, const uint32_t ticks) {
+  char fname[2048];
+  snprintf(fname, sizeof(fname), "%s/%s.gold", goldendir, song);
+
+  struct reg_log expected, got;
+  if (update) {
+    if (!record_song(song, ticks, &got))
+      return 2;
+    const bool ok = reglog_save(&got, fname);
+    if (ok)
+      printf("%s: recorded %u ticks, %u writes\n", song, got.num_ticks, got.num_writes);
+    reglog_free(&got);
+    return ok ? 0 : 2;
+  }
+
+  if (!reglog_load(&expected, fname))
+    return 2;
+  if (!record_song(song, expected.num_ticks, &got)) {
+    reglog_free(&expected);
+    return 2;
+  }
+
+  int ret = 0;
+  struct reg_log_diff diff;
+  if (reglog_diff(&got, &expected, &diff)) {
+    printf("%s: FAIL at tick %u, write %u: got ", song, diff.tick, diff.index);
+    print_write(diff.a);
+    printf(", expected ");
+    print_write(diff.b);
+    printf("\n");
+    ret = 1;
+  } else if (got.num_ticks != expected.num_ticks) {
+    printf("%s: FAIL, ran %u ticks, expected %u\n", song, got.num_ticks, expected.num_ticks);
+    ret = 1;
+  } else if (got.audio_hash != expected.audio_hash) {
+    printf("%s: FAIL, register writes match but the audio doesn't (hash %016llx, expected %016llx)\n",
+      song, (unsigned long long)got.audio_hash, (unsigned long long)expected.audio_hash);
+    ret = 1;
+  } else {
+    printf("%s: ok, %u ticks, %u writes\n", song, got.num_ticks, got.num_writes);
+  }
+
+  reglog_free(&expected);
+  reglog_free(&got);
+  return ret;
+}
+
+// every song runs in its own process from the state right after load_banks(), since the sequencer
+// and the emulator are global; that also lets them run in parallel
+static int check_goldens(const char *datadir, const char *goldendir, char **songs, int count,
+    const bool update, const uint32_t ticks, int jobs) {
+#ifdef _WIN32
+  (void)datadir; (void)goldendir; (void)songs; (void)count; (void)update; (void)ticks; (void)jobs;
+  fprintf(stderr, "error: golden checks need fork()\n");
+  return -1;
+#else
+  char **found = NULL;
+  if (!count) {
+    songs = found = find_songs(datadir, &count);
+    if (!songs)
+      return -3;
+  }
+
+  if (update)
+    mkdir(goldendir, 0777);
+
+  if (jobs < 1)
+    jobs = pool_num_cpus();
+
+  int failed = 0, errors = 0, running = 0;
+  const double start = time_ms();
+  for (int i = 0; i < count || running; ) {
+    if (i < count && running < jobs) {
+      fflush(stdout);
+      fflush(stderr);
+      const pid_t pid = fork();
+      if (pid == 0)
+        exit(golden_song(songs[i], goldendir, update, ticks));
+      if (pid < 0) {
+        fprintf(stderr, "error: could not start a process for '%s'\n", songs[i]);
+        ++errors;
+      } else {
+        ++running;
+      }
+      ++i;
+      continue;
+    }
+    int status;
+    if (wait(&status) < 0)
+      break;
+    --running;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) > 1)
+      ++errors;
+    else if (WEXITSTATUS(status))
+      ++failed;
+  }
+  const double wall = time_ms() - start;
+
+  if (update)
+    printf("recorded %d/%d goldens in %.1f ms\n", count - errors, count, wall);
+  else
+    printf("%d/%d songs match their goldens, %d failed, %d errors in %.1f ms\n",
+      count - failed - errors, count, failed, errors, wall);
+
+  if (found) {
+    for (int i = 0; i < count; ++i)
+      free(found[i]);
+    free(found);
+  }
+
+  return (failed || errors) ? -4 : 0;
+#endif
+}
+
+int main(int argc, char **argv) {
+  static const struct option long_opts[] = {
+    { "wav",    no_argument,       NULL, 'w' },
+    { "noise",  no_argument,       NULL, 'n' },
+    { "map",    no_argument,       NULL, 'm' },
+    { "trace",  required_argument, NULL, 'r' },
+    { "synth",  required_argument, NULL, 'y' },
+    { "loops",  required_argument, NULL, 'l' },
+    { "effort", required_argument, NULL, 'e' },
+    { "simd",   required_argument, NULL, 's' },
+    { "golden", required_argument, NULL, 'g' },
+    { "update", no_argument,       NULL, 'u' },
+    { "ticks",  required_argument, NULL, 't' },
+    { "jobs",   required_argument, NULL, 'j' },
+    { "help",   no_argument,       NULL, 'h' },
+    { NULL,     0,                 NULL, 0   },
+  };
+
+  bool wav = false;
+  bool noise = false;
+  bool map = false;
+  const char *synthdir = NULL;
+  const char *goldendir = NULL;
+  bool update = false;
+  int ticks = GOLDEN_TICKS;
+  int jobs = 0;
+  psx_audio_effort_t effort;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "wnmr:y:l:e:s:g:ut:j:h", long_opts, NULL)) != -1) {
+    switch (opt) {
+      case 'w': wav = true; break;
+      case 'n': noise = true; break;
+      case 'm': map = true; break;
+      case 'r': trace_dir = optarg; break;
+      case 'y': synthdir = optarg; break;
+      case 'l': num_loops = atoi(optarg); if (num_loops < 1) num_loops = 1; break;
+      case 'g': goldendir = optarg; break;
+      case 'u': update = true; break;
+      case 't': ticks = atoi(optarg); if (ticks < 1) ticks = 1; break;
+      case 'j': jobs = atoi(optarg); break;
+      case 'e':
+        if (!parse_effort(optarg, &effort)) {
+          fprintf(stderr, "error: unknown effort level '%s'\n", optarg);
+          return -1;
+        }
+        psx_audio_set_effort(effort);
+        break;
+      case 's': {
+        int level = PSX_AUDIO_SIMD_NONE;
+        while (level <= PSX_AUDIO_SIMD_AVX2 && strcmp(optarg, simd_names[level]))
+          ++level;
+        if (level > PSX_AUDIO_SIMD_AVX2) {
+          fprintf(stderr, "error: unknown SIMD level '%s'\n", optarg);
+          return -1;
+        }
+        spuemu_set_simd(level);
+        break;
+      }
+      default: usage(); return -1;
+    }
+  }
+
+  argc -= optind;
+  argv += optind;
+
+  if (argc < ((goldendir || map) ? 1 : (wav || noise || synthdir) ? 2 : 3)) {
+    usage();
+    return -1;
+  }
+
+  host_init(argv[0]);
+  load_banks();
+
+  if (goldendir)
+    return check_goldens(argv[0], goldendir, argv + 1, argc - 1, update, ticks, jobs);
+
+  if (map)
+    return check_spu_maps(argv[0], argv + 1, argc - 1);
+
+  if (synthdir)
+    return check_synth(argv[0], argv[1], synthdir, argv + 2, argc - 2);
+
+  if (noise)
+    return compare_noise_drums(argv[0], argv[1], argv + 2, argc - 2);
+
+  if (wav)
+    return convert_wavs(argv[0], argv[1], argv + 2, argc - 2);
+
+  return convert_xa(argv[1], argv[2]);
+}
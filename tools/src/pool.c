@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+#define MAX_JOBS 64
+
+struct range {
+  pthread_mutex_t lock;
+  int next; // next index to run
+  int end;  // one past the last index
+};
+
+struct pool {
+  struct range ranges[MAX_JOBS];
+  int jobs;
+  pool_fn_t fn;
+  void *arg;
+};
+
+struct worker {
+  struct pool *pool;
+  int id;
+};
+
+int pool_num_cpus(void) {
+  const long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n > 0) ? (int)n : 1;
+}
+
+// takes an index from the front of a range, returns -1 if it's empty
+static int range_pop(struct range *r) {
+  int idx = -1;
+  pthread_mutex_lock(&r->lock);
+  if (r->next < r->end)
+    idx = r->next++;
+  pthread_mutex_unlock(&r->lock);
+  return idx;
+}
+
+// moves the back half of the fullest other range into ours, returns false if there's nothing left
+static int range_steal(struct pool *pool, const int id) {
+  for (;;) {
+    int victim = -1;
+    int most = 0;
+    for (int i = 0; i < pool->jobs; ++i) {
+      if (i == id)
+        continue;
+      pthread_mutex_lock(&pool->ranges[i].lock);
+      const int left = pool->ranges[i].end - pool->ranges[i].next;
+      pthread_mutex_unlock(&pool->ranges[i].lock);
+      if (left > most) {
+        most = left;
+        victim = i;
+      }
+    }
+    if (victim < 0)
+      return 0;
+
+    struct range *r = &pool->ranges[victim];
+    int lo = 0, hi = 0;
+    pthread_mutex_lock(&r->lock);
+    const int left = r->end - r->next;
+    if (left > 0) {
+      hi = r->end;
+      lo = r->end - (left + 1) / 2;
+      r->end = lo;
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    if (hi > lo) {
+      struct range *own = &pool->ranges[id];
+      pthread_mutex_lock(&own->lock);
+      own->next = lo;
+      own->end = hi;
+      pthread_mutex_unlock(&own->lock);
+      return 1;
+    }
+    // someone else got there first, look again
+  }
+}
+
+static void *worker_main(void *arg) {
+  struct worker *w = arg;
+  struct pool *pool = w->pool;
+  do {
+    int idx;
+    while ((idx = range_pop(&pool->ranges[w->id])) >= 0)
+      pool->fn(idx, pool->arg);
+  } while (range_steal(pool, w->id));
+  return NULL;
+}
+
+void pool_run(int jobs, const int count, pool_fn_t fn, void *arg) {
+  if (jobs > count) jobs = count;
+  if (jobs > MAX_JOBS) jobs = MAX_JOBS;
+
+  if (jobs <= 1) {
+    for (int i = 0; i < count; ++i)
+      fn(i, arg);
+    return;
+  }
+
+  struct pool *pool = calloc(1, sizeof(*pool));
+  assert(pool);
+  pool->jobs = jobs;
+  pool->fn = fn;
+  pool->arg = arg;
+  for (int i = 0; i < jobs; ++i) {
+    pthread_mutex_init(&pool->ranges[i].lock, NULL);
+    pool->ranges[i].next = count * i / jobs;
+    pool->ranges[i].end = count * (i + 1) / jobs;
+  }
+
+  pthread_t threads[MAX_JOBS];
+  struct worker workers[MAX_JOBS];
+  for (int i = 1; i < jobs; ++i) {
+    workers[i].pool = pool;
+    workers[i].id = i;
+    const int res = pthread_create(&threads[i], NULL, worker_main, &workers[i]);
+    assert(res == 0);
+  }
+
+  // the calling thread is worker 0
+  workers[0].pool = pool;
+  workers[0].id = 0;
+  worker_main(&workers[0]);
+
+  for (int i = 1; i < jobs; ++i)
+    pthread_join(threads[i], NULL);
+
+  for (int i = 0; i < jobs; ++i)
+    pthread_mutex_destroy(&pool->ranges[i].lock);
+  free(pool);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// minimal thread pool for the host tools
+
+typedef void (*pool_fn_t)(int idx, void *arg);
+
+// number of CPUs available, at least 1
+int pool_num_cpus(void);
+
+// runs fn(idx, arg) for every idx in [0, count) on up to `jobs` threads and waits for all of them;
+// each thread starts with an even slice of the indices and steals from the others once it's done
+// fn may be called in any order, so it should only write to its own idx's output
+void pool_run(int jobs, const int count, pool_fn_t fn, void *arg);
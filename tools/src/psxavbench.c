@@ -0,0 +1,563 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "libpsxav/libpsxav.h"
+#include "common.h"
+#include "synth.h"
+#include "sector_ref.h"
+
+// encodes and decodes the samples from existing banks and reports how much the round trip costs in quality and time,
+// checks the SIMD candidate kernels against the scalar one and the streaming encoders against the one-shot ones,
+// then checks and times CD-ROM sector EDC/ECC generation
+
+#define MAX_SAMPLES 1024
+// decoded ADPCM re-encodes losslessly on its original block grid, so the reference signal
+// starts half a block in to make the encoder do real work
+#define REF_OFFSET 14
+
+// random inputs the streaming encoders are checked with, and the longest one in samples
+#define STREAM_INPUTS 300
+#define STREAM_MAX_LEN 40000
+
+// random candidate lists psx_audio_check_simd() scores at every SIMD level
+#define SIMD_CHECK_LISTS 100000
+
+struct sample {
+  int16_t *pcm;  // decoded from the bank, this is the reference signal
+  uint32_t len;  // in samples
+  int loop;      // whether the last block has the repeat flag
+};
+
+struct result {
+  const char *name;
+  uint64_t pcm_bytes;
+  double enc_ms;
+  double dec_ms;
+  double signal;
+  double noise;
+  int max_err;
+  bool checked;   // whether the SIMD levels were compared for this encoder
+  bool identical; // output matches at every SIMD level
+};
+
+static const char *simd_names[] = { "none", "sse2", "avx2" };
+
+static int num_iters = 3;
+static int num_sectors = 4096;
+
+static double mb_per_sec(const uint64_t bytes, const double ms) {
+  return (ms > 0.0) ? (bytes / (1024.0 * 1024.0)) / (ms / 1000.0) : 0.0;
+}
+
+// splits a bank into its samples, each one ending at the first block with the end flag
+static int load_bank(struct sample *samples, const int max_samples, const char *fname) {
+  uint32_t size = 0;
+  FILE *f = fopen(fname, "rb");
+  if (!f)
+    return -1;
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *buf = malloc(size);
+  assert(buf);
+  const bool ok = fread(buf, size, 1, f) == 1;
+  fclose(f);
+
+  uint32_t data_size, num_sfx;
+  if (!ok || size < 8) {
+    free(buf);
+    return -1;
+  }
+  memcpy(&data_size, buf + 0, 4);
+  memcpy(&num_sfx, buf + 4, 4);
+  if (8 + num_sfx * 4 + data_size > size) {
+    free(buf);
+    return -1;
+  }
+
+  const uint32_t *addr = (const uint32_t *)(buf + 8);
+  const uint8_t *data = buf + 8 + num_sfx * 4;
+  uint32_t start = 0;
+  for (uint32_t i = 0; i < num_sfx; ++i)
+    if (addr[i] && (!start || addr[i] < start))
+      start = addr[i];
+
+  int count = 0;
+  for (uint32_t i = 0; i < num_sfx && count < max_samples; ++i) {
+    if (!addr[i] || addr[i] < start || addr[i] - start >= data_size)
+      continue;
+    const uint8_t *adpcm = data + addr[i] - start;
+    uint32_t adpcm_len = 0;
+    while (addr[i] - start + adpcm_len + 16 <= data_size) {
+      adpcm_len += 16;
+      if (adpcm[adpcm_len - 16 + 1] & PSX_AUDIO_SPU_LOOP_END)
+        break;
+    }
+    if (adpcm_len < 32)
+      continue;
+    struct sample *s = &samples[count++];
+    s->pcm = malloc(adpcm_len / 16 * 28 * sizeof(int16_t));
+    assert(s->pcm);
+    s->len = psx_audio_spu_decode_simple(adpcm, adpcm_len, s->pcm) - REF_OFFSET;
+    memmove(s->pcm, s->pcm + REF_OFFSET, s->len * sizeof(int16_t));
+    s->loop = (adpcm[adpcm_len - 16 + 1] & PSX_AUDIO_SPU_LOOP_REPEAT) == PSX_AUDIO_SPU_LOOP_REPEAT;
+  }
+
+  free(buf);
+  return count;
+}
+
+static void measure(struct result *res, struct sample *samples, const int count, const bool fast) {
+  uint32_t max_len = 0;
+  for (int i = 0; i < count; ++i)
+    if (samples[i].len > max_len)
+      max_len = samples[i].len;
+
+  uint8_t *adpcm = malloc(psx_audio_spu_get_buffer_size(max_len));
+  uint8_t *check = malloc(psx_audio_spu_get_buffer_size(max_len));
+  int16_t *pcm = malloc((max_len + 28) * sizeof(int16_t));
+  assert(adpcm && check && pcm);
+
+  const psx_audio_simd_t simd = psx_audio_get_simd();
+  res->checked = !fast;
+  res->identical = true;
+
+  for (int i = 0; i < count; ++i) {
+    const struct sample *s = &samples[i];
+    const int loop_start = s->loop ? 0 : -1;
+    int adpcm_len = 0;
+
+    double start = time_ms();
+    for (int it = 0; it < num_iters; ++it) {
+      adpcm_len = fast ?
+        (int)synth_encode_adpcm(adpcm, s->pcm, s->len, s->loop) :
+        psx_audio_spu_encode_simple(s->pcm, s->len, adpcm, loop_start);
+    }
+    res->enc_ms += (time_ms() - start) / num_iters;
+
+    start = time_ms();
+    for (int it = 0; it < num_iters; ++it)
+      psx_audio_spu_decode_simple(adpcm, adpcm_len, pcm);
+    res->dec_ms += (time_ms() - start) / num_iters;
+
+    res->pcm_bytes += s->len * sizeof(int16_t);
+    for (uint32_t n = 0; n < s->len; ++n) {
+      const int err = abs(pcm[n] - s->pcm[n]);
+      res->signal += (double)s->pcm[n] * s->pcm[n];
+      res->noise += (double)err * err;
+      if (err > res->max_err)
+        res->max_err = err;
+    }
+
+    if (fast)
+      continue;
+
+    // every lower SIMD level must produce exactly the same bytes
+    for (int level = PSX_AUDIO_SIMD_NONE; level < (int)simd; ++level) {
+      psx_audio_set_simd(level);
+      if (psx_audio_spu_encode_simple(s->pcm, s->len, check, loop_start) != adpcm_len || memcmp(check, adpcm, adpcm_len))
+        res->identical = false;
+    }
+    psx_audio_set_simd(simd);
+  }
+
+  free(pcm);
+  free(check);
+  free(adpcm);
+}
+
+struct sector_result {
+  const char *name;
+  psx_cdrom_sector_type_t type;
+  double sectors_per_sec;
+  bool edc_ok;
+  bool ecc_ok;
+};
+
+// the plain bit-at-a-time EDC, to check the table-driven one against
+static uint32_t reference_edc(const uint8_t *data, const uint32_t size) {
+  uint32_t edc = 0;
+  for (uint32_t i = 0; i < size; ++i) {
+    edc ^= data[i];
+    for (int bit = 0; bit < 8; ++bit)
+      edc = (edc >> 1) ^ (0xD8018001 * (edc & 1));
+  }
+  return edc;
+}
+
+static uint8_t gf_mul2(const uint8_t x) {
+  return (x << 1) ^ ((x & 0x80) ? 0x1D : 0);
+}
+
+// a valid RS codeword from the CD-ROM product code has both syndromes (roots 1 and 2) equal to zero;
+// this checks ECC without sharing any code with the generator
+static bool check_codeword(const uint8_t *cw, const int len) {
+  uint8_t s0 = 0;
+  uint8_t s1 = 0;
+  for (int i = 0; i < len; ++i) {
+    s0 ^= cw[i];
+    s1 = gf_mul2(s1) ^ cw[i];
+  }
+  return !s0 && !s1;
+}
+
+static bool check_ecc(const uint8_t *sector, const bool zero_header) {
+  uint8_t buf[2340];
+  uint8_t cw[45];
+  memcpy(buf, sector + 0xC, sizeof(buf));
+  if (zero_header)
+    memset(buf, 0, 4);
+
+  // P: 86 columns of 24 bytes plus 2 parity bytes, stride 86
+  for (int major = 0; major < 86; ++major) {
+    for (int minor = 0; minor < 26; ++minor)
+      cw[minor] = buf[major + minor * 86];
+    if (!check_codeword(cw, 26))
+      return false;
+  }
+
+  // Q: 52 diagonals of 43 bytes (over the data and P) plus 2 parity bytes
+  for (int major = 0; major < 52; ++major) {
+    int index = (major >> 1) * 86 + (major & 1);
+    for (int minor = 0; minor < 43; ++minor) {
+      cw[minor] = buf[index];
+      index = (index + 88) % 2236;
+    }
+    cw[43] = buf[2236 + major];
+    cw[44] = buf[2236 + 52 + major];
+    if (!check_codeword(cw, 45))
+      return false;
+  }
+
+  return true;
+}
+
+// the sectors sector_ref.h has the EDC and ECC of; only the part from the EDC on is left to the generator
+static void make_ref_sectors(uint8_t *mode1, uint8_t *form1) {
+  static const uint8_t sync[12] = { 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+  static const uint8_t subheader[4] = { 0x00, 0x00, 0x08, 0x00 };
+
+  memset(mode1, 0, PSX_CDROM_SECTOR_SIZE);
+  memcpy(mode1, sync, sizeof(sync));
+  mode1[0xC] = 0x00; mode1[0xD] = 0x02; mode1[0xE] = 0x00; mode1[0xF] = 1;
+  for (int i = 0; i < 2048; ++i)
+    mode1[0x10 + i] = i * 31 + (i >> 8);
+
+  memset(form1, 0, PSX_CDROM_SECTOR_SIZE);
+  memcpy(form1, sync, sizeof(sync));
+  form1[0xC] = 0x00; form1[0xD] = 0x02; form1[0xE] = 0x16; form1[0xF] = 2;
+  memcpy(form1 + 0x10, subheader, 4);
+  memcpy(form1 + 0x14, subheader, 4);
+  uint8_t *pvd = form1 + 0x18;
+  memcpy(pvd, "\x01" "CD001" "\x01", 7);
+  memset(pvd + 8, ' ', 64);
+  memcpy(pvd + 8, "PLAYSTATION", 11);
+  memcpy(pvd + 40, "ORGPLAY", 7);
+}
+
+// the generator's EDC and ECC byte for byte against ones that weren't made by it, see sector_ref.h;
+// returns how many of the 2 sectors match
+static int check_ref_sectors(void) {
+  uint8_t mode1[PSX_CDROM_SECTOR_SIZE];
+  uint8_t form1[PSX_CDROM_SECTOR_SIZE];
+  make_ref_sectors(mode1, form1);
+  // garbage where the checksums go, so nothing is left over from the setup
+  memset(mode1 + 0x810, 0xAA, sizeof(ref_mode1_tail));
+  memset(form1 + 0x818, 0xAA, sizeof(ref_form1_tail));
+  psx_cdrom_calculate_checksums(mode1, PSX_CDROM_SECTOR_TYPE_MODE1);
+  psx_cdrom_calculate_checksums(form1, PSX_CDROM_SECTOR_TYPE_MODE2_FORM1);
+  return !memcmp(mode1 + 0x810, ref_mode1_tail, sizeof(ref_mode1_tail))
+    + !memcmp(form1 + 0x818, ref_form1_tail, sizeof(ref_form1_tail));
+}
+
+static void measure_sectors(struct sector_result *res, const int num_sectors) {
+  uint8_t *sectors = malloc((size_t)num_sectors * PSX_CDROM_SECTOR_SIZE);
+  assert(sectors);
+
+  // random payloads with a proper sync pattern and header
+  srand(1);
+  for (int i = 0; i < num_sectors; ++i) {
+    uint8_t *sector = sectors + (size_t)i * PSX_CDROM_SECTOR_SIZE;
+    for (int j = 0; j < PSX_CDROM_SECTOR_SIZE; ++j)
+      sector[j] = rand();
+    memset(sector + 1, 0xFF, 10);
+    sector[0] = sector[11] = 0;
+    sector[0xF] = (res->type == PSX_CDROM_SECTOR_TYPE_MODE1) ? 1 : 2;
+  }
+
+  double start = time_ms();
+  for (int it = 0; it < num_iters; ++it)
+    for (int i = 0; i < num_sectors; ++i)
+      psx_cdrom_calculate_checksums(sectors + (size_t)i * PSX_CDROM_SECTOR_SIZE, res->type);
+  const double ms = (time_ms() - start) / num_iters;
+  res->sectors_per_sec = (ms > 0.0) ? num_sectors / (ms / 1000.0) : 0.0;
+
+  res->edc_ok = res->ecc_ok = true;
+  for (int i = 0; i < num_sectors; ++i) {
+    const uint8_t *sector = sectors + (size_t)i * PSX_CDROM_SECTOR_SIZE;
+    uint32_t edc, stored;
+    switch (res->type) {
+      case PSX_CDROM_SECTOR_TYPE_MODE1:
+        edc = reference_edc(sector, 0x810);
+        memcpy(&stored, sector + 0x810, 4);
+        res->ecc_ok = res->ecc_ok && check_ecc(sector, false);
+        break;
+      case PSX_CDROM_SECTOR_TYPE_MODE2_FORM1:
+        edc = reference_edc(sector + 0x10, 0x808);
+        memcpy(&stored, sector + 0x818, 4);
+        res->ecc_ok = res->ecc_ok && check_ecc(sector, true);
+        break;
+      default:
+        edc = reference_edc(sector + 0x10, 0x91C);
+        memcpy(&stored, sector + 0x92C, 4);
+        break;
+    }
+    res->edc_ok = res->edc_ok && (edc == stored);
+  }
+
+  free(sectors);
+}
+
+// feeds a stream encoder in random chunks of up to `max_chunk` frames, 0 included; returns the length
+static int feed_spu_stream(const int16_t *pcm, const int len, const int loop_start, uint8_t *out) {
+  psx_audio_spu_stream_t stream;
+  psx_audio_spu_stream_init(&stream, loop_start);
+  int out_len = 0;
+  for (int pos = 0; pos < len; ) {
+    int n = rand() % ((rand() & 1) ? 64 : 4096);
+    if (n > len - pos) n = len - pos;
+    out_len += psx_audio_spu_stream_feed(&stream, pcm + pos, n, out + out_len);
+    pos += n;
+  }
+  return out_len + psx_audio_spu_stream_flush(&stream, out + out_len);
+}
+
+static int feed_xa_stream(const int16_t *pcm, const int frames, const psx_audio_xa_settings_t settings, uint8_t *out) {
+  psx_audio_xa_stream_t stream;
+  psx_audio_xa_stream_init(&stream, settings);
+  const int channels = settings.stereo ? 2 : 1;
+  int out_len = 0;
+  for (int pos = 0; pos < frames; ) {
+    int n = rand() % ((rand() & 1) ? 64 : 8192);
+    if (n > frames - pos) n = frames - pos;
+    out_len += psx_audio_xa_stream_feed(&stream, pcm + pos * channels, n, out + out_len);
+    pos += n;
+  }
+  return out_len + psx_audio_xa_stream_flush(&stream, out + out_len);
+}
+
+// the streaming encoders have to give the same bytes as the one-shot ones however the input is cut up:
+// SPU without a loop and looping from a random point, XA in mono and stereo with every bit depth,
+// rate and format; returns the number of encodes that differed
+static int check_streams(int *num_checked) {
+  int16_t *pcm = malloc(STREAM_MAX_LEN * 2 * sizeof(int16_t));
+  const size_t out_size = STREAM_MAX_LEN * 2 + 4 * PSX_AUDIO_XA_STREAM_FLUSH_MAX;
+  uint8_t *ref = malloc(out_size);
+  uint8_t *got = malloc(out_size);
+  assert(pcm && ref && got);
+
+  srand(2);
+  int failed = 0;
+  *num_checked = 0;
+  for (int t = 0; t < STREAM_INPUTS; ++t) {
+    // a couple of tones and some noise, sometimes clipping
+    const int len = 1 + rand() % STREAM_MAX_LEN;
+    const double f1 = 0.001 + rand() % 1000 / 2000.0, f2 = 0.001 + rand() % 1000 / 20000.0;
+    const double amp = 1000.0 + rand() % 40000;
+    for (int i = 0; i < len * 2; ++i) {
+      double x = amp * (0.6 * sin(i * f1) + 0.3 * sin(i * f2)) + (rand() % 2001 - 1000) * amp / 20000.0;
+      pcm[i] = (x > 32767.0) ? 32767 : (x < -32768.0) ? -32768 : (int16_t)x;
+    }
+
+    for (int loop = 0; loop < 2; ++loop) {
+      const int loop_start = loop ? rand() % len : -1;
+      const int ref_len = psx_audio_spu_encode_simple(pcm, len, ref, loop_start);
+      const int got_len = feed_spu_stream(pcm, len, loop_start, got);
+      if (got_len != ref_len || memcmp(got, ref, ref_len)) {
+        if (!failed)
+          fprintf(stderr, "error: SPU stream differs for %d samples, loop start %d\n", len, loop_start);
+        ++failed;
+      }
+      ++*num_checked;
+    }
+
+    for (int stereo = 0; stereo < 2; ++stereo) {
+      const psx_audio_xa_settings_t settings = {
+        .format = (t & 1) ? PSX_AUDIO_XA_FORMAT_XACD : PSX_AUDIO_XA_FORMAT_XA,
+        .stereo = stereo,
+        .frequency = (t & 2) ? PSX_AUDIO_XA_FREQ_DOUBLE : PSX_AUDIO_XA_FREQ_SINGLE,
+        .bits_per_sample = (t & 4) ? 8 : 4,
+      };
+      // one-shot XA output starts 16 bytes before the buffer in the .xa format
+      const int ofs = 2352 - psx_audio_xa_get_buffer_size_per_sector(settings);
+      const int ref_len = psx_audio_xa_encode_simple(settings, pcm, len, ref + ofs);
+      const int got_len = feed_xa_stream(pcm, len, settings, got);
+      if (got_len != ref_len || memcmp(got, ref + ofs, ref_len)) {
+        if (!failed)
+          fprintf(stderr, "error: XA stream differs for %d frames, %s, %d bit, %d Hz, %s\n", len,
+            stereo ? "stereo" : "mono", settings.bits_per_sample, settings.frequency, (t & 1) ? "XACD" : "XA");
+        ++failed;
+      }
+      ++*num_checked;
+    }
+  }
+
+  free(pcm);
+  free(ref);
+  free(got);
+  return failed;
+}
+
+static void print_result(const struct result *res, const int count) {
+  printf("%-28s %5d %9.1f %9.1f %9.2f %9.2f %7d %s\n",
+    res->name, count, res->pcm_bytes / 1024.0,
+    mb_per_sec(res->pcm_bytes, res->enc_ms), mb_per_sec(res->pcm_bytes, res->dec_ms),
+    snr_db(res->signal, res->noise), res->max_err, !res->checked ? "-" : res->identical ? "yes" : "NO");
+}
+
+static void write_json(FILE *f, const struct result *res, const int num_res, const struct sector_result *sec, const int num_sec, const psx_audio_simd_t simd) {
+  fprintf(f, "{\n  \"simd\": \"%s\",\n  \"iterations\": %d,\n  \"results\": [\n", simd_names[simd], num_iters);
+  for (int i = 0; i < num_res; ++i) {
+    fprintf(f, "    { \"name\": \"%s\", \"pcm_bytes\": %llu, \"encode_mb_s\": %.3f, \"decode_mb_s\": %.3f, "
+      "\"snr_db\": %.3f, \"max_error\": %d, \"simd_identical\": %s }%s\n",
+      res[i].name, (unsigned long long)res[i].pcm_bytes,
+      mb_per_sec(res[i].pcm_bytes, res[i].enc_ms), mb_per_sec(res[i].pcm_bytes, res[i].dec_ms),
+      snr_db(res[i].signal, res[i].noise), res[i].max_err, !res[i].checked ? "null" : res[i].identical ? "true" : "false",
+      (i < num_res - 1) ? "," : "");
+  }
+  fprintf(f, "  ],\n  \"sectors\": [\n");
+  for (int i = 0; i < num_sec; ++i) {
+    fprintf(f, "    { \"name\": \"%s\", \"sectors_per_sec\": %.1f, \"edc_ok\": %s, \"ecc_ok\": %s }%s\n",
+      sec[i].name, sec[i].sectors_per_sec, sec[i].edc_ok ? "true" : "false", sec[i].ecc_ok ? "true" : "false",
+      (i < num_sec - 1) ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+}
+
+static void usage(void) {
+  printf("usage: psxavbench [options] <bank> [<bank> ...]\n");
+  printf("options:\n");
+  printf("  -n, --iters <n>      encode and decode every sample n times and take the average (default: %d)\n", num_iters);
+  printf("  -s, --sectors <n>    number of CD-ROM sectors to checksum (default: %d)\n", num_sectors);
+  printf("  -o, --json <file>    also write the results as JSON\n");
+}
+
+int main(int argc, char **argv) {
+  static const struct option long_opts[] = {
+    { "iters",   required_argument, NULL, 'n' },
+    { "sectors", required_argument, NULL, 's' },
+    { "json",    required_argument, NULL, 'o' },
+    { "help",    no_argument,       NULL, 'h' },
+    { NULL,      0,                 NULL, 0   },
+  };
+
+  const char *json_fname = NULL;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "n:s:o:h", long_opts, NULL)) != -1) {
+    switch (opt) {
+      case 'n': num_iters = atoi(optarg); break;
+      case 's': num_sectors = atoi(optarg); break;
+      case 'o': json_fname = optarg; break;
+      default: usage(); return -1;
+    }
+  }
+
+  argc -= optind;
+  argv += optind;
+
+  if (argc < 1 || num_iters < 1 || num_sectors < 1) {
+    usage();
+    return -1;
+  }
+
+  static struct sample samples[MAX_SAMPLES];
+  int count = 0;
+  for (int i = 0; i < argc; ++i) {
+    const int n = load_bank(samples + count, MAX_SAMPLES - count, argv[i]);
+    if (n < 0) {
+      fprintf(stderr, "error: could not load bank '%s'\n", argv[i]);
+      return -2;
+    }
+    count += n;
+  }
+
+  const psx_audio_simd_t simd = psx_audio_get_simd();
+  printf("%d samples from %d banks, SIMD level: %s\n", count, argc, simd_names[simd]);
+
+  struct result res[] = {
+    { .name = "psx_audio_spu_encode/fast" },
+    { .name = "psx_audio_spu_encode" },
+    { .name = "psx_audio_spu_encode/max" },
+    { .name = "synth_encode_adpcm" },
+  };
+  const int num_res = sizeof(res) / sizeof(*res);
+  for (int i = PSX_AUDIO_EFFORT_FAST; i <= PSX_AUDIO_EFFORT_MAX; ++i) {
+    psx_audio_set_effort(i);
+    measure(&res[i], samples, count, false);
+  }
+  psx_audio_set_effort(PSX_AUDIO_EFFORT_DEFAULT);
+  measure(&res[num_res - 1], samples, count, true);
+
+  bool identical = true;
+  for (int i = 0; i < num_res; ++i)
+    identical = identical && (!res[i].checked || res[i].identical);
+
+  printf("%-28s %5s %9s %9s %9s %9s %7s %s\n", "encoder", "smps", "pcm KB", "enc MB/s", "dec MB/s", "SNR dB", "maxerr", "simd ok");
+  for (int i = 0; i < num_res; ++i)
+    print_result(&res[i], count);
+
+  // the candidate kernels on their own, over random blocks the stock banks may never hit
+  int kernels_failed = 0;
+  for (int level = PSX_AUDIO_SIMD_SSE2; level <= (int)simd; ++level) {
+    const int failed = psx_audio_check_simd(level, SIMD_CHECK_LISTS);
+    printf("\n%s candidate kernel: %d/%d random blocks score the same as the scalar one", simd_names[level], SIMD_CHECK_LISTS - failed, SIMD_CHECK_LISTS);
+    kernels_failed += failed;
+  }
+  if (simd > PSX_AUDIO_SIMD_NONE)
+    printf("\n");
+
+  int num_streams;
+  const int streams_failed = check_streams(&num_streams);
+  printf("\nstream encoders: %d/%d random encodes match the one-shot encoders\n", num_streams - streams_failed, num_streams);
+
+  struct sector_result sec[] = {
+    { .name = "mode1",       .type = PSX_CDROM_SECTOR_TYPE_MODE1 },
+    { .name = "mode2_form1", .type = PSX_CDROM_SECTOR_TYPE_MODE2_FORM1 },
+    { .name = "mode2_form2", .type = PSX_CDROM_SECTOR_TYPE_MODE2_FORM2 },
+  };
+  const int num_sec = sizeof(sec) / sizeof(*sec);
+  bool sectors_ok = true;
+  printf("\n%-28s %12s %6s %6s\n", "sector type", "sectors/s", "EDC", "ECC");
+  for (int i = 0; i < num_sec; ++i) {
+    measure_sectors(&sec[i], num_sectors);
+    const bool has_ecc = sec[i].type != PSX_CDROM_SECTOR_TYPE_MODE2_FORM2;
+    printf("%-28s %12.0f %6s %6s\n", sec[i].name, sec[i].sectors_per_sec,
+      sec[i].edc_ok ? "ok" : "BAD", !has_ecc ? "-" : sec[i].ecc_ok ? "ok" : "BAD");
+    sectors_ok = sectors_ok && sec[i].edc_ok && sec[i].ecc_ok;
+  }
+  const int ref_ok = check_ref_sectors();
+  printf("reference sectors: %d/2 match the known EDC and ECC byte for byte\n", ref_ok);
+  sectors_ok = sectors_ok && ref_ok == 2;
+
+  if (json_fname) {
+    FILE *f = fopen(json_fname, "w");
+    if (!f) {
+      fprintf(stderr, "error: could not open '%s' for writing\n", json_fname);
+      return -3;
+    }
+    write_json(f, res, num_res, sec, num_sec, simd);
+    fclose(f);
+  }
+
+  for (int i = 0; i < count; ++i)
+    free(samples[i].pcm);
+
+  return (identical && sectors_ok && !streams_failed && !kernels_failed) ? 0 : -4;
+}
@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "reglog.h"
+
+#pragma pack(push, 1)
+
+struct reglog_hdr {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_ticks;
+  uint32_t num_writes;
+  uint64_t audio_hash;
+  // followed by tick_start[num_ticks], then the writes
+};
+
+#pragma pack(pop)
+
+static const char *voice_reg_names[] = {
+  "vol left", "vol right", "pitch", "addr", "adsr lo", "adsr hi", "adsr vol", "repeat addr",
+};
+
+static const struct {
+  uint16_t reg;
+  const char *name;
+} global_reg_names[] = {
+  { 0x180, "main vol left" },
+  { 0x182, "main vol right" },
+  { 0x184, "reverb vol left" },
+  { 0x186, "reverb vol right" },
+  { 0x188, "key on lo" },
+  { 0x18A, "key on hi" },
+  { 0x18C, "key off lo" },
+  { 0x18E, "key off hi" },
+  { 0x190, "fm lo" },
+  { 0x192, "fm hi" },
+  { 0x194, "noise lo" },
+  { 0x196, "noise hi" },
+  { 0x198, "reverb on lo" },
+  { 0x19A, "reverb on hi" },
+  { 0x19C, "endx lo" },
+  { 0x19E, "endx hi" },
+  { 0x1A2, "reverb addr" },
+  { 0x1A4, "irq addr" },
+  { 0x1A6, "transfer addr" },
+  { 0x1A8, "transfer fifo" },
+  { 0x1AA, "ctrl" },
+  { 0x1AC, "transfer ctrl" },
+  { 0x1AE, "stat" },
+  { 0x1B0, "cd vol left" },
+  { 0x1B2, "cd vol right" },
+  { 0x1B4, "ext vol left" },
+  { 0x1B6, "ext vol right" },
+};
+
+void reglog_init(struct reg_log *log) {
+  memset(log, 0, sizeof(*log));
+}
+
+void reglog_free(struct reg_log *log) {
+  free(log->writes);
+  free(log->tick_start);
+  reglog_init(log);
+}
+
+void reglog_tick(struct reg_log *log) {
+  if (log->num_ticks == log->max_ticks) {
+    log->max_ticks = log->max_ticks ? log->max_ticks * 2 : 1024;
+    log->tick_start = realloc(log->tick_start, log->max_ticks * sizeof(*log->tick_start));
+    assert(log->tick_start);
+  }
+  log->tick_start[log->num_ticks++] = log->num_writes;
+}
+
+void reglog_write(struct reg_log *log, const uint16_t reg, const uint16_t val) {
+  if (!log->num_ticks)
+    return;
+  if (log->num_writes == log->max_writes) {
+    log->max_writes = log->max_writes ? log->max_writes * 2 : 16384;
+    log->writes = realloc(log->writes, log->max_writes * sizeof(*log->writes));
+    assert(log->writes);
+  }
+  log->writes[log->num_writes++] = (struct reg_write){ reg, val };
+}
+
+uint32_t reglog_tick_end(const struct reg_log *log, const uint32_t tick) {
+  return (tick + 1 < log->num_ticks) ? log->tick_start[tick + 1] : log->num_writes;
+}
+
+bool reglog_save(const struct reg_log *log, const char *fname) {
+  FILE *f = fopen(fname, "wb");
+  if (!f) {
+    fprintf(stderr, "error: could not open '%s' for writing\n", fname);
+    return false;
+  }
+  const struct reglog_hdr hdr = {
+    .magic = REGLOG_MAGIC,
+    .version = REGLOG_VERSION,
+    .num_ticks = log->num_ticks,
+    .num_writes = log->num_writes,
+    .audio_hash = log->audio_hash,
+  };
+  bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+  ok = ok && fwrite(log->tick_start, sizeof(*log->tick_start), log->num_ticks, f) == log->num_ticks;
+  ok = ok && fwrite(log->writes, sizeof(*log->writes), log->num_writes, f) == log->num_writes;
+  if (fclose(f) || !ok) {
+    fprintf(stderr, "error: could not write '%s'\n", fname);
+    return false;
+  }
+  return true;
+}
+
+bool reglog_load(struct reg_log *log, const char *fname) {
+  reglog_init(log);
+
+  FILE *f = fopen(fname, "rb");
+  if (!f) {
+    fprintf(stderr, "error: could not open '%s'\n", fname);
+    return false;
+  }
+
+  struct reglog_hdr hdr;
+  if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != REGLOG_MAGIC || hdr.version != REGLOG_VERSION) {
+    fprintf(stderr, "error: '%s' is not a version %d register log\n", fname, REGLOG_VERSION);
+    fclose(f);
+    return false;
+  }
+
+  log->num_ticks = log->max_ticks = hdr.num_ticks;
+  log->num_writes = log->max_writes = hdr.num_writes;
+  log->audio_hash = hdr.audio_hash;
+  log->tick_start = malloc(hdr.num_ticks * sizeof(*log->tick_start) + 1);
+  log->writes = malloc(hdr.num_writes * sizeof(*log->writes) + 1);
+  assert(log->tick_start && log->writes);
+
+  bool ok = fread(log->tick_start, sizeof(*log->tick_start), hdr.num_ticks, f) == hdr.num_ticks;
+  ok = ok && fread(log->writes, sizeof(*log->writes), hdr.num_writes, f) == hdr.num_writes;
+  for (uint32_t i = 0; ok && i < hdr.num_ticks; ++i)
+    ok = log->tick_start[i] <= hdr.num_writes && (!i || log->tick_start[i] >= log->tick_start[i - 1]);
+  fclose(f);
+
+  if (!ok) {
+    fprintf(stderr, "error: '%s' is truncated or corrupt\n", fname);
+    reglog_free(log);
+    return false;
+  }
+
+  return true;
+}
+
+bool reglog_diff(const struct reg_log *a, const struct reg_log *b, struct reg_log_diff *diff) {
+  const uint32_t num_ticks = a->num_ticks < b->num_ticks ? a->num_ticks : b->num_ticks;
+  for (uint32_t t = 0; t < num_ticks; ++t) {
+    const uint32_t a_start = a->tick_start[t], a_end = reglog_tick_end(a, t);
+    const uint32_t b_start = b->tick_start[t], b_end = reglog_tick_end(b, t);
+    for (uint32_t i = 0; a_start + i < a_end || b_start + i < b_end; ++i) {
+      const struct reg_write *wa = (a_start + i < a_end) ? &a->writes[a_start + i] : NULL;
+      const struct reg_write *wb = (b_start + i < b_end) ? &b->writes[b_start + i] : NULL;
+      if (!wa || !wb || wa->reg != wb->reg || wa->val != wb->val) {
+        *diff = (struct reg_log_diff){ t, i, wa, wb };
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+uint64_t reglog_hash(uint64_t hash, const void *data, size_t size) {
+  const uint8_t *p = data;
+  while (size--) {
+    hash ^= *p++;
+    hash *= 0x100000001B3ull;
+  }
+  return hash;
+}
+
+const char *reglog_voice_reg_name(const uint16_t reg) {
+  return voice_reg_names[(reg & 0xF) >> 1];
+}
+
+const char *reglog_reg_name(const uint16_t reg, char *buf, const size_t size) {
+  if (reg < 0x180) {
+    snprintf(buf, size, "voice %d %s", reg >> 4, reglog_voice_reg_name(reg));
+    return buf;
+  }
+  for (size_t i = 0; i < sizeof(global_reg_names) / sizeof(*global_reg_names); ++i) {
+    if (global_reg_names[i].reg == reg) {
+      snprintf(buf, size, "%s", global_reg_names[i].name);
+      return buf;
+    }
+  }
+  snprintf(buf, size, "reg 0x%03X", reg);
+  return buf;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// log of SPU register writes grouped by sequencer tick, plus a hash of the audio they produced;
+// orgrender records these and checks them against goldens
+
+#define REGLOG_MAGIC 0x47474C52 // 'RLGG'
+#define REGLOG_VERSION 1
+
+struct reg_write {
+  uint16_t reg; // offset from 0x1F801C00
+  uint16_t val;
+};
+
+struct reg_log {
+  struct reg_write *writes;
+  uint32_t num_writes;
+  uint32_t max_writes;
+  uint32_t *tick_start; // index of the first write of every tick
+  uint32_t num_ticks;
+  uint32_t max_ticks;
+  uint64_t audio_hash;
+};
+
+// where two logs first differ; a write is NULL if that log has no more writes in the tick
+struct reg_log_diff {
+  uint32_t tick;
+  uint32_t index; // within the tick
+  const struct reg_write *a;
+  const struct reg_write *b;
+};
+
+void reglog_init(struct reg_log *log);
+void reglog_free(struct reg_log *log);
+// starts the next tick, writes before the first one are dropped
+void reglog_tick(struct reg_log *log);
+void reglog_write(struct reg_log *log, const uint16_t reg, const uint16_t val);
+// writes of a tick are [tick_start[tick], reglog_tick_end(log, tick))
+uint32_t reglog_tick_end(const struct reg_log *log, const uint32_t tick);
+
+bool reglog_save(const struct reg_log *log, const char *fname);
+bool reglog_load(struct reg_log *log, const char *fname);
+
+// compares the writes tick by tick (not the audio hash); returns false if they're the same,
+// also if one log just has more ticks
+bool reglog_diff(const struct reg_log *a, const struct reg_log *b, struct reg_log_diff *diff);
+
+// FNV-1a, chainable: start with REGLOG_HASH_INIT
+#define REGLOG_HASH_INIT 0xCBF29CE484222325ull
+uint64_t reglog_hash(uint64_t hash, const void *data, size_t size);
+
+// readable name of a register, like "voice 8 pitch" or "key on lo"
+const char *reglog_reg_name(const uint16_t reg, char *buf, const size_t size);
+// the same for a voice register, without the voice: "pitch"
+const char *reglog_voice_reg_name(const uint16_t reg);
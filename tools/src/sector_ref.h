@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+// EDC and ECC of two sectors, computed outside of libpsxav from the ECMA-130 definitions: the EDC as the
+// bitwise CRC of (x^16 + x^15 + x^2 + 1)(x^16 + x^2 + x + 1), whose check value for "123456789" is 0x6EC2EDC4,
+// and P and Q by solving both parity equations of every vector, laid out with the standard's 16-bit word
+// formulas (43 * Mp + Np and (44 * Mq + 43 * Nq) mod 1118) rather than the byte strides cdrom.c uses.
+// make_ref_sectors() in psxavbench.c builds the rest of both sectors
+
+// mode 1 at 00:02:00, data byte i is i * 31 + (i >> 8); from 0x810: EDC, 8 zero bytes, P, Q
+static const uint8_t ref_mode1_tail[288] = {
+  0xA9, 0xAE, 0xAE, 0x3C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xB3, 0xC3, 0x63, 0xB4,
+  0x83, 0x3B, 0xB4, 0x5A, 0xAD, 0x9D, 0xDE, 0xF3, 0xAF, 0x9C, 0xD3, 0xD5, 0xA6, 0x09, 0xA6, 0x56,
+  0x2E, 0x48, 0x10, 0xFE, 0x88, 0x7F, 0x47, 0xC3, 0xFF, 0xBF, 0x1D, 0x2F, 0xEC, 0xBD, 0xA9, 0x3E,
+  0x81, 0xFD, 0x10, 0x48, 0x55, 0x0B, 0x08, 0x56, 0xAF, 0x99, 0x7B, 0xA7, 0x44, 0xE3, 0xEE, 0x4C,
+  0x51, 0x77, 0xBE, 0x23, 0x81, 0xA5, 0xD9, 0xA7, 0x2D, 0x65, 0x64, 0xC9, 0xB0, 0x59, 0x6F, 0x49,
+  0x18, 0x7F, 0xD6, 0xEC, 0x3D, 0x88, 0x53, 0x68, 0x00, 0x15, 0x2A, 0x76, 0x1C, 0x81, 0xC0, 0x19,
+  0x6B, 0xB1, 0xCE, 0x61, 0x49, 0x54, 0x6B, 0x3B, 0xAC, 0x5A, 0x85, 0x1D, 0xE6, 0xF3, 0x97, 0x1C,
+  0xFB, 0xD5, 0xBE, 0x09, 0xCE, 0x56, 0x46, 0x48, 0x68, 0xFE, 0xE0, 0x7F, 0x5F, 0xC3, 0xE7, 0xBF,
+  0x35, 0xAF, 0xD4, 0xBD, 0x81, 0xBE, 0xA9, 0xFD, 0x08, 0x48, 0xBD, 0x0B, 0xF0, 0x56, 0x57, 0x99,
+  0x93, 0xA7, 0x5C, 0xE3, 0xC6, 0xCC, 0x79, 0x77, 0x86, 0xA3, 0xA9, 0xA5, 0xC1, 0xA7, 0x35, 0x65,
+  0x0C, 0xC9, 0xC8, 0x59, 0x07, 0x49, 0x70, 0x7F, 0xCE, 0xEC, 0x15, 0x08, 0xC5, 0xE0, 0xD2, 0xCE,
+  0x83, 0xD2, 0xC2, 0x64, 0xD3, 0x3B, 0xC3, 0xD2, 0x00, 0x68, 0xC8, 0x16, 0xFC, 0xB4, 0x7F, 0x98,
+  0xED, 0xDC, 0x71, 0x77, 0xB1, 0x7F, 0x40, 0xB5, 0xB4, 0xDF, 0x90, 0x73, 0x98, 0x55, 0x35, 0xBF,
+  0x70, 0x97, 0x2B, 0x3C, 0x85, 0xC1, 0x82, 0xF9, 0x4F, 0x80, 0xC7, 0xA0, 0x24, 0x58, 0xBC, 0x55,
+  0xAE, 0x83, 0x78, 0x2A, 0xF7, 0x54, 0x2A, 0x5B, 0x3C, 0x95, 0xD4, 0xF8, 0x33, 0xC6, 0x4F, 0xD1,
+  0xE8, 0x31, 0xE5, 0xC3, 0x14, 0xEA, 0x7B, 0x4E, 0x8B, 0xB4, 0xF1, 0xF5, 0xAD, 0xC7, 0x52, 0x5E,
+  0x56, 0x36, 0x4B, 0xE1, 0xA6, 0x9B, 0xC9, 0x85, 0x8B, 0xDC, 0x86, 0xD1, 0x27, 0x95, 0xBE, 0x6C,
+  0xDC, 0x2F, 0x48, 0x16, 0xBA, 0x20, 0x53, 0xAE, 0xDB, 0xA1, 0xAC, 0xC6, 0xD8, 0x82, 0xAF, 0xF6,
+};
+
+// mode 2 form 1 at 00:02:16 with subheader 00 00 08 00 and the start of an ISO 9660 primary volume
+// descriptor like mkpsxiso writes for iso.xml; from 0x818: EDC, P, Q
+static const uint8_t ref_form1_tail[280] = {
+  0xC3, 0x4E, 0xE9, 0xCE, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFB, 0x00, 0x00, 0x00, 0xFB, 0x00,
+  0xF5, 0x89, 0x78, 0x20, 0x20, 0xD5, 0xF5, 0x00, 0x60, 0x83, 0x7E, 0x6E, 0x62, 0x93, 0x7E, 0x93,
+  0x85, 0x81, 0x74, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB,
+  0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0x81, 0x97, 0x7A, 0x60, 0x83, 0x7E, 0x6E, 0xCB,
+  0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB,
+  0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0xCB, 0x93, 0x19, 0x26, 0x4F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0xF3, 0x00, 0x00, 0x00, 0xF3, 0x00, 0xF4, 0xCA, 0x3C, 0x10, 0x10, 0xE4, 0xF4, 0x00, 0x30, 0xCF,
+  0x3F, 0x37, 0x31, 0xC7, 0x3F, 0xC7, 0xCC, 0xCE, 0x3A, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB,
+  0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xCE, 0xC5,
+  0x3D, 0x30, 0xCF, 0x3F, 0x37, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB,
+  0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0xEB, 0x70, 0x77, 0xCF, 0x81,
+  0xBD, 0xB4, 0x8D, 0x8D, 0x07, 0x07, 0x0E, 0x0E, 0x1C, 0x1C, 0x38, 0x38, 0x70, 0x70, 0xC6, 0xAF,
+  0xC4, 0xFB, 0x94, 0x76, 0x92, 0x2E, 0xBF, 0xEB, 0x97, 0x8F, 0xE2, 0xC1, 0xA7, 0x70, 0x89, 0x6F,
+  0xD3, 0xE6, 0x76, 0x8D, 0x83, 0x87, 0x36, 0x64, 0x0F, 0xAA, 0x2C, 0x41, 0x22, 0x3D, 0xD4, 0x8D,
+  0x66, 0x53, 0x2E, 0x52, 0xD2, 0xC6, 0x8D, 0x8D, 0x07, 0x07, 0x0E, 0x0E, 0x1C, 0x1C, 0x38, 0x38,
+  0x70, 0x70, 0x2F, 0x61, 0x21, 0xFA, 0x77, 0xEE, 0xB6, 0xD8, 0x43, 0x96, 0x83, 0x94, 0xEC, 0x3C,
+  0xAB, 0x90, 0x0D, 0xF9, 0x57, 0x7F, 0x1F, 0x49, 0x7A, 0x2F, 0x7D, 0x9E, 0xFD, 0xE9, 0x7A, 0x41,
+  0x45, 0x88, 0x30, 0xF2, 0x96, 0xB5, 0x6C, 0x0C,
+};
@@ -3,11 +3,14 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <getopt.h>
 
 #define DR_WAV_IMPLEMENTATION
 #include "dr_wav.h"
 #include "libpsxav/libpsxav.h"
 #include "common.h"
+#include "adpcm_cache.h"
+#include "pool.h"
 
 // output PSX SPURAM
 static uint8_t spuram[SPURAM_SIZE + 1024]; // 1kb of grace zone
@@ -15,93 +18,214 @@ static int spuram_ptr = SPURAM_START;
 
 static struct sfx sfx[MAX_SFX]; // 0 is dummy
 static int max_sfx = 0;
+static double dec_time[MAX_SFX]; // time spent loading and decoding each WAV, in ms
+
+// samples are read from the WAVs this many at a time, so only a few chunks are ever in memory;
+// it's a whole number of ADPCM blocks so the error can be measured chunk by chunk
+#define CHUNK_LEN (28 * 256)
+
+static int num_jobs = 0; // 0 = one per CPU
 
 static struct bank_hdr bank_hdr;
 
-static bool load_wav(struct sfx *sfx, const char *fname) {
-  drwav wav;
-  if (!drwav_init_file(&wav, fname, NULL))
+static bool open_wav(drwav *wav, const char *fname) {
+  if (!drwav_init_file(wav, fname, NULL))
     return false;
 
-  if (wav.bitsPerSample != 8 || wav.channels != 1 || wav.sampleRate != 22050) {
+  if (wav->bitsPerSample != 8 || wav->channels != 1 || wav->sampleRate != 22050) {
     fprintf(stderr, "error: '%s' is not a mono unsigned 8-bit 22khz PCM WAV file!\n", fname);
-    drwav_uninit(&wav);
+    drwav_uninit(wav);
     return false;
   }
 
-  int16_t *pcm = malloc(sizeof(int16_t) * wav.totalPCMFrameCount);
-  assert(pcm);
-
-  const uint32_t total_read = drwav_read_pcm_frames_s16(&wav, wav.totalPCMFrameCount, pcm);
-  assert(total_read);
-
-  sfx->data = pcm;
-  sfx->len = total_read;
-  sfx->freq = wav.sampleRate;
-
-  drwav_uninit(&wav);
+  if (!wav->totalPCMFrameCount) {
+    fprintf(stderr, "error: '%s' is empty\n", fname);
+    drwav_uninit(wav);
+    return false;
+  }
 
   return true;
 }
 
-static bool load_all_sfx(const char *path) {
-  char fname[2048];
-  int i = 1;
-  for (; i < MAX_SFX; ++i) {
-    snprintf(fname, sizeof(fname), "%s/%d.wav", path, i);
-    if (load_wav(&sfx[i], fname))
-      max_sfx = i;
-  }
-  return (i > 1);
+// reads the next chunk of a WAV, counting the time it takes
+static uint32_t read_chunk(drwav *wav, int16_t *chunk, double *time) {
+  const double start = time_ms();
+  const uint32_t n = drwav_read_pcm_frames_s16(wav, CHUNK_LEN, chunk);
+  *time += time_ms() - start;
+  return n;
 }
 
 static void cleanup(void) {
-  for (int i = 0; i < max_sfx; ++i) {
-    if (sfx[i].data)
-      free(sfx[i].data);
-  }
+  adpcm_cache_print_stats();
+  for (int i = 0; i <= max_sfx; ++i)
+    free(sfx[i].adpcm);
 }
 
 static inline bool is_sfx_looping(const int sfx) {
   return (sfx == 40 || sfx == 41 || sfx == 58 || sfx == 7);
 }
 
+static void usage(void) {
+  printf("usage: sfxconv [options] <wavdir> <out_bank>\n");
+  printf("options:\n");
+  printf("  -C, --cache <dir>    reuse encoded samples from, and save new ones to, a cache directory\n");
+  printf("  -e, --effort <level> encoder effort: fast, default or max (default: default)\n");
+  printf("  -j, --jobs <n>       number of threads loading and encoding samples (default: one per CPU)\n");
+}
+
+// loads and encodes one sample, numbered from 1, straight from the WAV in chunks; missing files are skipped
+static void convert_sfx(int idx, void *arg) {
+  const char *path = arg;
+  const int i = idx + 1;
+  char fname[2048];
+  snprintf(fname, sizeof(fname), "%s/%d.wav", path, i);
+
+  drwav wav;
+  if (!open_wav(&wav, fname))
+    return;
+
+  struct sfx *s = &sfx[i];
+  int16_t chunk[CHUNK_LEN];
+  uint32_t n;
+  s->len = wav.totalPCMFrameCount;
+  s->freq = wav.sampleRate;
+
+  // hash the input to look it up in the cache
+  const int loop_start = is_sfx_looping(i) ? 0 : -1;
+  uint64_t key = adpcm_cache_key_begin(s->len, loop_start, ADPCM_ENC_PSXAV, psx_audio_get_effort());
+  while ((n = read_chunk(&wav, chunk, &dec_time[i])))
+    key = adpcm_cache_key_update(key, chunk, n);
+
+  double start = time_ms();
+  const int max_len = psx_audio_spu_get_buffer_size(s->len);
+  s->adpcm = malloc(max_len + PSX_AUDIO_SPU_STREAM_FLUSH_MAX);
+  assert(s->adpcm);
+  s->adpcm_len = adpcm_cache_load(key, s->adpcm, max_len);
+  s->enc_time += time_ms() - start;
+
+  if (s->adpcm_len < 0) {
+    psx_audio_spu_stream_t stream;
+    psx_audio_spu_stream_init(&stream, loop_start);
+    s->adpcm_len = 0;
+    drwav_seek_to_pcm_frame(&wav, 0);
+    while ((n = read_chunk(&wav, chunk, &dec_time[i]))) {
+      start = time_ms();
+      s->adpcm_len += psx_audio_spu_stream_feed(&stream, chunk, n, s->adpcm + s->adpcm_len);
+      s->enc_time += time_ms() - start;
+    }
+    start = time_ms();
+    s->adpcm_len += psx_audio_spu_stream_flush(&stream, s->adpcm + s->adpcm_len);
+    adpcm_cache_store(key, s->adpcm, s->adpcm_len);
+    s->enc_time += time_ms() - start;
+  }
+
+  // compare the encoded sample to the input, a chunk at a time
+  psx_audio_decoder_channel_state_t dec_state = { 0 };
+  int16_t dec[CHUNK_LEN];
+  int adpcm_pos = 0;
+  drwav_seek_to_pcm_frame(&wav, 0);
+  while ((n = read_chunk(&wav, chunk, &dec_time[i])) && adpcm_pos < s->adpcm_len) {
+    const int blocks_len = (n + 27) / 28 * 16;
+    psx_audio_spu_decode(&dec_state, s->adpcm + adpcm_pos, blocks_len, dec);
+    adpcm_pos += blocks_len;
+    for (uint32_t j = 0; j < n; ++j) {
+      const double err = dec[j] - chunk[j];
+      s->signal += (double)chunk[j] * chunk[j];
+      s->noise += err * err;
+    }
+  }
+
+  drwav_uninit(&wav);
+}
+
 int main(int argc, char **argv) {
-  if (argc != 3) {
-    printf("usage: sfxconv <wavdir> <out_bank>\n");
+  static const struct option long_opts[] = {
+    { "cache",  required_argument, NULL, 'C' },
+    { "effort", required_argument, NULL, 'e' },
+    { "jobs",   required_argument, NULL, 'j' },
+    { "help",   no_argument,       NULL, 'h' },
+    { NULL,     0,                 NULL, 0   },
+  };
+
+  psx_audio_effort_t effort;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "C:e:j:h", long_opts, NULL)) != -1) {
+    switch (opt) {
+      case 'C': if (!adpcm_cache_init(optarg)) return -1; break;
+      case 'e':
+        if (!parse_effort(optarg, &effort)) {
+          fprintf(stderr, "error: unknown effort level '%s'\n", optarg);
+          return -1;
+        }
+        psx_audio_set_effort(effort);
+        break;
+      case 'j': num_jobs = atoi(optarg); break;
+      default: usage(); return -1;
+    }
+  }
+
+  if (argc - optind != 2) {
+    usage();
     return -1;
   }
 
   atexit(cleanup);
 
-  const char *wavpath = argv[1];
-  const char *outfname = argv[2];
+  const char *wavpath = argv[optind + 0];
+  const char *outfname = argv[optind + 1];
+
+  // load and encode all the samples in parallel
+
+  const int jobs = num_jobs ? num_jobs : pool_num_cpus();
+  double start = time_ms();
+  pool_run(jobs, MAX_SFX - 1, convert_sfx, (void *)wavpath);
+  const double convert_wall = time_ms() - start;
+
+  double total_dec = 0.0;
+  double total_enc = 0.0;
+  double signal = 0.0;
+  double noise = 0.0;
+  for (int i = 1; i < MAX_SFX; ++i) {
+    if (sfx[i].adpcm == NULL)
+      continue;
+    max_sfx = i;
+    total_dec += dec_time[i];
+    total_enc += sfx[i].enc_time;
+    signal += sfx[i].signal;
+    noise += sfx[i].noise;
+  }
 
-  if (!load_all_sfx(wavpath)) {
+  if (!max_sfx) {
     fprintf(stderr, "error: could not load samples from '%s'\n", wavpath);
     return -2;
   }
 
   printf("%d samples loaded\n", max_sfx);
 
-  // convert samples
+  // pack them in order
 
+  start = time_ms();
   for (int i = 1; i <= max_sfx; ++i) {
-    if (sfx[i].data == NULL)
+    if (sfx[i].adpcm == NULL)
       continue;
-    const int loop_start = is_sfx_looping(i) ? 0 : -1;
-    const int adpcm_len = psx_audio_spu_encode_simple(sfx[i].data, sfx[i].len, spuram + spuram_ptr, loop_start);
-    if (adpcm_len <= 0) {
+    if (sfx[i].adpcm_len <= 0) {
       fprintf(stderr, "error: could not encode sfx %d\n", i);
       return -3;
     }
-    sfx[i].addr = spuram_ptr;
-    spuram_ptr += ALIGN(adpcm_len, 8);
-    if (spuram_ptr >= SPURAM_SIZE) {
+    if (spuram_ptr + ALIGN(sfx[i].adpcm_len, 8) >= SPURAM_SIZE) {
       fprintf(stderr, "error: ran out of SPU RAM packing sfx %d\n", i);
       return -4;
     }
+    memcpy(spuram + spuram_ptr, sfx[i].adpcm, sfx[i].adpcm_len);
+    sfx[i].addr = spuram_ptr;
+    spuram_ptr += ALIGN(sfx[i].adpcm_len, 8);
   }
+  const double pack_time = time_ms() - start;
+
+  printf("loaded and encoded %d samples in %.1f ms on %d threads (%.1f ms loading, %.1f ms encoding), packed in %.1f ms\n",
+    max_sfx, convert_wall, (jobs < MAX_SFX - 1) ? jobs : MAX_SFX - 1, total_dec, total_enc, pack_time);
+  printf("effort: %s, SNR: %.2f dB\n", effort_name(psx_audio_get_effort()), snr_db(signal, noise));
 
   bank_hdr.num_sfx = max_sfx + 1;
   bank_hdr.data_size = spuram_ptr - SPURAM_START;
@@ -0,0 +1,603 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "libpsxav/libpsxav.h"
+#include "spuemu.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SPUEMU_HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#define REG_VOL_LEFT    0x0
+#define REG_VOL_RIGHT   0x2
+#define REG_PITCH       0x4
+#define REG_ADDR        0x6
+#define REG_ADSR_LO     0x8
+#define REG_ADSR_HI     0xA
+#define REG_ADSR_VOL    0xC
+#define REG_MAIN_LEFT   0x180
+#define REG_MAIN_RIGHT  0x182
+#define REG_KEY_ON_LO   0x188
+#define REG_KEY_ON_HI   0x18A
+#define REG_KEY_OFF_LO  0x18C
+#define REG_KEY_OFF_HI  0x18E
+#define REG_NOISE_LO    0x194
+#define REG_NOISE_HI    0x196
+#define REG_ENDX_LO     0x19C
+#define REG_ENDX_HI     0x19E
+#define REG_CTRL        0x1AA
+
+#define BLOCK_LEN  28
+#define BLOCK_SIZE 16
+#define HISTORY    3 // previous samples the interpolation looks at
+
+#define MAX_PITCH 0x4000
+#define MAX_ENV   0x7FFF
+#define MAX_VOL   0x7FFF
+
+// volume register bits
+#define VOL_SWEEP      0x8000
+#define VOL_SWEEP_EXP  0x4000
+#define VOL_SWEEP_DEC  0x2000
+
+// voices are mixed this many frames at a time
+#define MIX_CHUNK 256
+
+// ADPCM block flags
+#define FLAG_END    1
+#define FLAG_REPEAT 2
+#define FLAG_START  4
+
+enum phase { PHASE_OFF, PHASE_ATTACK, PHASE_DECAY, PHASE_SUSTAIN, PHASE_RELEASE };
+
+// one ADSR phase: how often the level changes and by how much
+struct env_rate {
+  bool exponential;
+  bool decrease;
+  int shift;
+  int step;
+  int32_t target; // level that ends the phase
+};
+
+struct voice {
+  uint32_t addr;    // next block, in bytes
+  uint32_t repeat;  // where the end flag jumps to, in bytes
+  uint32_t counter; // position in the current block, 4.12
+  int16_t buf[HISTORY + BLOCK_LEN]; // tail of the previous block, then the current one
+  psx_audio_decoder_channel_state_t adpcm;
+  uint8_t flags;    // loop flags of the current block
+  enum phase phase;
+  struct env_rate rate; // of the current phase
+  int32_t env;      // ADSR level, 0 to MAX_ENV
+  uint32_t env_wait; // samples until the envelope steps again
+};
+
+// one side of a voice or the main volume; in sweep mode the level moves by itself like an envelope
+struct vol {
+  int32_t level;     // 0 to MAX_VOL, or negative in fixed mode
+  uint32_t wait;     // samples until the sweep steps again
+};
+
+typedef void (*mix_voice_t)(int32_t *acc_l, int32_t *acc_r, const int16_t *in, const int32_t vol_l, const int32_t vol_r, const int n);
+typedef void (*mix_output_t)(int16_t *out, const int32_t *acc_l, const int32_t *acc_r, const int n);
+
+static uint16_t regs[0x200 / 2];
+static uint8_t ram[SPUEMU_RAM_SIZE];
+static struct voice voices[SPUEMU_NUM_VOICES];
+static uint32_t endx;
+static struct vol voice_vols[SPUEMU_NUM_VOICES][2];
+static struct vol main_vols[2];
+static int16_t noise_level;
+static int32_t noise_timer;
+
+void spuemu_reset(void) {
+  memset(regs, 0, sizeof(regs));
+  memset(ram, 0, sizeof(ram));
+  memset(voices, 0, sizeof(voices));
+  memset(voice_vols, 0, sizeof(voice_vols));
+  memset(main_vols, 0, sizeof(main_vols));
+  endx = 0;
+  noise_level = 0;
+  noise_timer = 0;
+}
+
+static inline uint16_t voice_reg(const int v, const uint32_t reg) {
+  return regs[(v * 0x10 + reg) >> 1];
+}
+
+// a write to a volume register: fixed mode sets the level, sweep mode starts from wherever it is
+static void vol_write(struct vol *vol, const uint16_t val) {
+  if (!(val & VOL_SWEEP))
+    vol->level = (int16_t)(val << 1);
+  vol->wait = 0;
+}
+
+// steps a sweep by one sample, same rates as the ADSR; the phase bit is ignored
+static void vol_tick(struct vol *vol, const uint16_t val) {
+  if (vol->wait > 1) {
+    --vol->wait;
+    return;
+  }
+
+  const bool exponential = val & VOL_SWEEP_EXP;
+  const bool decrease = val & VOL_SWEEP_DEC;
+  const int shift = (val >> 2) & 0x1F;
+  int32_t step = decrease ? (-8 + (val & 3)) : (7 - (val & 3));
+  vol->wait = 1u << ((shift > 11) ? shift - 11 : 0);
+  step <<= (shift < 11) ? 11 - shift : 0;
+  if (exponential && !decrease && vol->level > 0x6000)
+    vol->wait *= 4;
+  if (exponential && decrease)
+    step = (step * vol->level) >> 15;
+
+  vol->level += step;
+  if (vol->level > MAX_VOL) vol->level = MAX_VOL;
+  if (vol->level < 0) vol->level = 0;
+}
+
+static struct env_rate env_rate(const int v, const enum phase phase) {
+  const uint16_t lo = voice_reg(v, REG_ADSR_LO);
+  const uint16_t hi = voice_reg(v, REG_ADSR_HI);
+  struct env_rate r = { 0 };
+  switch (phase) {
+    case PHASE_ATTACK:
+      r.exponential = lo >> 15;
+      r.shift = (lo >> 10) & 0x1F;
+      r.step = 7 - ((lo >> 8) & 3);
+      r.target = MAX_ENV;
+      break;
+    case PHASE_DECAY:
+      r.exponential = true;
+      r.decrease = true;
+      r.shift = (lo >> 4) & 0x0F;
+      r.step = -8;
+      r.target = ((lo & 0x0F) + 1) * 0x800;
+      break;
+    case PHASE_SUSTAIN:
+      r.exponential = hi >> 15;
+      r.decrease = (hi >> 14) & 1;
+      r.shift = (hi >> 8) & 0x1F;
+      r.step = r.decrease ? (-8 + ((hi >> 6) & 3)) : (7 - ((hi >> 6) & 3));
+      r.target = -1; // lasts until key off
+      break;
+    default:
+      r.exponential = (hi >> 5) & 1;
+      r.decrease = true;
+      r.shift = hi & 0x1F;
+      r.step = -8;
+      r.target = 0;
+      break;
+  }
+  return r;
+}
+
+static void set_phase(struct voice *v, const int i, const enum phase phase) {
+  v->phase = phase;
+  v->rate = env_rate(i, phase);
+  v->env_wait = 0;
+}
+
+static void env_tick(struct voice *v) {
+  if (v->env_wait > 1) {
+    --v->env_wait;
+    return;
+  }
+
+  const struct env_rate r = v->rate;
+  v->env_wait = 1u << ((r.shift > 11) ? r.shift - 11 : 0);
+  int32_t step = r.step << ((r.shift < 11) ? 11 - r.shift : 0);
+  if (r.exponential && !r.decrease && v->env > 0x6000)
+    v->env_wait *= 4;
+  if (r.exponential && r.decrease)
+    step = (step * v->env) >> 15;
+
+  v->env += step;
+  if (v->env > MAX_ENV) v->env = MAX_ENV;
+  if (v->env < 0) v->env = 0;
+
+  if (v->phase == PHASE_ATTACK && v->env >= r.target)
+    set_phase(v, v - voices, PHASE_DECAY);
+  else if (v->phase == PHASE_DECAY && v->env <= r.target)
+    set_phase(v, v - voices, PHASE_SUSTAIN);
+  else if (v->phase == PHASE_RELEASE && v->env == 0)
+    v->phase = PHASE_OFF;
+}
+
+static void decode_block(struct voice *v) {
+  const uint8_t *block = ram + (v->addr & (SPUEMU_RAM_SIZE - BLOCK_SIZE));
+  v->flags = block[1];
+  if (v->flags & FLAG_START)
+    v->repeat = v->addr;
+  memcpy(v->buf, v->buf + BLOCK_LEN, HISTORY * sizeof(int16_t));
+  psx_audio_spu_decode(&v->adpcm, block, BLOCK_SIZE, v->buf + HISTORY);
+}
+
+static void key_on(const int i) {
+  struct voice *v = &voices[i];
+  memset(v, 0, sizeof(*v));
+  v->addr = voice_reg(i, REG_ADDR) << 3;
+  v->repeat = v->addr;
+  set_phase(v, i, PHASE_ATTACK);
+  endx &= ~(1u << i);
+  decode_block(v);
+}
+
+static void key_off(const int i) {
+  if (voices[i].phase != PHASE_OFF)
+    set_phase(&voices[i], i, PHASE_RELEASE);
+}
+
+// moves on to the next block when the current one is done
+static void next_block(const int i) {
+  struct voice *v = &voices[i];
+  if (v->flags & FLAG_END) {
+    endx |= 1u << i;
+    v->addr = v->repeat;
+    // without the repeat flag the voice is released and silenced immediately
+    if (!(v->flags & FLAG_REPEAT)) {
+      v->phase = PHASE_OFF;
+      v->env = 0;
+      return;
+    }
+  } else {
+    v->addr += BLOCK_SIZE;
+  }
+  decode_block(v);
+}
+
+void spuemu_write(const uint32_t reg, const uint16_t val) {
+  if (reg >= sizeof(regs) * 2)
+    return;
+  regs[reg >> 1] = val;
+  const int base = (reg == REG_KEY_ON_HI || reg == REG_KEY_OFF_HI) ? 16 : 0;
+  switch (reg) {
+    case REG_KEY_ON_LO:
+    case REG_KEY_ON_HI:
+      for (int i = 0; i < 16 && base + i < SPUEMU_NUM_VOICES; ++i)
+        if (val & (1u << i))
+          key_on(base + i);
+      break;
+    case REG_KEY_OFF_LO:
+    case REG_KEY_OFF_HI:
+      for (int i = 0; i < 16 && base + i < SPUEMU_NUM_VOICES; ++i)
+        if (val & (1u << i))
+          key_off(base + i);
+      break;
+    case REG_MAIN_LEFT:
+    case REG_MAIN_RIGHT:
+      vol_write(&main_vols[(reg - REG_MAIN_LEFT) >> 1], val);
+      break;
+    default:
+      if (reg < SPUEMU_NUM_VOICES * 0x10 && (reg & 0xF) <= REG_VOL_RIGHT)
+        vol_write(&voice_vols[reg >> 4][(reg & 0xF) >> 1], val);
+      break;
+  }
+}
+
+uint16_t spuemu_read(const uint32_t reg) {
+  if (reg == REG_ENDX_LO)
+    return endx;
+  if (reg == REG_ENDX_HI)
+    return endx >> 16;
+  if (reg < SPUEMU_NUM_VOICES * 0x10 && (reg & 0xF) == REG_ADSR_VOL)
+    return voices[reg >> 4].env;
+  return (reg < sizeof(regs) * 2) ? regs[reg >> 1] : 0;
+}
+
+void spuemu_write_ram(const uint32_t addr, const void *data, const uint32_t len) {
+  if (addr >= SPUEMU_RAM_SIZE)
+    return;
+  const uint32_t n = (addr + len > SPUEMU_RAM_SIZE) ? SPUEMU_RAM_SIZE - addr : len;
+  memcpy(ram + addr, data, n);
+}
+
+void spuemu_read_ram(const uint32_t addr, void *data, const uint32_t len) {
+  memset(data, 0, len);
+  if (addr >= SPUEMU_RAM_SIZE)
+    return;
+  const uint32_t n = (addr + len > SPUEMU_RAM_SIZE) ? SPUEMU_RAM_SIZE - addr : len;
+  memcpy(data, ram + addr, n);
+}
+
+// the interpolation table, read at 0xFF-i, 0x1FF-i, 0x100+i and i for the 4 taps at phase i.
+// 0x000-0x0FF are the hardware's values from the nocash docs; 0x100-0x1FF are fitted to them so that
+// each set of 4 taps sums to 0x7FFF, so the middle taps can be a few steps off the console's
+static const int16_t gauss[512] = {
+  -0x001, -0x001, -0x001, -0x001, -0x001, -0x001, -0x001, -0x001,
+  -0x001, -0x001, -0x001, -0x001, -0x001, -0x001, -0x001, -0x001,
+  0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0001,
+  0x0001, 0x0001, 0x0001, 0x0002, 0x0002, 0x0002, 0x0003, 0x0003,
+  0x0003, 0x0004, 0x0004, 0x0005, 0x0005, 0x0006, 0x0007, 0x0007,
+  0x0008, 0x0009, 0x0009, 0x000A, 0x000B, 0x000C, 0x000D, 0x000E,
+  0x000F, 0x0010, 0x0011, 0x0012, 0x0013, 0x0015, 0x0016, 0x0018,
+  0x0019, 0x001B, 0x001C, 0x001E, 0x0020, 0x0021, 0x0023, 0x0025,
+  0x0027, 0x0029, 0x002C, 0x002E, 0x0030, 0x0033, 0x0035, 0x0038,
+  0x003A, 0x003D, 0x0040, 0x0043, 0x0046, 0x0049, 0x004D, 0x0050,
+  0x0054, 0x0057, 0x005B, 0x005F, 0x0063, 0x0067, 0x006B, 0x006F,
+  0x0074, 0x0078, 0x007D, 0x0082, 0x0087, 0x008C, 0x0091, 0x0096,
+  0x009C, 0x00A1, 0x00A7, 0x00AD, 0x00B3, 0x00BA, 0x00C0, 0x00C7,
+  0x00CD, 0x00D4, 0x00DB, 0x00E3, 0x00EA, 0x00F2, 0x00FA, 0x0101,
+  0x010A, 0x0112, 0x011B, 0x0123, 0x012C, 0x0135, 0x013F, 0x0148,
+  0x0152, 0x015C, 0x0166, 0x0171, 0x017B, 0x0186, 0x0191, 0x019C,
+  0x01A8, 0x01B4, 0x01C0, 0x01CC, 0x01D9, 0x01E5, 0x01F2, 0x0200,
+  0x020D, 0x021B, 0x0229, 0x0237, 0x0246, 0x0255, 0x0264, 0x0273,
+  0x0283, 0x0293, 0x02A3, 0x02B4, 0x02C4, 0x02D6, 0x02E7, 0x02F9,
+  0x030B, 0x031D, 0x0330, 0x0343, 0x0356, 0x036A, 0x037E, 0x0392,
+  0x03A7, 0x03BC, 0x03D1, 0x03E7, 0x03FC, 0x0413, 0x042A, 0x0441,
+  0x0458, 0x0470, 0x0488, 0x04A0, 0x04B9, 0x04D2, 0x04EC, 0x0506,
+  0x0520, 0x053B, 0x0556, 0x0572, 0x058E, 0x05AA, 0x05C7, 0x05E4,
+  0x0601, 0x061F, 0x063E, 0x065C, 0x067C, 0x069B, 0x06BB, 0x06DC,
+  0x06FD, 0x071E, 0x0740, 0x0762, 0x0784, 0x07A7, 0x07CB, 0x07EE,
+  0x0813, 0x0837, 0x085C, 0x0882, 0x08A7, 0x08CE, 0x08F4, 0x091B,
+  0x0943, 0x096B, 0x0993, 0x09BC, 0x09E5, 0x0A0E, 0x0A38, 0x0A62,
+  0x0A8D, 0x0AB8, 0x0AE3, 0x0B0F, 0x0B3B, 0x0B68, 0x0B95, 0x0BC2,
+  0x0BF0, 0x0C1E, 0x0C4D, 0x0C7C, 0x0CAB, 0x0CDB, 0x0D0B, 0x0D3B,
+  0x0D6C, 0x0D9D, 0x0DCF, 0x0E01, 0x0E33, 0x0E66, 0x0E99, 0x0ECC,
+  0x0F00, 0x0F34, 0x0F68, 0x0F9D, 0x0FD2, 0x1007, 0x103D, 0x1073,
+  0x10A9, 0x10DF, 0x1116, 0x114D, 0x1184, 0x11BC, 0x11F3, 0x122B,
+  0x1263, 0x129E, 0x12D9, 0x1315, 0x1352, 0x138F, 0x13CD, 0x140B,
+  0x144A, 0x148A, 0x14CA, 0x150B, 0x154C, 0x158E, 0x15D1, 0x1614,
+  0x1657, 0x169B, 0x16E0, 0x1726, 0x176B, 0x17B2, 0x17F9, 0x1841,
+  0x1889, 0x18D2, 0x191B, 0x1965, 0x19AF, 0x19FA, 0x1A46, 0x1A92,
+  0x1ADF, 0x1B2C, 0x1B7A, 0x1BC8, 0x1C17, 0x1C67, 0x1CB6, 0x1D07,
+  0x1D58, 0x1DAA, 0x1DFC, 0x1E4F, 0x1EA2, 0x1EF5, 0x1F4A, 0x1F9E,
+  0x1FF4, 0x204A, 0x20A0, 0x20F7, 0x214E, 0x21A6, 0x21FE, 0x2256,
+  0x22B0, 0x2309, 0x2363, 0x23BE, 0x2419, 0x2474, 0x24D0, 0x252C,
+  0x2589, 0x25E6, 0x2643, 0x26A1, 0x2700, 0x275E, 0x27BE, 0x281D,
+  0x287D, 0x28DD, 0x293D, 0x299E, 0x29FF, 0x2A61, 0x2AC2, 0x2B24,
+  0x2B86, 0x2BE9, 0x2C4C, 0x2CAF, 0x2D12, 0x2D76, 0x2DDA, 0x2E3E,
+  0x2EA2, 0x2F07, 0x2F6C, 0x2FD1, 0x3036, 0x309B, 0x3101, 0x3167,
+  0x31CC, 0x3232, 0x3298, 0x32FF, 0x3365, 0x33CB, 0x3432, 0x3498,
+  0x34FF, 0x3565, 0x35CC, 0x3633, 0x3699, 0x3700, 0x3766, 0x37CD,
+  0x3834, 0x389A, 0x3901, 0x3968, 0x39CE, 0x3A34, 0x3A9A, 0x3B01,
+  0x3B66, 0x3BCC, 0x3C32, 0x3C97, 0x3CFD, 0x3D61, 0x3DC6, 0x3E2B,
+  0x3E90, 0x3EF4, 0x3F58, 0x3FBB, 0x401E, 0x4082, 0x40E5, 0x4147,
+  0x41A9, 0x420B, 0x426D, 0x42CE, 0x432E, 0x438E, 0x43EF, 0x444E,
+  0x44AE, 0x450C, 0x456A, 0x45C8, 0x4625, 0x4682, 0x46DF, 0x473A,
+  0x4795, 0x47F0, 0x484A, 0x48A4, 0x48FD, 0x4956, 0x49AE, 0x4A05,
+  0x4A5B, 0x4AB1, 0x4B07, 0x4B5B, 0x4BB0, 0x4C03, 0x4C56, 0x4CA8,
+  0x4CFA, 0x4D4A, 0x4D9A, 0x4DEA, 0x4E38, 0x4E86, 0x4ED3, 0x4F1F,
+  0x4F6B, 0x4FB5, 0x4FFF, 0x5048, 0x5090, 0x50D8, 0x511E, 0x5164,
+  0x51A9, 0x51ED, 0x5230, 0x5273, 0x52B4, 0x52F5, 0x5335, 0x5373,
+  0x53B1, 0x53EE, 0x542A, 0x5464, 0x549F, 0x54D9, 0x5510, 0x5548,
+  0x557E, 0x55B4, 0x55E8, 0x561C, 0x564F, 0x5680, 0x56B1, 0x56E1,
+  0x5710, 0x573D, 0x576B, 0x5796, 0x57C1, 0x57EC, 0x5814, 0x583D,
+  0x5864, 0x588A, 0x58AF, 0x58D4, 0x58F7, 0x5919, 0x593A, 0x595B,
+  0x597A, 0x5998, 0x59B6, 0x59D2, 0x59ED, 0x5A08, 0x5A21, 0x5A3A,
+  0x5A51, 0x5A69, 0x5A7E, 0x5A93, 0x5AA6, 0x5AB9, 0x5ACB, 0x5ADC,
+  0x5AEC, 0x5AFB, 0x5B0A, 0x5B17, 0x5B23, 0x5B2F, 0x5B39, 0x5B43,
+  0x5B4C, 0x5B54, 0x5B5B, 0x5B61, 0x5B67, 0x5B6B, 0x5B6F, 0x5B72,
+};
+
+// the noise generator for the next n frames: a 16-bit LFSR shifted at the clock in bits 8-13 of the
+// control register, the upper 4 bits of which double its rate and the lower 2 add a bit to it
+static void render_noise(int16_t *out, const int n) {
+  const uint16_t ctrl = regs[REG_CTRL >> 1];
+  const int shift = (ctrl >> 10) & 0x0F;
+  const int step = ((ctrl >> 8) & 3) + 4;
+  for (int f = 0; f < n; ++f) {
+    const uint16_t l = noise_level;
+    const int parity = ((l >> 15) ^ (l >> 12) ^ (l >> 11) ^ (l >> 10) ^ 1) & 1;
+    noise_timer -= step;
+    if (noise_timer < 0) {
+      noise_level = (int16_t)((l << 1) | parity);
+      noise_timer += 0x20000 >> shift;
+      if (noise_timer < 0)
+        noise_timer += 0x20000 >> shift;
+    }
+    out[f] = noise_level;
+  }
+}
+
+// steps a voice through n frames, writes its enveloped samples to out and zeroes out up to a multiple of 8;
+// voices in noise mode play `noise` instead of their samples, but still go through them
+static void render_voice(const int i, int16_t *out, const int n, const int16_t *noise) {
+  struct voice *v = &voices[i];
+  uint32_t pitch = voice_reg(i, REG_PITCH);
+  if (pitch > MAX_PITCH) pitch = MAX_PITCH;
+  // the ADSR registers may have changed since the last call
+  v->rate = env_rate(i, v->phase);
+
+  int f;
+  for (f = 0; f < n && v->phase != PHASE_OFF; ++f) {
+    const int g = (v->counter >> 4) & 0xFF;
+    const int16_t *s = v->buf + HISTORY + (v->counter >> 12);
+    int32_t sample;
+    if (noise) {
+      sample = noise[f];
+    } else {
+      sample = (gauss[0x0FF - g] * s[-3]) >> 15;
+      sample += (gauss[0x1FF - g] * s[-2]) >> 15;
+      sample += (gauss[0x100 + g] * s[-1]) >> 15;
+      sample += (gauss[0x000 + g] * s[0]) >> 15;
+    }
+    out[f] = (sample * v->env) >> 15;
+
+    env_tick(v);
+    v->counter += pitch;
+    while (v->phase != PHASE_OFF && (v->counter >> 12) >= BLOCK_LEN) {
+      v->counter -= BLOCK_LEN << 12;
+      next_block(i);
+    }
+  }
+
+  for (; f < ((n + 7) & ~7); ++f)
+    out[f] = 0;
+}
+
+static void mix_voice_scalar(int32_t *acc_l, int32_t *acc_r, const int16_t *in, const int32_t vol_l, const int32_t vol_r, const int n) {
+  for (int i = 0; i < n; ++i) {
+    acc_l[i] += (in[i] * vol_l) >> 15;
+    acc_r[i] += (in[i] * vol_r) >> 15;
+  }
+}
+
+// for voices with a sweep going: the volumes change every sample, so there's no SIMD version of this
+static void mix_voice_sweep(int32_t *acc_l, int32_t *acc_r, const int16_t *in, const int v, const int n) {
+  struct vol *vol = voice_vols[v];
+  const uint16_t val_l = voice_reg(v, REG_VOL_LEFT);
+  const uint16_t val_r = voice_reg(v, REG_VOL_RIGHT);
+  for (int i = 0; i < n; ++i) {
+    acc_l[i] += (in[i] * vol[0].level) >> 15;
+    acc_r[i] += (in[i] * vol[1].level) >> 15;
+    if (val_l & VOL_SWEEP) vol_tick(&vol[0], val_l);
+    if (val_r & VOL_SWEEP) vol_tick(&vol[1], val_r);
+  }
+}
+
+// the main volume applies to the sum of the voices, before it's clamped; a few voices at full volume
+// are enough to overflow 32 bits when that's scaled, so it's done in 64
+static void mix_main(int32_t *acc_l, int32_t *acc_r, const int n) {
+  const uint16_t val_l = regs[REG_MAIN_LEFT >> 1];
+  const uint16_t val_r = regs[REG_MAIN_RIGHT >> 1];
+  for (int i = 0; i < n; ++i) {
+    acc_l[i] = (int32_t)(((int64_t)acc_l[i] * main_vols[0].level) >> 15);
+    acc_r[i] = (int32_t)(((int64_t)acc_r[i] * main_vols[1].level) >> 15);
+    if (val_l & VOL_SWEEP) vol_tick(&main_vols[0], val_l);
+    if (val_r & VOL_SWEEP) vol_tick(&main_vols[1], val_r);
+  }
+}
+
+static void mix_output_scalar(int16_t *out, const int32_t *acc_l, const int32_t *acc_r, const int n) {
+  for (int i = 0; i < n; ++i) {
+    out[i * 2 + 0] = (acc_l[i] > 0x7FFF) ? 0x7FFF : (acc_l[i] < -0x8000) ? -0x8000 : acc_l[i];
+    out[i * 2 + 1] = (acc_r[i] > 0x7FFF) ? 0x7FFF : (acc_r[i] < -0x8000) ? -0x8000 : acc_r[i];
+  }
+}
+
+#ifdef SPUEMU_HAVE_X86_SIMD
+
+// n is a multiple of 8 in all of these, the buffers are padded for it
+
+__attribute__((target("sse2")))
+static void mix_voice_sse2(int32_t *acc_l, int32_t *acc_r, const int16_t *in, const int32_t vol_l, const int32_t vol_r, const int n) {
+  const __m128i vl = _mm_set1_epi16(vol_l);
+  const __m128i vr = _mm_set1_epi16(vol_r);
+  for (int i = 0; i < n; i += 8) {
+    const __m128i s = _mm_loadu_si128((const __m128i *)(in + i));
+    // full 32-bit products from the low and high halves
+    const __m128i lo_l = _mm_mullo_epi16(s, vl);
+    const __m128i hi_l = _mm_mulhi_epi16(s, vl);
+    const __m128i lo_r = _mm_mullo_epi16(s, vr);
+    const __m128i hi_r = _mm_mulhi_epi16(s, vr);
+    __m128i *al = (__m128i *)(acc_l + i);
+    __m128i *ar = (__m128i *)(acc_r + i);
+    _mm_storeu_si128(al + 0, _mm_add_epi32(_mm_loadu_si128(al + 0), _mm_srai_epi32(_mm_unpacklo_epi16(lo_l, hi_l), 15)));
+    _mm_storeu_si128(al + 1, _mm_add_epi32(_mm_loadu_si128(al + 1), _mm_srai_epi32(_mm_unpackhi_epi16(lo_l, hi_l), 15)));
+    _mm_storeu_si128(ar + 0, _mm_add_epi32(_mm_loadu_si128(ar + 0), _mm_srai_epi32(_mm_unpacklo_epi16(lo_r, hi_r), 15)));
+    _mm_storeu_si128(ar + 1, _mm_add_epi32(_mm_loadu_si128(ar + 1), _mm_srai_epi32(_mm_unpackhi_epi16(lo_r, hi_r), 15)));
+  }
+}
+
+__attribute__((target("sse2")))
+static void mix_output_sse2(int16_t *out, const int32_t *acc_l, const int32_t *acc_r, const int n) {
+  for (int i = 0; i < n; i += 8) {
+    const __m128i l = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)(acc_l + i)), _mm_loadu_si128((const __m128i *)(acc_l + i + 4)));
+    const __m128i r = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)(acc_r + i)), _mm_loadu_si128((const __m128i *)(acc_r + i + 4)));
+    _mm_storeu_si128((__m128i *)(out + i * 2), _mm_unpacklo_epi16(l, r));
+    _mm_storeu_si128((__m128i *)(out + i * 2 + 8), _mm_unpackhi_epi16(l, r));
+  }
+}
+
+__attribute__((target("avx2")))
+static void mix_voice_avx2(int32_t *acc_l, int32_t *acc_r, const int16_t *in, const int32_t vol_l, const int32_t vol_r, const int n) {
+  const __m256i vl = _mm256_set1_epi32(vol_l);
+  const __m256i vr = _mm256_set1_epi32(vol_r);
+  for (int i = 0; i < n; i += 8) {
+    const __m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + i)));
+    __m256i *al = (__m256i *)(acc_l + i);
+    __m256i *ar = (__m256i *)(acc_r + i);
+    _mm256_storeu_si256(al, _mm256_add_epi32(_mm256_loadu_si256(al), _mm256_srai_epi32(_mm256_mullo_epi32(s, vl), 15)));
+    _mm256_storeu_si256(ar, _mm256_add_epi32(_mm256_loadu_si256(ar), _mm256_srai_epi32(_mm256_mullo_epi32(s, vr), 15)));
+  }
+}
+
+#endif
+
+static psx_audio_simd_t simd_level = PSX_AUDIO_SIMD_NONE;
+static mix_voice_t mix_voice = mix_voice_scalar;
+static mix_output_t mix_output = mix_output_scalar;
+
+psx_audio_simd_t spuemu_set_simd(psx_audio_simd_t simd) {
+  psx_audio_simd_t supported = PSX_AUDIO_SIMD_NONE;
+#ifdef SPUEMU_HAVE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    supported = PSX_AUDIO_SIMD_AVX2;
+  else if (__builtin_cpu_supports("sse2"))
+    supported = PSX_AUDIO_SIMD_SSE2;
+#endif
+
+  if (simd == PSX_AUDIO_SIMD_AUTO || simd > supported)
+    simd = supported;
+
+  simd_level = simd;
+  switch (simd) {
+#ifdef SPUEMU_HAVE_X86_SIMD
+    case PSX_AUDIO_SIMD_AVX2: mix_voice = mix_voice_avx2; mix_output = mix_output_sse2; break;
+    case PSX_AUDIO_SIMD_SSE2: mix_voice = mix_voice_sse2; mix_output = mix_output_sse2; break;
+#endif
+    default: mix_voice = mix_voice_scalar; mix_output = mix_output_scalar; simd_level = PSX_AUDIO_SIMD_NONE; break;
+  }
+
+  return simd_level;
+}
+
+psx_audio_simd_t spuemu_get_simd(void) {
+  return simd_level;
+}
+
+#ifdef SPUEMU_HAVE_X86_SIMD
+__attribute__((constructor))
+static void init_simd(void) {
+  spuemu_set_simd(PSX_AUDIO_SIMD_AUTO);
+}
+#endif
+
+void spuemu_render(int16_t *out, const uint32_t frames) {
+  int16_t voice_buf[MIX_CHUNK];
+  int32_t acc_l[MIX_CHUNK];
+  int32_t acc_r[MIX_CHUNK];
+  int16_t out_buf[MIX_CHUNK * 2];
+  int16_t noise_buf[MIX_CHUNK];
+
+  for (uint32_t done = 0; done < frames; ) {
+    const int n = (frames - done > MIX_CHUNK) ? MIX_CHUNK : frames - done;
+    const int n8 = (n + 7) & ~7;
+    memset(acc_l, 0, n8 * sizeof(int32_t));
+    memset(acc_r, 0, n8 * sizeof(int32_t));
+
+    // the generator only matters while some voice listens to it
+    const uint32_t noise_on = regs[REG_NOISE_LO >> 1] | ((uint32_t)regs[REG_NOISE_HI >> 1] << 16);
+    if (noise_on)
+      render_noise(noise_buf, n);
+
+    for (int i = 0; i < SPUEMU_NUM_VOICES; ++i) {
+      if (voices[i].phase == PHASE_OFF) {
+        // sweeps keep going on silent voices
+        for (int j = 0; j < 2; ++j) {
+          const uint16_t val = voice_reg(i, REG_VOL_LEFT + j * 2);
+          for (int f = 0; (val & VOL_SWEEP) && f < n; ++f)
+            vol_tick(&voice_vols[i][j], val);
+        }
+        continue;
+      }
+      // fixed volumes can only change between calls
+      render_voice(i, voice_buf, n, (noise_on & (1u << i)) ? noise_buf : NULL);
+      if ((voice_reg(i, REG_VOL_LEFT) | voice_reg(i, REG_VOL_RIGHT)) & VOL_SWEEP)
+        mix_voice_sweep(acc_l, acc_r, voice_buf, i, n);
+      else
+        mix_voice(acc_l, acc_r, voice_buf, voice_vols[i][0].level, voice_vols[i][1].level, n8);
+    }
+    mix_main(acc_l, acc_r, n);
+
+    if (n == n8) {
+      mix_output(out + done * 2, acc_l, acc_r, n);
+    } else {
+      mix_output(out_buf, acc_l, acc_r, n8);
+      memcpy(out + done * 2, out_buf, n * 2 * sizeof(int16_t));
+    }
+    done += n;
+  }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "libpsxav/libpsxav.h"
+
+// SPU emulator for rendering what the player does on the host: decodes the ADPCM in SPU RAM with
+// its loop flags, steps voices by their pitch with 4-tap Gaussian interpolation, runs the ADSR
+// envelopes on key on/off and mixes the voices with their volumes, fixed or sweeping, and the main volume;
+// voices in noise mode play the noise generator instead. there is only one SPU, like on the console;
+// no reverb or pitch modulation
+
+#define SPUEMU_FREQ 44100
+#define SPUEMU_RAM_SIZE (512 * 1024)
+#define SPUEMU_NUM_VOICES 24
+
+void spuemu_reset(void);
+// reg is the offset from 0x1F801C00
+void spuemu_write(const uint32_t reg, const uint16_t val);
+uint16_t spuemu_read(const uint32_t reg);
+void spuemu_write_ram(const uint32_t addr, const void *data, const uint32_t len);
+void spuemu_read_ram(const uint32_t addr, void *data, const uint32_t len);
+// renders the next `frames` stereo frames, interleaved
+void spuemu_render(int16_t *out, const uint32_t frames);
+// mixing gives the same output at every level; returns the level that will actually be used
+psx_audio_simd_t spuemu_set_simd(psx_audio_simd_t simd);
+psx_audio_simd_t spuemu_get_simd(void);
@@ -0,0 +1,415 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "types.h"
+#include "sputrace.h"
+#include "reglog.h"
+
+// summarises and compares SPU register write traces (see ../src/sputrace.h): from orgrender -w -r, or
+// the player's ring cut out of a RAM dump
+
+#define NUM_VOICES 24
+#define NUM_REGS 0x100 // registers are 16 bits, offsets below 0x200
+#define VOICE_REGS 8
+
+#define REG_KEY_ON_LO  0x188
+#define REG_KEY_ON_HI  0x18A
+#define REG_KEY_OFF_LO 0x18C
+#define REG_KEY_OFF_HI 0x18E
+
+struct trace {
+  spu_trace_rec_t *recs; // in order
+  uint32_t num_recs;
+  uint32_t first_tick;
+  uint32_t num_ticks; // from first_tick to the last one with a write
+  bool wrapped; // from a ring that had wrapped around, the first tick is cut off
+};
+
+struct summary {
+  uint32_t writes;
+  uint32_t redundant; // same value as the last write to the register, key on/off don't count
+  uint32_t *tick_writes; // [num_ticks]
+  uint32_t max_tick;
+  uint32_t reg_writes[NUM_REGS];
+  uint32_t reg_redundant[NUM_REGS];
+  uint32_t voice_writes[NUM_VOICES];
+  uint32_t voice_redundant[NUM_VOICES];
+  uint32_t voice_key_on[NUM_VOICES];
+  uint32_t voice_key_off[NUM_VOICES];
+};
+
+static int num_busiest = 5;
+
+static inline bool is_strobe(const uint16_t reg) {
+  return reg >= REG_KEY_ON_LO && reg <= REG_KEY_OFF_HI;
+}
+
+static bool valid_header(const spu_trace_header_t *hdr) {
+  return hdr->magic == SPU_TRACE_MAGIC && hdr->version == SPU_TRACE_VERSION &&
+    hdr->rec_size == sizeof(spu_trace_rec_t) && (!hdr->ring_len || (hdr->num_recs <= hdr->ring_len && hdr->head < hdr->ring_len));
+}
+
+// a trace file, or anything with a ring in it: the first header found at a 4 byte boundary is used
+static bool load_trace(const char *fname, struct trace *t) {
+  FILE *f = fopen(fname, "rb");
+  if (!f) {
+    fprintf(stderr, "error: could not open '%s'\n", fname);
+    return false;
+  }
+  fseek(f, 0, SEEK_END);
+  const long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *data = malloc(size > 0 ? size : 1);
+  if (!data || fread(data, 1, size, f) != (size_t)size) {
+    fprintf(stderr, "error: could not read '%s'\n", fname);
+    fclose(f);
+    free(data);
+    return false;
+  }
+  fclose(f);
+
+  const spu_trace_header_t *hdr = NULL;
+  long ofs = 0;
+  for (; ofs + (long)sizeof(*hdr) <= size; ofs += 4) {
+    spu_trace_header_t tmp;
+    memcpy(&tmp, data + ofs, sizeof(tmp));
+    if (valid_header(&tmp)) {
+      hdr = (const spu_trace_header_t *)(data + ofs);
+      break;
+    }
+  }
+  if (!hdr) {
+    fprintf(stderr, "error: no SPU trace in '%s'\n", fname);
+    free(data);
+    return false;
+  }
+
+  const uint8_t *recs = data + ofs + sizeof(*hdr);
+  const uint32_t avail = (size - ofs - sizeof(*hdr)) / sizeof(spu_trace_rec_t);
+  uint32_t num = hdr->num_recs;
+  uint32_t start = 0;
+  if (hdr->ring_len) {
+    if (avail < hdr->ring_len) {
+      fprintf(stderr, "error: the SPU trace ring in '%s' is cut off\n", fname);
+      free(data);
+      return false;
+    }
+    // once it's full, the oldest record is the next one to be overwritten
+    if (num == hdr->ring_len)
+      start = hdr->head;
+  } else if (!num || num > avail) {
+    // orgrender didn't get to finish it, go by the size
+    num = avail;
+  }
+
+  memset(t, 0, sizeof(*t));
+  t->recs = malloc((num ? num : 1) * sizeof(spu_trace_rec_t));
+  if (!t->recs) {
+    free(data);
+    return false;
+  }
+  const uint32_t len = hdr->ring_len ? hdr->ring_len : num;
+  for (uint32_t i = 0; i < num; ++i)
+    memcpy(&t->recs[i], recs + ((start + i) % len) * sizeof(spu_trace_rec_t), sizeof(spu_trace_rec_t));
+  t->num_recs = num;
+  t->wrapped = start != 0;
+  if (num) {
+    t->first_tick = t->recs[0].tick;
+    t->num_ticks = t->recs[num - 1].tick - t->first_tick + 1;
+  }
+
+  free(data);
+  return true;
+}
+
+static void free_trace(struct trace *t) {
+  free(t->recs);
+  t->recs = NULL;
+}
+
+static void summarise(const struct trace *t, struct summary *s) {
+  memset(s, 0, sizeof(*s));
+  s->tick_writes = calloc(t->num_ticks ? t->num_ticks : 1, sizeof(uint32_t));
+
+  // what every register was last set to, as far as the trace knows
+  uint32_t last[NUM_REGS];
+  bool known[NUM_REGS] = { false };
+  for (uint32_t i = 0; i < t->num_recs; ++i) {
+    const spu_trace_rec_t *r = &t->recs[i];
+    const uint32_t tick = r->tick - t->first_tick;
+    ++s->writes;
+    if (tick < t->num_ticks && ++s->tick_writes[tick] > s->tick_writes[s->max_tick])
+      s->max_tick = tick;
+
+    const uint32_t idx = (r->reg >> 1) % NUM_REGS;
+    const bool redundant = !is_strobe(r->reg) && known[idx] && last[idx] == r->val;
+    last[idx] = r->val;
+    known[idx] = true;
+    ++s->reg_writes[idx];
+    s->redundant += redundant;
+    s->reg_redundant[idx] += redundant;
+
+    if (r->reg < NUM_VOICES * 0x10) {
+      ++s->voice_writes[r->reg >> 4];
+      s->voice_redundant[r->reg >> 4] += redundant;
+    } else if (is_strobe(r->reg)) {
+      const uint32_t shift = (r->reg & 2) ? 16 : 0;
+      uint32_t *count = (r->reg < REG_KEY_OFF_LO) ? s->voice_key_on : s->voice_key_off;
+      for (uint32_t v = 0; v < 16; ++v)
+        if ((r->val & (1 << v)) && v + shift < NUM_VOICES)
+          ++count[v + shift];
+    }
+  }
+}
+
+static void free_summary(struct summary *s) {
+  free(s->tick_writes);
+  s->tick_writes = NULL;
+}
+
+static inline double percent(const uint32_t part, const uint32_t whole) {
+  return whole ? part * 100.0 / whole : 0.0;
+}
+
+// voice registers are added up over all the voices
+static uint32_t reg_total(const uint32_t *counts, const uint32_t idx) {
+  if (idx >= VOICE_REGS)
+    return counts[idx];
+  uint32_t sum = 0;
+  for (uint32_t v = 0; v < NUM_VOICES; ++v)
+    sum += counts[v * VOICE_REGS + idx];
+  return sum;
+}
+
+static const char *reg_row_name(const uint32_t idx, char *buf, const size_t size) {
+  if (idx < VOICE_REGS)
+    return reglog_voice_reg_name(idx << 1);
+  return reglog_reg_name(idx << 1, buf, size);
+}
+
+static void print_overview(const char *fname, const struct trace *t, const struct summary *s) {
+  printf("%s: %u writes in ticks %u-%u", fname, s->writes, t->first_tick, t->first_tick + t->num_ticks - 1);
+  if (t->wrapped)
+    printf(" (ring, tick %u is cut off)", t->first_tick);
+  printf(", %.1f per tick, most %u at tick %u, %u redundant (%.1f%%)\n",
+    t->num_ticks ? (double)s->writes / t->num_ticks : 0.0, s->tick_writes[s->max_tick], t->first_tick + s->max_tick,
+    s->redundant, percent(s->redundant, s->writes));
+}
+
+static int print_summary(const char *fname) {
+  struct trace t;
+  if (!load_trace(fname, &t))
+    return -2;
+  struct summary s;
+  summarise(&t, &s);
+
+  print_overview(fname, &t, &s);
+  if (t.first_tick == 0 && !t.wrapped)
+    printf("before the first tick: %u writes\n", s.tick_writes[0]);
+
+  // the busiest ticks, biggest first
+  printf("busiest ticks:");
+  uint32_t prev_count = UINT32_MAX, prev_tick = 0;
+  for (int n = 0; n < num_busiest; ++n) {
+    uint32_t best = UINT32_MAX;
+    for (uint32_t i = 0; i < t.num_ticks; ++i) {
+      const uint32_t c = s.tick_writes[i];
+      // after the one printed last: fewer writes, or as many at a later tick
+      if (c > prev_count || (c == prev_count && i <= prev_tick) || (t.first_tick + i == 0))
+        continue;
+      if (best == UINT32_MAX || c > s.tick_writes[best])
+        best = i;
+    }
+    if (best == UINT32_MAX)
+      break;
+    printf(" %u (%u)", t.first_tick + best, s.tick_writes[best]);
+    prev_count = s.tick_writes[best];
+    prev_tick = best;
+  }
+  printf("\n\n");
+
+  printf("register          writes  redundant\n");
+  for (uint32_t idx = 0; idx < NUM_REGS; ++idx) {
+    if (idx >= VOICE_REGS && idx < NUM_VOICES * VOICE_REGS)
+      continue;
+    const uint32_t n = reg_total(s.reg_writes, idx);
+    if (!n)
+      continue;
+    char name[64];
+    const uint32_t red = reg_total(s.reg_redundant, idx);
+    printf("%-16s %7u %6u %3.0f%%\n", reg_row_name(idx, name, sizeof(name)), n, red, percent(red, n));
+  }
+
+  printf("\nvoice  writes  redundant  key on  key off\n");
+  for (uint32_t v = 0; v < NUM_VOICES; ++v) {
+    if (!s.voice_writes[v] && !s.voice_key_on[v] && !s.voice_key_off[v])
+      continue;
+    printf("%5u %7u %6u %3.0f%% %7u %8u\n", v, s.voice_writes[v], s.voice_redundant[v],
+      percent(s.voice_redundant[v], s.voice_writes[v]), s.voice_key_on[v], s.voice_key_off[v]);
+  }
+
+  free_summary(&s);
+  free_trace(&t);
+  return 0;
+}
+
+// in reglog form, one tick per tick of the trace from its first one, to diff them with reglog_diff()
+static void trace_to_reglog(const struct trace *t, struct reg_log *log) {
+  reglog_init(log);
+  uint32_t i = 0;
+  for (uint32_t tick = 0; tick < t->num_ticks; ++tick) {
+    reglog_tick(log);
+    for (; i < t->num_recs && t->recs[i].tick - t->first_tick == tick; ++i)
+      reglog_write(log, t->recs[i].reg, t->recs[i].val);
+  }
+}
+
+static void print_write(const struct reg_write *w) {
+  char name[64];
+  if (w)
+    printf("%s = 0x%04X", reglog_reg_name(w->reg, name, sizeof(name)), w->val);
+  else
+    printf("nothing");
+}
+
+static void print_count_diff(const char *name, const uint32_t a, const uint32_t b) {
+  printf("%-16s %7u %7u %+7d", name, a, b, (int)(b - a));
+  if (a)
+    printf(" %+6.1f%%", percent(b, a) - 100.0);
+  printf("\n");
+}
+
+// returns 0 if the traces have the same writes in the same ticks, 1 if not
+static int diff_traces(const char *fname_a, const char *fname_b) {
+  struct trace ta, tb;
+  if (!load_trace(fname_a, &ta))
+    return -2;
+  if (!load_trace(fname_b, &tb)) {
+    free_trace(&ta);
+    return -2;
+  }
+  struct summary sa, sb;
+  summarise(&ta, &sa);
+  summarise(&tb, &sb);
+  print_overview(fname_a, &ta, &sa);
+  print_overview(fname_b, &tb, &sb);
+  if (ta.first_tick != tb.first_tick)
+    printf("they start at different ticks, comparing them from their first ones\n");
+
+  struct reg_log la, lb;
+  trace_to_reglog(&ta, &la);
+  trace_to_reglog(&tb, &lb);
+  struct reg_log_diff diff;
+  const bool writes_differ = reglog_diff(&la, &lb, &diff);
+  const bool differ = writes_differ || la.num_ticks != lb.num_ticks;
+  if (!differ) {
+    printf("same writes in every tick\n");
+  } else {
+    if (writes_differ) {
+      printf("first difference at tick %u, write %u: ", ta.first_tick + diff.tick, diff.index);
+      print_write(diff.a);
+      printf(" vs ");
+      print_write(diff.b);
+      printf("\n");
+    }
+    if (la.num_ticks != lb.num_ticks)
+      printf("%u ticks vs %u\n", la.num_ticks, lb.num_ticks);
+
+    // where the number of writes changed
+    const uint32_t num_ticks = la.num_ticks < lb.num_ticks ? la.num_ticks : lb.num_ticks;
+    uint32_t changed = 0, more = 0, fewer = 0, worst = 0;
+    int worst_delta = 0;
+    for (uint32_t i = 0; i < num_ticks; ++i) {
+      const int delta = (int)sb.tick_writes[i] - (int)sa.tick_writes[i];
+      if (!delta)
+        continue;
+      ++changed;
+      if (delta > 0) ++more;
+      else ++fewer;
+      if (abs(delta) > abs(worst_delta)) {
+        worst_delta = delta;
+        worst = i;
+      }
+    }
+    printf("%u of %u ticks have a different number of writes, %u more and %u fewer", changed, num_ticks, more, fewer);
+    if (changed)
+      printf(", most at tick %u: %u vs %u", ta.first_tick + worst, sa.tick_writes[worst], sb.tick_writes[worst]);
+    printf("\n");
+  }
+
+  printf("\n                       a       b    diff\n");
+  print_count_diff("writes", sa.writes, sb.writes);
+  print_count_diff("redundant", sa.redundant, sb.redundant);
+  for (uint32_t idx = 0; idx < NUM_REGS; ++idx) {
+    if (idx >= VOICE_REGS && idx < NUM_VOICES * VOICE_REGS)
+      continue;
+    const uint32_t a = reg_total(sa.reg_writes, idx), b = reg_total(sb.reg_writes, idx);
+    if (a == b)
+      continue;
+    char name[64];
+    print_count_diff(reg_row_name(idx, name, sizeof(name)), a, b);
+  }
+  for (uint32_t v = 0; v < NUM_VOICES; ++v) {
+    if (sa.voice_key_on[v] == sb.voice_key_on[v])
+      continue;
+    char name[32];
+    snprintf(name, sizeof(name), "voice %u key on", v);
+    print_count_diff(name, sa.voice_key_on[v], sb.voice_key_on[v]);
+  }
+
+  reglog_free(&la);
+  reglog_free(&lb);
+  free_summary(&sa);
+  free_summary(&sb);
+  free_trace(&ta);
+  free_trace(&tb);
+  return differ;
+}
+
+static void usage(void) {
+  printf("usage: sputrace [options] <trace>\n");
+  printf("       sputrace -d [options] <trace_a> <trace_b>\n");
+  printf("prints how many SPU register writes a trace has per tick, register and voice, and how many of\n");
+  printf("them wrote what the register already had; with -d, compares two traces and exits with 1 if they differ.\n");
+  printf("a trace is a file from orgrender -w -r, or anything with the player's trace ring in it, like a RAM dump\n");
+  printf("options:\n");
+  printf("  -d, --diff           compare two traces\n");
+  printf("  -b, --busiest <n>    ticks with the most writes to list (default: 5)\n");
+}
+
+int main(int argc, char **argv) {
+  static const struct option long_opts[] = {
+    { "diff",    no_argument,       NULL, 'd' },
+    { "busiest", required_argument, NULL, 'b' },
+    { "help",    no_argument,       NULL, 'h' },
+    { NULL,      0,                 NULL, 0   },
+  };
+
+  bool diff = false;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "db:h", long_opts, NULL)) != -1) {
+    switch (opt) {
+      case 'd': diff = true; break;
+      case 'b': num_busiest = atoi(optarg); if (num_busiest < 0) num_busiest = 0; break;
+      default: usage(); return -1;
+    }
+  }
+
+  argc -= optind;
+  argv += optind;
+
+  if (argc != (diff ? 2 : 1)) {
+    usage();
+    return -1;
+  }
+
+  if (diff)
+    return diff_traces(argv[0], argv[1]);
+
+  return print_summary(argv[0]);
+}